@@ -200,12 +200,151 @@ static void asm_jnc(struct asm *as, asm_label to) {
     asm_jump(as, 0x3, to);
 }
 
+static void asm_jnz(struct asm *as, asm_label to) {
+    asm_jump(as, 0x5, to);
+}
+
+static void asm_ja(struct asm *as, asm_label to) {
+    asm_jump(as, 0x7, to);
+}
+
 // movzx edx, byte [rsi]
 static void asm_load_char(struct asm *as) {
     uint8_t bytes[] = {0x0f, 0xb6, ASM_DX << 3 | ASM_SI};
     asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
 }
 
+// movzx ecx, byte [rbx+rdx]
+static void asm_load_char_class(struct asm *as) {
+    uint8_t bytes[] = {0x0f, 0xb6, 0x0c, 0x13};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// xor edx, edx
+// bts edx, ecx
+static void asm_make_char_class_bit(struct asm *as) {
+    uint8_t bytes[] = {0x31, 0xd2, 0x0f, 0xab, 0xca};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// test dl, imm8 (if `mask` fits) or test edx, imm32
+static void asm_test_char_class_mask(struct asm *as, uint32_t mask) {
+    if (mask <= UINT8_MAX) {
+        uint8_t bytes[] = {0xf6, 0xc2, mask};
+        asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    } else {
+        uint8_t bytes[] = {
+            0xf7,
+            0xc2,
+            mask & 0xff,
+            (mask >> 8) & 0xff,
+            (mask >> 16) & 0xff,
+            (mask >> 24) & 0xff,
+        };
+        asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    }
+}
+
+// test byte [rbx+rdx+offset], imm8
+static void asm_test_char_table(struct asm *as, uint32_t offset, uint8_t bit) {
+    if (offset < 128) {
+        uint8_t bytes[] = {0xf6, 0x44, 0x13, offset, bit};
+        asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    } else {
+        uint8_t bytes[] = {
+            0xf6,
+            0x84,
+            0x13,
+            offset & 0xff,
+            (offset >> 8) & 0xff,
+            (offset >> 16) & 0xff,
+            (offset >> 24) & 0xff,
+            bit,
+        };
+        asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    }
+}
+
+// mov r64, imm64
+static void asm_mov_r64_imm64(struct asm *as, enum asm_register r, uint64_t imm) {
+    uint8_t rex = 0x48;
+    if (r >= ASM_R8) {
+        rex |= 0x1;
+        r -= ASM_R8;
+    }
+    uint8_t bytes[] = {rex, 0xb8 | r};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    for (size_t i = 0; i < 8; ++i) {
+        uint8_t b = imm >> (8 * i);
+        asm_bytes(as, &b, 1);
+    }
+}
+
+// mov al, imm8
+static void asm_set_accepted_flag(struct asm *as, bool accepted) {
+    uint8_t bytes[] = {0xb0, accepted ? 1 : 0};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// lea rdx, [rsi+16]
+// cmp rdx, rdi
+static void asm_cmp_vector_end(struct asm *as) {
+    uint8_t bytes[] = {0x48, 0x8d, 0x56, 0x10, 0x48, 0x39, 0xfa};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// movdqu xmm0, [rsi]
+static void asm_load_vector(struct asm *as) {
+    uint8_t bytes[] = {0xf3, 0x0f, 0x6f, 0x06};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// movdqa xmm`dst`, xmm0
+// pcmpeqb xmm`dst`, [rbx+offset] (`offset` must be 16 byte aligned)
+static void asm_cmpeq_vector(struct asm *as, uint8_t dst, uint32_t offset) {
+    uint8_t bytes[] = {
+        0x66,
+        0x0f,
+        0x6f,
+        0xc0 | dst << 3,
+        0x66,
+        0x0f,
+        0x74,
+        0x83 | dst << 3,
+        offset & 0xff,
+        (offset >> 8) & 0xff,
+        (offset >> 16) & 0xff,
+        (offset >> 24) & 0xff,
+    };
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// por xmm1, xmm2
+static void asm_or_vector(struct asm *as) {
+    uint8_t bytes[] = {0x66, 0x0f, 0xeb, 0xca};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// pmovmskb edx, xmm1
+// test edx, edx
+static void asm_test_vector_mask(struct asm *as) {
+    uint8_t bytes[] = {0x66, 0x0f, 0xd7, 0xd1, 0x85, 0xd2};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// add rsi, 16
+static void asm_next_vector(struct asm *as) {
+    uint8_t bytes[] = {0x48, 0x83, 0xc6, 0x10};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// bsf edx, edx
+// add rsi, rdx
+static void asm_skip_to_vector_mask(struct asm *as) {
+    uint8_t bytes[] = {0x0f, 0xbc, 0xd2, 0x48, 0x01, 0xd6};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
 // xor r64, r64
 static void asm_xor_r64(struct asm *as, enum asm_register r1, enum asm_register r2) {
     asm_general_binop_r(as, 0x31, r1, r2);
@@ -256,6 +395,105 @@ static void asm_btr_r64(struct asm *as, enum asm_register r, uint8_t bit) {
     asm_btx_r64(as, ASM_BTR, r, bit);
 }
 
+// ModR/M (and displacement) for `[base+disp]` memory operand.
+// `base` must be r8-r11 (no SIB byte and no special encodings).
+static void
+asm_modrm_mem(struct asm *as, uint8_t reg_field, enum asm_register base, uint32_t disp) {
+    assert(ASM_R8 <= base && base <= ASM_R11);
+    uint8_t rm = base - ASM_R8;
+
+    if (disp < 128) {
+        uint8_t bytes[] = {0x40 | reg_field << 3 | rm, disp};
+        asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    } else {
+        uint8_t bytes[] = {
+            0x80 | reg_field << 3 | rm,
+            disp & 0xff,
+            (disp >> 8) & 0xff,
+            (disp >> 16) & 0xff,
+            (disp >> 24) & 0xff,
+        };
+        asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    }
+}
+
+// `op byte [base+disp], imm8` of the 0x80 (/digit) or 0xf6 (/0, test) group.
+static void asm_byte_mem_imm8(
+    struct asm *as,
+    uint8_t opcode,
+    uint8_t digit,
+    enum asm_register base,
+    uint32_t disp,
+    uint8_t imm
+) {
+    uint8_t prefix[] = {0x41, opcode};
+    asm_bytes(as, prefix, RCS_ARRAY_LEN(prefix));
+    asm_modrm_mem(as, digit, base, disp);
+    asm_bytes(as, &imm, 1);
+}
+
+// test byte [base+disp], imm8
+static void asm_test_byte_mem(struct asm *as, enum asm_register base, uint32_t disp, uint8_t imm) {
+    asm_byte_mem_imm8(as, 0xf6, 0, base, disp, imm);
+}
+
+// or byte [base+disp], imm8
+static void asm_or_byte_mem(struct asm *as, enum asm_register base, uint32_t disp, uint8_t imm) {
+    asm_byte_mem_imm8(as, 0x80, 1, base, disp, imm);
+}
+
+// and byte [base+disp], imm8
+static void asm_and_byte_mem(struct asm *as, enum asm_register base, uint32_t disp, uint8_t imm) {
+    asm_byte_mem_imm8(as, 0x80, 4, base, disp, imm);
+}
+
+// mov qword [base+disp], src
+static void asm_store_r64(
+    struct asm *as,
+    enum asm_register base,
+    uint32_t disp,
+    enum asm_register src
+) {
+    uint8_t rex = 0x49;
+    if (src >= ASM_R8) {
+        rex |= 0x4;
+        src -= ASM_R8;
+    }
+    uint8_t bytes[] = {rex, 0x89};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    asm_modrm_mem(as, src, base, disp);
+}
+
+// xchg r64, r64
+static void asm_xchg_r64(struct asm *as, enum asm_register r1, enum asm_register r2) {
+    asm_general_binop_r(as, 0x87, r1, r2);
+}
+
+// vpxor ymm0, ymm0, ymm0
+static void asm_zero_ymm0(struct asm *as) {
+    uint8_t bytes[] = {0xc5, 0xfd, 0xef, 0xc0};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// vmovdqu ymmword [base+disp], ymm0
+static void asm_store_ymm0(struct asm *as, enum asm_register base, uint32_t disp) {
+    // 3-byte VEX with inverted B bit set, since base is r8-r15
+    uint8_t bytes[] = {0xc4, 0xc1, 0x7e, 0x7f};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+    asm_modrm_mem(as, 0, base, disp);
+}
+
+static void asm_vzeroupper(struct asm *as) {
+    uint8_t bytes[] = {0xc5, 0xf8, 0x77};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
+// setnz r8
+static void asm_setnz_r8(struct asm *as, enum asm_register r) {
+    uint8_t bytes[] = {0x0f, 0x95, 0xc0 | r};
+    asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
+}
+
 static void asm_setc_r8(struct asm *as, enum asm_register r) {
     uint8_t bytes[] = {0x0f, 0x92, 0xc0 | r};
     asm_bytes(as, bytes, RCS_ARRAY_LEN(bytes));
@@ -2,6 +2,7 @@
 #include "../api.h"
 #include "../common.h"
 #include "../mmap.h"
+#include "../standard.h"
 #include "../vec.h"
 #include <assert.h>
 #include <errno.h>
@@ -22,10 +23,13 @@
 // 0-th byte (lowest) of the return is "reached accepting state at the last step" flag.
 // 1-th byte of the return is "non-sinked" flag (true iff there are active states in the bitmap)
 //
+// If there are no more than `MAX_REGISTER_STATES` NFA states, the states bitmaps live in registers.
+//
 // Synopsis:
 //     uint64_t jit_code(
 //         const uint8_t *buf,
 //         size_t buf_len,
+//         const uint8_t *data,
 //         uint64_t states_bitmap0,
 //         uint64_t states_bitmap1,
 //         uint64_t states_bitmap2,
@@ -35,6 +39,7 @@
 // Registers used:
 //    rsi (input)          - `buf` (incremented on each step)
 //    rdi (input)          - `buf_end`
+//    rbx (input)          - `data`, read-only data placed after the code (see `DATA_*` offsets)
 //    r8  (input & output) - `states_bitmap0`
 //    r9  (input & output) - `states_bitmap1`
 //    r10 (input & output) - `states_bitmap2`
@@ -43,8 +48,272 @@
 //    rax (output) - return
 //
 //    r12-15 (internal use) - next bitmap
-//    rdx    (internal use) - current byte
+//    rdx    (internal use) - current byte, or its class bit if there are few byte classes
+//    rcx    (internal use) - current byte class
 //    rflags (internal use)
+//
+// Before each step the current bitmap is compared with a few "skip sets" (see `struct skip_set`).
+// On a match, bytes that leave the set unchanged are skipped with SSE2 compares against its exit
+// bytes, then the normal stepping resumes from the next exit byte.
+//    xmm0-2 (internal use) - input bytes and exit bytes compare results
+//
+// Otherwise the bitmaps are arrays padded to 32 bytes, the function swaps them after each step.
+//
+// Synopsis:
+//     uint64_t jit_code(
+//         const uint8_t *buf,
+//         size_t buf_len,
+//         const uint8_t *data,
+//         uint64_t *states_bitmap,
+//         uint64_t *next_states_bitmap
+//     )
+//
+// Registers used:
+//    rsi, rdi, rbx, rax, rdx, rcx, rflags - same as above
+//    r8  (input & output) - `states_bitmap`
+//    r9  (input & output) - `next_states_bitmap` (contents are not used)
+//
+//    ymm0 (internal use) - zero, if AVX2 is available
+//    r10  (internal use) - zero otherwise
+//
+// Each active state is checked with a single `test` of its bitmap byte, the next bitmap is
+// cleared with 32 byte stores, so there is no cliff at `MAX_REGISTER_STATES`.
+//
+// If there are no more than `MAX_MASKED_CLASSES` byte classes, state condition is a single test of
+// the class bit against the mask of classes matched by the state.
+// Otherwise conditions of more than one range are tested with a single load from the membership
+// table of the condition (see `DATA_COND_TABLES`), and only single range conditions are compared
+// with the byte.
+
+#define MAX_REGISTER_STATES 256
+
+#define MAX_MASKED_CLASSES 32
+
+// Byte to class table, `uint8_t[256]`.
+#define DATA_CLASS_MAP 0
+// Byte membership tables of distinct state conditions, `uint8_t[256]` each.
+// Bit k of the byte b in the table t is set iff the condition 8*t+k matches b.
+#define DATA_COND_TABLES 256
+#define DATA_COND_TABLE_LEN 256
+#define DATA_ALIGNMENT 64
+
+// Skip sets exit bytes vectors, `uint8_t[MAX_SKIP_SETS][MAX_SKIP_EXIT_BYTES][SKIP_VECTOR_LEN]`.
+// Placed right after the conditions tables, each vector is an exit byte repeated.
+#define SKIP_VECTOR_LEN 16
+
+#define NO_COND_TABLE SIZE_MAX
+
+#define MAX_SKIP_SETS 4
+#define MAX_SKIP_EXIT_BYTES 3
+
+// Set of active states that a step doesn't change unless the byte is one of the exit bytes,
+// e.g. `{[^;], ;}` for `key=[^;]*;value`. Only for the register bitmaps.
+struct skip_set {
+    uint64_t states[4];
+    // Accepting state is reached on every non-exit byte.
+    bool accepting;
+    uint8_t exit_bytes[MAX_SKIP_EXIT_BYTES];
+    size_t exit_bytes_len;
+};
+
+struct skip_sets {
+    struct skip_set sets[MAX_SKIP_SETS];
+    size_t len;
+};
+
+// Distinct state conditions tested with the membership tables.
+struct cond_tables {
+    // Condition index of each NFA state, `NO_COND_TABLE` if the state doesn't use the tables.
+    size_t *state_conds;
+    size_t conds_len;
+};
+
+static bool states_in_registers(const struct rcs_nfa *nfa) {
+    return nfa->states_len <= MAX_REGISTER_STATES;
+}
+
+// Bitmap length in words, padded to 32 bytes, so it's at least the length of the register bitmap.
+static size_t bitmap_len(const struct rcs_nfa *nfa) {
+    return RCS_DIV_CEILING(nfa->states_len, 256) * 4;
+}
+
+static bool use_class_masks(const struct rcs_byte_classes *classes) {
+    return classes->len <= MAX_MASKED_CLASSES;
+}
+
+static bool
+use_cond_table(const struct rcs_byte_classes *classes, const struct rcs_nfa_state *state) {
+    return !use_class_masks(classes) && state->ranges_len > 1;
+}
+
+RCS_NODISCARD
+static rcs_error cond_tables_init(
+    struct cond_tables *tables,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
+    tables->conds_len = 0;
+    tables->state_conds = malloc(nfa->states_len * sizeof(*tables->state_conds));
+    if (tables->state_conds == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        tables->state_conds[i] = NO_COND_TABLE;
+        if (rcs_nfa_state_is_accept(&nfa->states[i]) || !use_cond_table(classes, &nfa->states[i]))
+            continue;
+
+        // states with the same classes share the condition
+        const rcs_bitmap_word *cond = rcs_byte_classes_state_cond(classes, i);
+        for (size_t j = 0; j < i; ++j) {
+            const rcs_bitmap_word *other = rcs_byte_classes_state_cond(classes, j);
+            if (tables->state_conds[j] != NO_COND_TABLE &&
+                rcs_bitmap_equal(cond, other, classes->state_conds_len)) {
+                tables->state_conds[i] = tables->state_conds[j];
+                break;
+            }
+        }
+        if (tables->state_conds[i] == NO_COND_TABLE)
+            tables->state_conds[i] = tables->conds_len++;
+    }
+
+    return RCS_OK;
+}
+
+static size_t cond_tables_data_len(const struct cond_tables *tables) {
+    return RCS_DIV_CEILING(tables->conds_len, 8) * DATA_COND_TABLE_LEN;
+}
+
+static void cond_tables_fill(
+    const struct cond_tables *tables,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    uint8_t *data
+) {
+    memset(data, 0, cond_tables_data_len(tables));
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        size_t cond_i = tables->state_conds[i];
+        if (cond_i == NO_COND_TABLE)
+            continue;
+
+        uint8_t *table = data + cond_i / 8 * DATA_COND_TABLE_LEN;
+        for (size_t b = 0; b < 256; ++b) {
+            if (rcs_byte_classes_state_matches(classes, i, classes->map[b]))
+                table[b] |= 1 << (cond_i % 8);
+        }
+    }
+}
+
+static void cond_tables_free(struct cond_tables *tables) {
+    free(tables->state_conds);
+    tables->state_conds = NULL;
+}
+
+// Tries the states reached from a self-looping state as the skip set.
+static bool make_skip_set(
+    struct skip_set *set,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_nfa_state *loop_state
+) {
+    const size_t accept_i = nfa->accept - nfa->states;
+
+    *set = (struct skip_set){0};
+    for (size_t i = 0; i < loop_state->next_len; ++i) {
+        if (loop_state->next[i] != nfa->accept)
+            rcs_bitmap_set(set->states, loop_state->next[i] - nfa->states);
+    }
+
+    bool class_exits[256];
+    bool accepting_seen = false;
+    for (size_t class_i = 0; class_i < classes->len; ++class_i) {
+        uint64_t next[4] = {0};
+        rcs_standard_step(nfa, classes, NULL, set->states, next, class_i);
+
+        bool accepting = rcs_bitmap_get(next, accept_i);
+        rcs_bitmap_clear(next, accept_i);
+
+        class_exits[class_i] = memcmp(next, set->states, sizeof next) != 0;
+        if (class_exits[class_i])
+            continue;
+        if (!accepting_seen) {
+            set->accepting = accepting;
+            accepting_seen = true;
+        } else if (set->accepting != accepting) {
+            // accepting flag must not depend on the skipped byte
+            return false;
+        }
+    }
+
+    for (size_t b = 0; b < 256; ++b) {
+        if (!class_exits[classes->map[b]])
+            continue;
+        if (set->exit_bytes_len == MAX_SKIP_EXIT_BYTES)
+            return false;
+        set->exit_bytes[set->exit_bytes_len++] = b;
+    }
+    return true;
+}
+
+static void find_skip_sets(
+    struct skip_sets *skips,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
+    skips->len = 0;
+    if (!states_in_registers(nfa))
+        return;
+
+    for (size_t i = 0; i < nfa->states_len && skips->len < MAX_SKIP_SETS; ++i) {
+        const struct rcs_nfa_state *state = &nfa->states[i];
+
+        bool self_loop = false;
+        for (size_t j = 0; j < state->next_len; ++j)
+            self_loop = self_loop || state->next[j] == state;
+        if (!self_loop)
+            continue;
+
+        struct skip_set *set = &skips->sets[skips->len];
+        if (!make_skip_set(set, nfa, classes, state))
+            continue;
+
+        bool duplicate = false;
+        for (size_t j = 0; j < skips->len && !duplicate; ++j)
+            duplicate = memcmp(skips->sets[j].states, set->states, sizeof set->states) == 0;
+        if (!duplicate)
+            ++skips->len;
+    }
+}
+
+static size_t skip_sets_data_offset(const struct cond_tables *tables) {
+    return DATA_COND_TABLES + cond_tables_data_len(tables);
+}
+
+static size_t skip_sets_data_len(const struct skip_sets *skips) {
+    return skips->len * MAX_SKIP_EXIT_BYTES * SKIP_VECTOR_LEN;
+}
+
+static uint32_t skip_vector_offset(const struct cond_tables *tables, size_t set_i, size_t exit_i) {
+    return skip_sets_data_offset(tables) + (set_i * MAX_SKIP_EXIT_BYTES + exit_i) * SKIP_VECTOR_LEN;
+}
+
+static void skip_sets_fill(const struct skip_sets *skips, uint8_t *data) {
+    for (size_t i = 0; i < skips->len; ++i) {
+        for (size_t j = 0; j < skips->sets[i].exit_bytes_len; ++j) {
+            uint8_t *vector = data + (i * MAX_SKIP_EXIT_BYTES + j) * SKIP_VECTOR_LEN;
+            memset(vector, skips->sets[i].exit_bytes[j], SKIP_VECTOR_LEN);
+        }
+    }
+}
+
+static uint32_t state_class_mask(const struct rcs_byte_classes *classes, size_t state_idx) {
+    const rcs_bitmap_word *cond = rcs_byte_classes_state_cond(classes, state_idx);
+    uint32_t mask = 0;
+    for (size_t i = 0; i < classes->len; ++i) {
+        if (rcs_bitmap_get(cond, i))
+            mask |= (uint32_t)1 << i;
+    }
+    return mask;
+}
 
 static void emit_range_code(
     struct asm *as,
@@ -67,18 +336,96 @@ static void emit_next_states_bitmask_update(
     const struct rcs_nfa *nfa,
     const struct rcs_nfa_state *state
 ) {
-    for (size_t i = 0; i < state->next_len; ++i) {
-        size_t next_i = state->next[i] - nfa->states;
-        asm_bts_r64(as, ASM_R12 + (next_i / 64), next_i % 64); // bts r12-15, next_i
+    if (states_in_registers(nfa)) {
+        for (size_t i = 0; i < state->next_len; ++i) {
+            size_t next_i = state->next[i] - nfa->states;
+            asm_bts_r64(as, ASM_R12 + (next_i / 64), next_i % 64); // bts r12-15, next_i
+        }
+    } else {
+        // one `or` per bitmap byte
+        for (size_t i = 0; i < state->next_len; ++i) {
+            size_t byte_i = (state->next[i] - nfa->states) / 8;
+
+            bool byte_done = false;
+            for (size_t j = 0; j < i && !byte_done; ++j)
+                byte_done = (size_t)(state->next[j] - nfa->states) / 8 == byte_i;
+            if (byte_done)
+                continue;
+
+            uint8_t mask = 0;
+            for (size_t j = i; j < state->next_len; ++j) {
+                size_t next_j = state->next[j] - nfa->states;
+                if (next_j / 8 == byte_i)
+                    mask |= 1 << (next_j % 8);
+            }
+            asm_or_byte_mem(as, ASM_R9, byte_i, mask); // or byte [r9+byte_i], mask
+        }
     }
     if (state->next_len != 0)
         asm_set_no_sink_flag(as); // mov ah, 1
 }
 
-static void emit_state_code(struct asm *as, const struct rcs_nfa *nfa, size_t state_idx) {
+static void emit_state_class_mask_code(
+    struct asm *as,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    size_t state_idx
+) {
+    const struct rcs_nfa_state *state = &nfa->states[state_idx];
+    uint32_t mask = state_class_mask(classes, state_idx);
+    uint32_t all_classes = classes->len == 32 ? UINT32_MAX : ((uint32_t)1 << classes->len) - 1;
+
+    if (mask == 0)
+        // matches nothing
+        return;
+
+    if (mask == all_classes) {
+        emit_next_states_bitmask_update(as, nfa, state);
+        return;
+    }
+
+    const asm_label next_state = asm_new_label(as);
+    asm_test_char_class_mask(as, mask);              //     test edx, mask
+    asm_jz(as, next_state);                          //     jz   next_state
+    emit_next_states_bitmask_update(as, nfa, state); //     ...
+    asm_place_label(as, next_state);                 // next_state:
+}
+
+static void emit_state_cond_table_code(
+    struct asm *as,
+    const struct rcs_nfa *nfa,
+    size_t cond_i,
+    size_t state_idx
+) {
+    const struct rcs_nfa_state *state = &nfa->states[state_idx];
+    const asm_label next_state = asm_new_label(as);
+    uint32_t table_offset = DATA_COND_TABLES + cond_i / 8 * DATA_COND_TABLE_LEN;
+
+    asm_test_char_table(as, table_offset, 1 << (cond_i % 8)); //     test byte [rbx+rdx+table], bit
+    asm_jz(as, next_state);                                   //     jz   next_state
+    emit_next_states_bitmask_update(as, nfa, state);          //     ...
+    asm_place_label(as, next_state);                          // next_state:
+}
+
+static void emit_state_code(
+    struct asm *as,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct cond_tables *tables,
+    size_t state_idx
+) {
     const struct rcs_nfa_state *state = &nfa->states[state_idx];
     assert(!rcs_nfa_state_is_accept(state));
 
+    if (use_class_masks(classes)) {
+        emit_state_class_mask_code(as, nfa, classes, state_idx);
+        return;
+    }
+    if (tables->state_conds[state_idx] != NO_COND_TABLE) {
+        emit_state_cond_table_code(as, nfa, tables->state_conds[state_idx], state_idx);
+        return;
+    }
+
     // Label exit from state's match code.
     // Means success on regular match, failure on reversed.
     const asm_label end = asm_new_label(as);
@@ -103,13 +450,96 @@ static void emit_state_code(struct asm *as, const struct rcs_nfa *nfa, size_t st
     asm_place_label(as, next_state); // next_state:
 }
 
-static void emit_code(struct asm *as, const struct rcs_nfa *nfa) {
-    assert(nfa->states_len <= 256);
+// Jumps to `skip` if the current bitmap is the skip set.
+static void emit_skip_set_check(
+    struct asm *as,
+    size_t bitmap_regs,
+    const struct skip_set *set,
+    asm_label skip
+) {
+    asm_label no_skip = asm_new_label(as);
+    for (size_t i = 0; i < bitmap_regs; ++i) {
+        asm_mov_r64_imm64(as, ASM_CX, set->states[i]); //     mov    rcx, set_states[i]
+        asm_cmp_r64(as, ASM_R8 + i, ASM_CX);           //     cmp    r8..11, rcx
+        asm_jnz(as, no_skip);                          //     jne    no_skip
+    }
+    asm_jmp(as, skip);            //     jmp    skip
+    asm_place_label(as, no_skip); // no_skip:
+}
+
+// Skips to the next exit byte of the set, jumps to `step` with at least one byte left,
+// or to `end` at the end of the buffer.
+static void emit_skip_set_code(
+    struct asm *as,
+    const struct cond_tables *tables,
+    const struct skip_sets *skips,
+    size_t set_i,
+    asm_label step,
+    asm_label end
+) {
+    const struct skip_set *set = &skips->sets[set_i];
+
+    if (set->exit_bytes_len == 0) {
+        // the rest of the buffer is skipped
+        asm_set_accepted_flag(as, set->accepting); //     mov    al, accepting
+        asm_mov_r64(as, ASM_SI, ASM_DI);           //     mov    rsi, rdi
+        asm_jmp(as, end);                          //     jmp    end
+        return;
+    }
+
+    asm_label vector_loop = asm_new_label(as);
+    asm_label found = asm_new_label(as);
+    asm_label tail = asm_new_label(as);
+    asm_label skipped = asm_new_label(as);
+
+    asm_mov_r64(as, ASM_CX, ASM_SI);  //     mov    rcx, rsi
+    asm_place_label(as, vector_loop); // vector_loop:
+    asm_cmp_vector_end(as);           //     lea    rdx, [rsi+16]
+                                      //     cmp    rdx, rdi
+    asm_ja(as, tail);                 //     ja     tail
+    asm_load_vector(as);              //     movdqu xmm0, [rsi]
+    for (size_t i = 0; i < set->exit_bytes_len; ++i) {
+        uint32_t offset = skip_vector_offset(tables, set_i, i);
+        asm_cmpeq_vector(as, i == 0 ? 1 : 2, offset); //     movdqa xmm1-2, xmm0
+                                                      //     pcmpeqb xmm1-2, [rbx+exit_vector]
+        if (i != 0)
+            asm_or_vector(as); //     por    xmm1, xmm2
+    }
+    asm_test_vector_mask(as);                  //     pmovmskb edx, xmm1
+                                               //     test   edx, edx
+    asm_jnz(as, found);                        //     jnz    found
+    asm_next_vector(as);                       //     add    rsi, 16
+    asm_jmp(as, vector_loop);                  //     jmp    vector_loop
+    asm_place_label(as, found);                // found:
+    asm_skip_to_vector_mask(as);               //     bsf    edx, edx
+                                               //     add    rsi, rdx
+    asm_place_label(as, tail);                 // tail:
+    asm_cmp_r64(as, ASM_SI, ASM_CX);           //     cmp    rsi, rcx
+    asm_jz(as, skipped);                       //     je     skipped
+    asm_set_accepted_flag(as, set->accepting); //     mov    al, accepting
+    asm_place_label(as, skipped);              // skipped:
+    asm_cmp_r64(as, ASM_SI, ASM_DI);           //     cmp    rsi, rdi
+    asm_jz(as, end);                           //     je     end
+    asm_jmp(as, step);                         //     jmp    step
+}
+
+static void emit_registers_code(
+    struct asm *as,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct cond_tables *tables,
+    const struct skip_sets *skips
+) {
+    assert(states_in_registers(nfa));
 
     size_t bitmap_regs = RCS_DIV_CEILING(nfa->states_len, 64);
 
     asm_label loop = asm_new_label(as);
+    asm_label step = asm_new_label(as);
     asm_label end = asm_new_label(as);
+    asm_label skip_labels[MAX_SKIP_SETS];
+    for (size_t i = 0; i < skips->len; ++i)
+        skip_labels[i] = asm_new_label(as);
 
     asm_xor_r64(as, ASM_AX, ASM_AX);               //     xor    rax, rax
     asm_calc_arr_end(as);                          //     lea    rdi, [rsi+rdi]
@@ -121,9 +551,17 @@ static void emit_code(struct asm *as, const struct rcs_nfa *nfa) {
         asm_xor_r64(as, ASM_R12 + i, ASM_R12 + i); //     xor    r12..15, r12..15
     asm_cmp_r64(as, ASM_SI, ASM_DI);               //     cmp    rsi, rdi
     asm_jz(as, end);                               //     je     end
-    asm_xor_r64(as, ASM_AX, ASM_AX);               //     xor    rax, rax
-    asm_load_char(as);                             //     movzx  edx, byte [rsi]
-    asm_inc_r64(as, ASM_SI);                       //     inc    rsi
+    for (size_t i = 0; i < skips->len; ++i)
+        emit_skip_set_check(as, bitmap_regs, &skips->sets[i], skip_labels[i]); //     ...
+    asm_place_label(as, step);       // step:
+    asm_xor_r64(as, ASM_AX, ASM_AX); //     xor    rax, rax
+    asm_load_char(as);               //     movzx  edx, byte [rsi]
+    asm_inc_r64(as, ASM_SI);         //     inc    rsi
+    if (use_class_masks(classes)) {
+        asm_load_char_class(as);     //     movzx  ecx, byte [rbx+rdx]
+        asm_make_char_class_bit(as); //     xor    edx, edx
+                                     //     bts    edx, ecx
+    }
 
     for (size_t i = 0; i < nfa->states_len; ++i) {
         asm_shr_r64(as, ASM_R8 + i / 64); //     shr r8-12, 1
@@ -133,9 +571,9 @@ static void emit_code(struct asm *as, const struct rcs_nfa *nfa) {
 
         asm_label skip_state = asm_new_label(as);
 
-        asm_jnc(as, skip_state);         //     jnc skip_state
-        emit_state_code(as, nfa, i);     //     ...
-        asm_place_label(as, skip_state); // skip_state:
+        asm_jnc(as, skip_state);                      //     jnc skip_state
+        emit_state_code(as, nfa, classes, tables, i); //     ...
+        asm_place_label(as, skip_state);              // skip_state:
     }
 
     size_t accepting_state_i = nfa->accept - nfa->states;
@@ -148,8 +586,101 @@ static void emit_code(struct asm *as, const struct rcs_nfa *nfa) {
     for (size_t i = 0; i < bitmap_regs; ++i)      //
         asm_mov_r64(as, ASM_R8 + i, ASM_R12 + i); //     mov    r8..11, r12..15
     asm_jmp(as, loop);                            //     jmp    loop
-    asm_place_label(as, end);                     // end:
-    asm_ret(as);                                  //     ret
+    for (size_t i = 0; i < skips->len; ++i) {
+        asm_place_label(as, skip_labels[i]);                 // skip_i:
+        emit_skip_set_code(as, tables, skips, i, step, end); //     ...
+    }
+    asm_place_label(as, end); // end:
+    asm_ret(as);              //     ret
+}
+
+static void emit_memory_code(
+    struct asm *as,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct cond_tables *tables,
+    bool use_avx2
+) {
+    size_t bitmap_bytes = bitmap_len(nfa) * sizeof(uint64_t);
+
+    asm_label loop = asm_new_label(as);
+    asm_label end = asm_new_label(as);
+
+    asm_xor_r64(as, ASM_AX, ASM_AX); //     xor    rax, rax
+    asm_calc_arr_end(as);            //     lea    rdi, [rsi+rdi]
+    if (use_avx2)
+        asm_zero_ymm0(as); //     vpxor  ymm0, ymm0, ymm0
+    else
+        asm_xor_r64(as, ASM_R10, ASM_R10); //     xor    r10, r10
+    asm_set_no_sink_flag(as);              //     mov    ah, 1
+    asm_place_label(as, loop);             // loop:
+    asm_test_no_sink_flag(as);             //     test   ah, ah
+    asm_jz(as, end);                       //     jz     end
+    if (use_avx2) {
+        for (size_t off = 0; off < bitmap_bytes; off += 32)
+            asm_store_ymm0(as, ASM_R9, off); //     vmovdqu [r9+off], ymm0
+    } else {
+        for (size_t off = 0; off < bitmap_bytes; off += 8)
+            asm_store_r64(as, ASM_R9, off, ASM_R10); //     mov    [r9+off], r10
+    }
+    asm_cmp_r64(as, ASM_SI, ASM_DI); //     cmp    rsi, rdi
+    asm_jz(as, end);                 //     je     end
+    asm_xor_r64(as, ASM_AX, ASM_AX); //     xor    rax, rax
+    asm_load_char(as);               //     movzx  edx, byte [rsi]
+    asm_inc_r64(as, ASM_SI);         //     inc    rsi
+    if (use_class_masks(classes)) {
+        asm_load_char_class(as);     //     movzx  ecx, byte [rbx+rdx]
+        asm_make_char_class_bit(as); //     xor    edx, edx
+                                     //     bts    edx, ecx
+    }
+
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        if (rcs_nfa_state_is_accept(&nfa->states[i]))
+            continue;
+
+        asm_label skip_state = asm_new_label(as);
+
+        asm_test_byte_mem(as, ASM_R8, i / 8, 1 << (i % 8)); //     test byte [r8+i/8], 1<<i%8
+        asm_jz(as, skip_state);                             //     jz   skip_state
+        emit_state_code(as, nfa, classes, tables, i);       //     ...
+        asm_place_label(as, skip_state);                    // skip_state:
+    }
+
+    size_t accepting_state_i = nfa->accept - nfa->states;
+    uint8_t accepting_state_bit = 1 << (accepting_state_i % 8);
+    asm_test_byte_mem(
+        as,
+        ASM_R9,
+        accepting_state_i / 8,
+        accepting_state_bit
+    );                       //     test   byte [r9+accepting_state_byte], accepting_state_bit
+    asm_setnz_r8(as, ASM_AX); //     setnz  al
+    asm_and_byte_mem(
+        as,
+        ASM_R9,
+        accepting_state_i / 8,
+        ~accepting_state_bit
+    );                                 //     and    byte [r9+accepting_state_byte], ~bit
+    asm_xchg_r64(as, ASM_R8, ASM_R9); //     xchg   r8, r9
+    asm_jmp(as, loop);                 //     jmp    loop
+    asm_place_label(as, end);          // end:
+    if (use_avx2)
+        asm_vzeroupper(as); //     vzeroupper
+    asm_ret(as);            //     ret
+}
+
+static void emit_code(
+    struct asm *as,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct cond_tables *tables,
+    const struct skip_sets *skips,
+    bool use_avx2
+) {
+    if (states_in_registers(nfa))
+        emit_registers_code(as, nfa, classes, tables, skips);
+    else
+        emit_memory_code(as, nfa, classes, tables, use_avx2);
 
     // // for manual testing
     // asm_label L1 = asm_new_label(as);
@@ -199,13 +730,26 @@ static void emit_code(struct asm *as, const struct rcs_nfa *nfa) {
     // asm_jump(as, ASM_NO_CONDITION, L6);
 }
 
-static RCS_NODISCARD rcs_error
-init_jit(struct rcs_jit_scanner *scanner, const struct rcs_nfa *nfa) {
+static RCS_NODISCARD rcs_error init_jit(
+    struct rcs_jit_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
     rcs_error err = RCS_OK;
 
+    struct cond_tables tables;
+    err = cond_tables_init(&tables, nfa, classes);
+    if (rcs_failed(err))
+        return err;
+
+    struct skip_sets skips;
+    find_skip_sets(&skips, nfa, classes);
+
     struct asm *volatile as = malloc(sizeof *as);
-    if (as == NULL)
-        return RCS_MAKE_ERR_LIBC(errno);
+    if (as == NULL) {
+        err = RCS_MAKE_ERR_LIBC(errno);
+        goto exit_free;
+    }
 
     err = asm_init(as);
     if (rcs_failed(err))
@@ -214,18 +758,7 @@ init_jit(struct rcs_jit_scanner *scanner, const struct rcs_nfa *nfa) {
     // exception handler for assembler
     // reduces boilerplate
     if (setjmp(as->env) == 0) {
-        memset(scanner->initial_states_bitmap, 0, sizeof scanner->initial_states_bitmap);
-        scanner->has_accepting_source = false;
-
-        for (size_t i = 0; i < nfa->sources_len; ++i) {
-            size_t src_i = nfa->sources[i] - nfa->states;
-            scanner->initial_states_bitmap[src_i / 64] |= 1 << (src_i % 64);
-
-            if (rcs_nfa_state_is_accept(nfa->sources[i]))
-                scanner->has_accepting_source = true;
-        }
-
-        emit_code(as, nfa);
+        emit_code(as, nfa, classes, &tables, &skips, scanner->use_avx2);
 
         // {
         //     FILE *f = fopen("/tmp/regex-cs-jit2.bin", "w+");
@@ -236,13 +769,21 @@ init_jit(struct rcs_jit_scanner *scanner, const struct rcs_nfa *nfa) {
         // }
 
         size_t bytes_optimized = asm_optimize_jumps(as);
-        scanner->mmap_len = as->code.len - bytes_optimized;
+        size_t code_len = as->code.len - bytes_optimized;
+        scanner->data_offset = RCS_DIV_CEILING(code_len, DATA_ALIGNMENT) * DATA_ALIGNMENT;
+        scanner->mmap_len =
+            scanner->data_offset + skip_sets_data_offset(&tables) + skip_sets_data_len(&skips);
 
-        rcs_error err = rcs_mmap_for_write(&scanner->mmap_addr, scanner->mmap_len);
+        err = rcs_mmap_for_write(&scanner->mmap_addr, scanner->mmap_len);
         if (rcs_failed(err))
-            return err;
+            goto exit_free;
+
+        asm_link(as, scanner->mmap_addr, code_len);
 
-        asm_link(as, scanner->mmap_addr, scanner->mmap_len);
+        uint8_t *data = (uint8_t *)scanner->mmap_addr + scanner->data_offset;
+        memcpy(data + DATA_CLASS_MAP, classes->map, sizeof classes->map);
+        cond_tables_fill(&tables, nfa, classes, data + DATA_COND_TABLES);
+        skip_sets_fill(&skips, data + skip_sets_data_offset(&tables));
 
         //
         // {
@@ -263,22 +804,196 @@ init_jit(struct rcs_jit_scanner *scanner, const struct rcs_nfa *nfa) {
 
 exit_free:
     free(as);
+    cond_tables_free(&tables);
     return err;
 }
 
+// Allocates the bitmaps and sets the initial states, everything but the code.
+static RCS_NODISCARD rcs_error
+init_bitmaps(struct rcs_jit_scanner *scanner, const struct rcs_nfa *nfa, bool use_avx2) {
+    *scanner = (struct rcs_jit_scanner){0};
+    scanner->bitmap_len = bitmap_len(nfa);
+    scanner->states_bm_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+    scanner->states_in_registers = states_in_registers(nfa);
+    scanner->use_avx2 = use_avx2;
+
+    scanner->initial_states_bitmap = calloc(scanner->bitmap_len, sizeof(uint64_t));
+    if (scanner->initial_states_bitmap == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+    if (!scanner->states_in_registers) {
+        for (size_t i = 0; i < 2; ++i) {
+            scanner->bitmaps[i] = malloc(scanner->bitmap_len * sizeof(uint64_t));
+            if (scanner->bitmaps[i] == NULL)
+                return RCS_MAKE_ERR_LIBC(errno);
+        }
+    }
+
+    for (size_t i = 0; i < nfa->sources_len; ++i) {
+        size_t src_i = nfa->sources[i] - nfa->states;
+        scanner->initial_states_bitmap[src_i / 64] |= (uint64_t)1 << (src_i % 64);
+
+        if (rcs_nfa_state_is_accept(nfa->sources[i]))
+            scanner->has_accepting_source = true;
+    }
+    return RCS_OK;
+}
+
 RCS_NODISCARD
 bool rcs_jit_scanner_init(
     rcs_error *err,
     struct rcs_jit_scanner *scanner,
-    const struct rcs_nfa *nfa
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
 ) {
-    if (nfa->states_len > 256)
+    // the counters are run by the other backends
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        if (rcs_nfa_state_is_counting(&nfa->states[i]))
+            return false;
+    }
+
+    *err = init_bitmaps(scanner, nfa, __builtin_cpu_supports("avx2"));
+    if (!rcs_failed(*err))
+        *err = init_jit(scanner, nfa, classes);
+    if (rcs_failed(*err))
+        rcs_jit_scanner_free(scanner);
+    return true;
+}
+
+void rcs_jit_scanner_code(struct rcs_jit_code *out, const struct rcs_jit_scanner *scanner) {
+    *out = (struct rcs_jit_code){
+        .code = scanner->mmap_addr,
+        .len = scanner->mmap_len,
+        .data_offset = scanner->data_offset,
+        .use_avx2 = scanner->use_avx2,
+    };
+}
+
+RCS_NODISCARD
+bool rcs_jit_scanner_load(
+    rcs_error *err,
+    struct rcs_jit_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_jit_code *code
+) {
+    if (code->use_avx2 && !__builtin_cpu_supports("avx2"))
         return false;
 
-    *err = init_jit(scanner, nfa);
+    *err = init_bitmaps(scanner, nfa, code->use_avx2);
+    if (rcs_failed(*err))
+        goto error_free;
+
+    // the code addresses its data relative to `rbx` and has only relative jumps
+    void *addr;
+    *err = rcs_mmap_for_write(&addr, code->len);
+    if (rcs_failed(*err))
+        goto error_free;
+    scanner->mmap_addr = addr;
+    scanner->mmap_len = code->len;
+    scanner->data_offset = code->data_offset;
+    memcpy(addr, code->code, code->len);
+
+    *err = rcs_mmap_make_exec(addr, code->len);
+    if (rcs_failed(*err))
+        goto error_free;
+    return true;
+
+error_free:
+    rcs_jit_scanner_free(scanner);
     return true;
 }
 
+RCS_NODISCARD
+rcs_error
+rcs_jit_scanner_clone(struct rcs_jit_scanner *scanner, const struct rcs_jit_scanner *original) {
+    *scanner = *original;
+    scanner->shared_code = true;
+    scanner->bitmaps[0] = scanner->bitmaps[1] = NULL;
+
+    if (!scanner->states_in_registers) {
+        for (size_t i = 0; i < 2; ++i) {
+            scanner->bitmaps[i] = malloc(scanner->bitmap_len * sizeof(uint64_t));
+            if (scanner->bitmaps[i] == NULL) {
+                rcs_jit_scanner_free(scanner);
+                return RCS_MAKE_ERR_LIBC(errno);
+            }
+        }
+    }
+    return RCS_OK;
+}
+
+// Returns the JIT code return.
+static uint64_t call_registers_code(
+    struct rcs_jit_scanner *scanner,
+    uint64_t bitmap[4],
+    const uint8_t *buf,
+    rcs_api_size n
+) {
+    uint64_t jit_return;
+    void *scanner_entrypoint = scanner->mmap_addr;
+    void *scanner_data = (uint8_t *)scanner->mmap_addr + scanner->data_offset;
+
+    __asm__ volatile(
+        "    movq %6, %%rsi \n"
+        "    movq %7, %%rdi \n"
+        "    movq %8, %%rbx \n"
+        "    movq %1, %%r8  \n"
+        "    movq %2, %%r9  \n"
+        "    movq %3, %%r10 \n"
+        "    movq %4, %%r11 \n"
+        "    call *%5       \n"
+        "    movq %%r8, %1  \n"
+        "    movq %%r9, %2  \n"
+        "    movq %%r10, %3 \n"
+        "    movq %%r11, %4 \n"
+        : "=a"(jit_return), "+g"(bitmap[0]), "+g"(bitmap[1]), "+g"(bitmap[2]), "+g"(bitmap[3])
+        : "g"(scanner_entrypoint), "g"(buf), "g"((uint64_t)n), "g"(scanner_data)
+        : "rbx",
+          "rcx",
+          "rdx",
+          "rsi",
+          "rdi",
+          "r8",
+          "r9",
+          "r10",
+          "r11",
+          "r12",
+          "r13",
+          "r14",
+          "r15",
+          "xmm0",
+          "xmm1",
+          "xmm2"
+    );
+    return jit_return;
+}
+
+// Returns the JIT code return, swaps `bitmaps` as the code does.
+static uint64_t call_memory_code(
+    struct rcs_jit_scanner *scanner,
+    uint64_t *bitmaps[2],
+    const uint8_t *buf,
+    rcs_api_size n
+) {
+    uint64_t jit_return;
+    void *scanner_entrypoint = scanner->mmap_addr;
+    void *scanner_data = (uint8_t *)scanner->mmap_addr + scanner->data_offset;
+
+    __asm__ volatile(
+        "    movq %4, %%rsi \n"
+        "    movq %5, %%rdi \n"
+        "    movq %6, %%rbx \n"
+        "    movq %1, %%r8  \n"
+        "    movq %2, %%r9  \n"
+        "    call *%3       \n"
+        "    movq %%r8, %1  \n"
+        "    movq %%r9, %2  \n"
+        : "=a"(jit_return), "+g"(bitmaps[0]), "+g"(bitmaps[1])
+        : "g"(scanner_entrypoint), "g"(buf), "g"((uint64_t)n), "g"(scanner_data)
+        : "rbx", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "xmm0", "memory"
+    );
+    return jit_return;
+}
+
 RCS_NODISCARD
 rcs_error rcs_jit_match(
     rcs_api_bool *out_ok,
@@ -287,31 +1002,25 @@ rcs_error rcs_jit_match(
 ) {
     rcs_api_size n;
     uint64_t jit_return = 0x0100 | (scanner->has_accepting_source ? 1 : 0);
-    void *scanner_entrypoint = scanner->mmap_addr;
 
     uint64_t bitmap[4] = {0};
-    memcpy(bitmap, scanner->initial_states_bitmap, sizeof bitmap);
+    if (scanner->states_in_registers) {
+        memcpy(bitmap, scanner->initial_states_bitmap, sizeof bitmap);
+    } else {
+        memcpy(
+            scanner->bitmaps[0],
+            scanner->initial_states_bitmap,
+            scanner->bitmap_len * sizeof(uint64_t)
+        );
+    }
 
     *out_ok = false;
     while ((n = reader->read(reader->arg)) > 0) {
-        void *reader_buf = reader->buf;
-
-        __asm__ volatile(
-            "    movq %6, %%rsi \n"
-            "    movq %7, %%rdi \n"
-            "    movq %1, %%r8  \n"
-            "    movq %2, %%r9  \n"
-            "    movq %3, %%r10 \n"
-            "    movq %4, %%r11 \n"
-            "    call *%5       \n"
-            "    movq %%r8, %1  \n"
-            "    movq %%r9, %2  \n"
-            "    movq %%r10, %3 \n"
-            "    movq %%r11, %4 \n"
-            : "=a"(jit_return), "+g"(bitmap[0]), "+g"(bitmap[1]), "+g"(bitmap[2]), "+g"(bitmap[3])
-            : "g"(scanner_entrypoint), "g"(reader_buf), "g"((uint64_t)n)
-            : "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11", "r12", "r13", "r14", "r15"
-        );
+        if (scanner->states_in_registers)
+            jit_return = call_registers_code(scanner, bitmap, reader->buf, n);
+        else
+            jit_return = call_memory_code(scanner, scanner->bitmaps, reader->buf, n);
+
         // RCS_BREAKPOINT();
         if (!(jit_return & 0xff00))
             // sink; no match
@@ -321,7 +1030,45 @@ rcs_error rcs_jit_match(
     return RCS_OK;
 }
 
+bool rcs_jit_feed(
+    struct rcs_jit_scanner *scanner,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    rcs_api_size len
+) {
+    uint64_t bitmap[4] = {0};
+    uint64_t *cur = scanner->states_in_registers ? bitmap : scanner->bitmaps[0];
+    if (!scanner->states_in_registers)
+        memset(cur, 0, scanner->bitmap_len * sizeof(uint64_t));
+    memcpy(cur, states_bm, scanner->states_bm_len * sizeof(*states_bm));
+
+    uint64_t jit_return;
+    if (scanner->states_in_registers) {
+        jit_return = call_registers_code(scanner, bitmap, buf, len);
+    } else {
+        jit_return = call_memory_code(scanner, scanner->bitmaps, buf, len);
+        cur = scanner->bitmaps[0];
+    }
+
+    if (!(jit_return & 0xff00)) {
+        // sink, the code returns before the end of the buffer
+        memset(states_bm, 0, scanner->states_bm_len * sizeof(*states_bm));
+        return false;
+    }
+    memcpy(states_bm, cur, scanner->states_bm_len * sizeof(*states_bm));
+    return (jit_return & 0xff) != 0;
+}
+
 // Does not free the scanner struct itself, only its inner buffers.
 void rcs_jit_scanner_free(struct rcs_jit_scanner *scanner) {
-    rcs_mmap_free(scanner->mmap_addr, scanner->mmap_len);
+    if (!scanner->shared_code) {
+        if (scanner->mmap_addr != NULL)
+            rcs_mmap_free(scanner->mmap_addr, scanner->mmap_len);
+        free(scanner->initial_states_bitmap);
+    }
+    free(scanner->bitmaps[0]);
+    free(scanner->bitmaps[1]);
+    scanner->mmap_addr = NULL;
+    scanner->initial_states_bitmap = NULL;
+    scanner->bitmaps[0] = scanner->bitmaps[1] = NULL;
 }
@@ -6,10 +6,26 @@
 #include <stdint.h>
 
 struct rcs_jit_scanner {
-    uint64_t initial_states_bitmap[4];
+    // Padded to the 32 bytes (at least 4 words, the register bitmap size).
+    uint64_t *initial_states_bitmap;
+    size_t bitmap_len;
     bool has_accepting_source;
+    // Length of the NFA states bitmap of a stream context, `RCS_BITMAP_LEN_WORDS(states_len)`.
+    size_t states_bm_len;
+
+    // States bitmaps are kept in registers if there are few NFA states, in the memory otherwise.
+    bool states_in_registers;
+    // Current and next memory-resident bitmaps, `bitmap_len` words each.
+    uint64_t *bitmaps[2];
+    // Next bitmap is cleared with AVX2 stores.
+    bool use_avx2;
+
+    // The code and `initial_states_bitmap` are owned by the scanner this one was cloned from.
+    bool shared_code;
     void *mmap_addr;
     size_t mmap_len;
+    // Offset of the read-only data in the mapping, the code is placed before it.
+    size_t data_offset;
 };
 
 #endif
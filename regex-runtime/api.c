@@ -1,6 +1,7 @@
 #include "api.h"
-#include "jit.h"
-#include "standard.h"
+#include "buffer_reader.h"
+#include "mmap.h"
+#include "scanner.h"
 #include <assert.h>
 #include <errno.h>
 #include <stddef.h>
@@ -19,67 +20,443 @@ const char *rcs_strerror(rcs_error error) {
         return strerror(error.libc_errno);
     case RCS_ERR_JIT_TOO_LONG_JUMP:
         return "too long jump in jit-generated code (state condition is too big)";
+    case RCS_ERR_UNSUPPORTED_BACKEND:
+        return "scanner backend doesn't support the given automaton";
+    case RCS_ERR_BAD_IMAGE:
+        return "invalid compiled image or it was made by another runtime version or architecture";
     default:
         return "unknown error";
     }
 }
 
-enum rcs_scanner_backend {
-    RCS_STANDARD,
+// Backends tried by `RCS_AUTO` in order.
+static const rcs_scanner_backend auto_backends[] = {
+    // no branch mispredictions, so it beats the JIT on small NFAs
+    RCS_BIT_PARALLEL,
     RCS_JIT,
+    // turns into the NFA simulation itself if the cache is useless for the input
+    RCS_LAZY_DFA,
 };
 
-struct rcs_scanner {
-    enum rcs_scanner_backend backend_type;
-    union {
-        struct rcs_standard_scanner standard;
-        struct rcs_jit_scanner jit;
-    } backend;
-};
+// The JIT keeps bigger state sets in the memory and checks every state on each byte, the lazy DFA
+// is usually faster then.
+#define AUTO_JIT_MAX_STATES 256
+
+// Returns false if the backend doesn't support the given NFA.
+// True if the backend was initialized or an error occurred (`err` is set).
+// The JIT code is loaded from `jit_code` if it's not NULL and runs on this CPU.
+static bool init_backend(
+    rcs_error *err,
+    struct rcs_scanner *s,
+    rcs_scanner_backend backend,
+    const struct rcs_nfa *nfa,
+    const struct rcs_scanner_options *options,
+    const struct rcs_jit_code *jit_code
+) {
+    s->backend_type = backend;
+
+    switch (backend) {
+    case RCS_STANDARD:
+        *err = rcs_standard_scanner_init(&s->backend.standard, nfa, &s->classes, &s->counters);
+        return true;
+    case RCS_JIT:
+        if (jit_code != NULL && rcs_jit_scanner_load(err, &s->backend.jit, nfa, jit_code))
+            return true;
+        return rcs_jit_scanner_init(err, &s->backend.jit, nfa, &s->classes);
+    case RCS_LAZY_DFA:
+        *err = rcs_lazy_dfa_scanner_init(
+            &s->backend.lazy_dfa,
+            nfa,
+            &s->classes,
+            &s->counters,
+            options->dfa_cache_size
+        );
+        return true;
+    case RCS_BIT_PARALLEL:
+        return rcs_bitparallel_scanner_init(
+            err,
+            &s->backend.bitparallel,
+            nfa,
+            &s->classes,
+            &s->counters
+        );
+    default:
+        return false;
+    }
+}
+
+// Initializes the simulations used for all backends with the NFA of `program` without counters.
+static rcs_error init_simulations(struct rcs_scanner *s, const struct rcs_scanner *program) {
+    const struct rcs_nfa *nfa = program->nfa;
+    const struct rcs_byte_classes *classes = &program->classes;
+    if (program->counters.states != NULL) {
+        nfa = &program->unrolled.nfa;
+        classes = &program->unrolled.classes;
+    }
+
+    rcs_error err = rcs_search_scanner_init(&s->search, nfa, classes);
+    if (rcs_failed(err))
+        return err;
+    rcs_captures_scanner_init(&s->captures, nfa, classes);
+    rcs_early_scanner_init(&s->early, nfa, classes);
+    rcs_reverse_scanner_init(&s->reverse, nfa, classes);
+    return RCS_OK;
+}
 
 rcs_error rcs_scanner_init(const struct rcs_scanner **out_scanner, const struct rcs_nfa *nfa) {
+    struct rcs_scanner_options options = {.backend = RCS_AUTO, .dfa_cache_size = 0};
+    return rcs_scanner_init_ex(out_scanner, nfa, &options);
+}
+
+rcs_error rcs_scanner_init_ex(
+    const struct rcs_scanner **out_scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_scanner_options *options
+) {
+    struct rcs_byte_classes classes;
+    rcs_error err = rcs_byte_classes_init(&classes, nfa);
+    if (rcs_failed(err))
+        return err;
+    return rcs_scanner_init_compiled(out_scanner, nfa, &classes, options, NULL);
+}
+
+rcs_error rcs_scanner_init_compiled(
+    const struct rcs_scanner **out_scanner,
+    const struct rcs_nfa *nfa,
+    struct rcs_byte_classes *classes,
+    const struct rcs_scanner_options *options,
+    const struct rcs_jit_code *jit_code
+) {
     rcs_error err = RCS_OK;
 
-    struct rcs_scanner *s = malloc(sizeof(struct rcs_scanner));
+    // zeroed, so the buffers that weren't allocated yet are freed on error
+    struct rcs_scanner *s = calloc(1, sizeof(struct rcs_scanner));
+    if (s == NULL) {
+        err = RCS_MAKE_ERR_LIBC(errno);
+        rcs_byte_classes_free(classes);
+        return err;
+    }
+    s->classes = *classes;
+    s->nfa = nfa;
+
+    err = rcs_counters_init(&s->counters, nfa);
+    if (!rcs_failed(err) && s->counters.states != NULL)
+        err = rcs_unrolled_nfa_init(&s->unrolled, nfa, &s->counters, &s->classes);
+    if (!rcs_failed(err)) {
+        err = rcs_literal_filter_init(
+            &s->literal_filter,
+            nfa->required_literal,
+            nfa->required_literal_len
+        );
+    }
+    if (!rcs_failed(err))
+        err = init_simulations(s, s);
+    if (rcs_failed(err))
+        goto error_free;
+
+    if (options->backend == RCS_AUTO) {
+        bool initialized = false;
+        for (size_t i = 0; i < RCS_ARRAY_LEN(auto_backends) && !initialized; ++i) {
+            if (auto_backends[i] == RCS_JIT && nfa->states_len > AUTO_JIT_MAX_STATES)
+                continue;
+            initialized = init_backend(&err, s, auto_backends[i], nfa, options, jit_code);
+        }
+        assert(initialized && "the last auto backend must support any NFA");
+    } else if (!init_backend(&err, s, options->backend, nfa, options, jit_code)) {
+        err = RCS_MAKE_ERR(RCS_ERR_UNSUPPORTED_BACKEND);
+    }
+    if (rcs_failed(err))
+        goto error_free;
+
+    s->program = NULL;
+    s->owned_nfa = NULL;
+    s->options = *options;
+    s->options.backend = s->backend_type;
+    *out_scanner = s;
+    return RCS_OK;
+
+error_free:
+    rcs_search_scanner_free(&s->search);
+    rcs_literal_filter_free(&s->literal_filter);
+    rcs_unrolled_nfa_free(&s->unrolled);
+    rcs_counters_free(&s->counters);
+    rcs_byte_classes_free(&s->classes);
+    free(s);
+    return err;
+}
+
+rcs_error
+rcs_scanner_clone(const struct rcs_scanner **out_scanner, const struct rcs_scanner *scanner) {
+    const struct rcs_scanner *program = rcs_scanner_program(scanner);
+    const struct rcs_nfa *nfa = program->nfa;
+    const struct rcs_byte_classes *classes = &program->classes;
+    const struct rcs_counters *counters = &program->counters;
+    rcs_error err = RCS_OK;
+
+    struct rcs_scanner *s = calloc(1, sizeof(struct rcs_scanner));
     if (s == NULL)
         return RCS_MAKE_ERR_LIBC(errno);
+    s->program = program;
+    s->owned_nfa = NULL;
+    s->nfa = nfa;
+    s->backend_type = program->backend_type;
+    s->options = program->options;
 
-    bool jit_supported = rcs_jit_scanner_init(&err, &s->backend.jit, nfa);
-
-    if (jit_supported) {
-        if (rcs_failed(err))
-            goto error_free;
-        s->backend_type = RCS_JIT;
-    } else {
-        // fallback to slower standard implementation
+    err = rcs_literal_filter_init(
+        &s->literal_filter,
+        nfa->required_literal,
+        nfa->required_literal_len
+    );
+    if (!rcs_failed(err))
+        err = init_simulations(s, program);
+    if (rcs_failed(err))
+        goto error_free;
 
-        s->backend_type = RCS_STANDARD;
-        err = rcs_standard_scanner_init(&s->backend.standard, nfa);
-        if (rcs_failed(err))
-            goto error_free;
+    switch (s->backend_type) {
+    case RCS_JIT:
+        err = rcs_jit_scanner_clone(&s->backend.jit, &program->backend.jit);
+        break;
+    case RCS_STANDARD:
+        err = rcs_standard_scanner_init(&s->backend.standard, nfa, classes, counters);
+        break;
+    case RCS_LAZY_DFA:
+        err = rcs_lazy_dfa_scanner_init(
+            &s->backend.lazy_dfa,
+            nfa,
+            classes,
+            counters,
+            s->options.dfa_cache_size
+        );
+        break;
+    case RCS_BIT_PARALLEL:
+        err = rcs_bitparallel_scanner_clone(&s->backend.bitparallel, &program->backend.bitparallel);
+        break;
+    default:
+        assert(0 && "invalid scanner backend type");
     }
+    if (rcs_failed(err))
+        goto error_free;
 
     *out_scanner = s;
     return RCS_OK;
 
 error_free:
+    rcs_search_scanner_free(&s->search);
+    rcs_literal_filter_free(&s->literal_filter);
     free(s);
     return err;
 }
 
+// Sets `out_found` to false if the input can't match because it lacks the required literal.
+// Otherwise the reader is at the input start again.
+static rcs_error run_literal_filter(
+    rcs_api_bool *out_found,
+    struct rcs_scanner *scanner,
+    const struct rcs_reader *reader
+) {
+    if (scanner->literal_filter.len == 0) {
+        *out_found = true;
+        return RCS_OK;
+    }
+    return rcs_literal_filter_run(out_found, &scanner->literal_filter, reader);
+}
+
 rcs_error
 rcs_match(rcs_api_bool *out_ok, struct rcs_scanner *scanner, const struct rcs_reader *reader) {
+    rcs_api_bool has_literal;
+    rcs_error err = run_literal_filter(&has_literal, scanner, reader);
+    if (rcs_failed(err) || !has_literal) {
+        *out_ok = false;
+        return err;
+    }
+
     switch (scanner->backend_type) {
     case RCS_JIT:
         return rcs_jit_match(out_ok, &scanner->backend.jit, reader);
     case RCS_STANDARD:
         return rcs_standard_match(out_ok, &scanner->backend.standard, reader);
+    case RCS_LAZY_DFA:
+        return rcs_lazy_dfa_match(out_ok, &scanner->backend.lazy_dfa, reader);
+    case RCS_BIT_PARALLEL:
+        return rcs_bitparallel_match(out_ok, &scanner->backend.bitparallel, reader);
     default:
         assert(0 && "invalid scanner backend type");
     }
 }
 
+rcs_error rcs_match_buffer(
+    rcs_api_bool *out_ok,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len
+) {
+    struct rcs_buffer_reader r;
+    rcs_buffer_reader_init(&r, buf, len);
+    return rcs_match(out_ok, scanner, &r.reader);
+}
+
+rcs_error rcs_match_file(rcs_api_bool *out_ok, struct rcs_scanner *scanner, const char *path) {
+    const void *addr;
+    size_t len;
+    rcs_error err = rcs_mmap_file(&addr, &len, path);
+    if (rcs_failed(err))
+        return err;
+
+    err = rcs_match_buffer(out_ok, scanner, addr, len);
+    if (addr != NULL)
+        rcs_mmap_free((void *)addr, len);
+    return err;
+}
+
+rcs_error rcs_search(
+    rcs_api_bool *out_found,
+    uint64_t *out_start,
+    uint64_t *out_end,
+    struct rcs_scanner *scanner,
+    const struct rcs_reader *reader
+) {
+    rcs_api_bool has_literal;
+    rcs_error err = run_literal_filter(&has_literal, scanner, reader);
+    if (rcs_failed(err) || !has_literal) {
+        *out_found = false;
+        return err;
+    }
+
+    return rcs_search_scanner_search(out_found, out_start, out_end, &scanner->search, reader);
+}
+
+rcs_api_size rcs_captures_len(const struct rcs_scanner *scanner) {
+    return scanner->nfa->captures_len;
+}
+
+rcs_error rcs_match_captures(
+    rcs_api_bool *out_ok,
+    uint64_t *out_slots,
+    struct rcs_scanner *scanner,
+    const struct rcs_reader *reader
+) {
+    rcs_api_bool has_literal;
+    rcs_error err = run_literal_filter(&has_literal, scanner, reader);
+    if (rcs_failed(err) || !has_literal) {
+        *out_ok = false;
+        return err;
+    }
+
+    return rcs_captures_scanner_match(out_ok, out_slots, &scanner->captures, reader);
+}
+
+rcs_error rcs_match_early(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_scanner *scanner,
+    const struct rcs_reader *reader,
+    uint32_t mode
+) {
+    return rcs_early_scanner_match(out_ok, out_offset, &scanner->early, reader, mode);
+}
+
+rcs_error rcs_match_reverse(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    uint32_t mode
+) {
+    return rcs_reverse_scanner_match(out_ok, out_offset, &scanner->reverse, buf, len, mode);
+}
+
+rcs_error rcs_match_batch(
+    rcs_api_bool *out_ok,
+    struct rcs_scanner *scanner,
+    const struct rcs_input *inputs,
+    rcs_api_size inputs_len
+) {
+    // Literal search on short inputs costs about as much as the bit-parallel simulation.
+    if (scanner->backend_type == RCS_BIT_PARALLEL) {
+        rcs_bitparallel_match_batch(out_ok, &scanner->backend.bitparallel, inputs, inputs_len);
+        return RCS_OK;
+    }
+
+    for (size_t i = 0; i < inputs_len; ++i) {
+        rcs_error err = rcs_match_buffer(&out_ok[i], scanner, inputs[i].ptr, inputs[i].len);
+        if (rcs_failed(err))
+            return err;
+    }
+    return RCS_OK;
+}
+
+rcs_api_size rcs_stream_size(const struct rcs_scanner *scanner) {
+    size_t config_len = rcs_scanner_program(scanner)->counters.config_len;
+    return sizeof(struct rcs_stream) + config_len * sizeof(rcs_bitmap_word);
+}
+
+void rcs_stream_begin(struct rcs_stream *ctx, const struct rcs_scanner *scanner) {
+    const struct rcs_nfa *nfa = scanner->nfa;
+    const struct rcs_counters *counters = &rcs_scanner_program(scanner)->counters;
+
+    ctx->accepted = false;
+    rcs_bitmap_clear_all(ctx->states_bm, counters->config_len);
+    for (size_t i = 0; i < nfa->sources_len; ++i) {
+        if (nfa->sources[i] == nfa->accept)
+            ctx->accepted = true;
+        else
+            rcs_counters_enter(counters, ctx->states_bm, nfa->sources[i] - nfa->states);
+    }
+}
+
+rcs_error rcs_stream_feed(
+    struct rcs_stream *ctx,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    rcs_api_size len
+) {
+    if (len == 0)
+        return RCS_OK;
+
+    switch (scanner->backend_type) {
+    case RCS_JIT:
+        ctx->accepted = rcs_jit_feed(&scanner->backend.jit, ctx->states_bm, buf, len);
+        return RCS_OK;
+    case RCS_STANDARD:
+        ctx->accepted = rcs_standard_feed(&scanner->backend.standard, ctx->states_bm, buf, len);
+        return RCS_OK;
+    case RCS_LAZY_DFA: {
+        rcs_api_bool accepted;
+        rcs_error err = rcs_lazy_dfa_feed(
+            &accepted,
+            &scanner->backend.lazy_dfa,
+            ctx->states_bm,
+            buf,
+            len
+        );
+        if (!rcs_failed(err))
+            ctx->accepted = accepted;
+        return err;
+    }
+    case RCS_BIT_PARALLEL:
+        ctx->accepted =
+            rcs_bitparallel_feed(&scanner->backend.bitparallel, ctx->states_bm, buf, len);
+        return RCS_OK;
+    default:
+        assert(0 && "invalid scanner backend type");
+    }
+}
+
+rcs_error rcs_stream_end(rcs_api_bool *out_ok, const struct rcs_stream *ctx) {
+    *out_ok = ctx->accepted != 0;
+    return RCS_OK;
+}
+
 void rcs_scanner_free(struct rcs_scanner *scanner) {
+    bool owns_program = scanner->program == NULL;
+
+    rcs_search_scanner_free(&scanner->search);
+    rcs_captures_scanner_free(&scanner->captures);
+    rcs_early_scanner_free(&scanner->early);
+    rcs_reverse_scanner_free(&scanner->reverse);
+    rcs_literal_filter_free(&scanner->literal_filter);
+
     switch (scanner->backend_type) {
     case RCS_JIT:
         rcs_jit_scanner_free(&scanner->backend.jit);
@@ -87,7 +464,21 @@ void rcs_scanner_free(struct rcs_scanner *scanner) {
     case RCS_STANDARD:
         rcs_standard_scanner_free(&scanner->backend.standard);
         break;
+    case RCS_LAZY_DFA:
+        rcs_lazy_dfa_scanner_free(&scanner->backend.lazy_dfa);
+        break;
+    case RCS_BIT_PARALLEL:
+        rcs_bitparallel_scanner_free(&scanner->backend.bitparallel);
+        break;
     default:
         assert(0 && "invalid scanner backend type");
     }
+    // after the backends, they may refer to them
+    if (owns_program) {
+        rcs_unrolled_nfa_free(&scanner->unrolled);
+        rcs_counters_free(&scanner->counters);
+        rcs_byte_classes_free(&scanner->classes);
+    }
+    free(scanner->owned_nfa);
+    free(scanner);
 }
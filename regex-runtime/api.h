@@ -28,7 +28,9 @@ typedef enum {
     RCS_NO_ERR = 0,
     RCS_ERR_LIBC,
     RCS_ERR_READER,
-    RCS_ERR_JIT_TOO_LONG_JUMP
+    RCS_ERR_JIT_TOO_LONG_JUMP,
+    RCS_ERR_UNSUPPORTED_BACKEND,
+    RCS_ERR_BAD_IMAGE
 } rcs_error_code;
 
 typedef struct {
@@ -50,6 +52,10 @@ struct rcs_nfa_state {
     // Only the accepting state may have an empty next list.
     struct rcs_nfa_state **next;
     rcs_api_size next_len;
+    // Capture tags of the transitions, `next_len + 1` offsets in `rcs_nfa.tags`: the transition to
+    // `next[j]` sets slots `tags[next_tags[j]..next_tags[j + 1])` to the input position.
+    // NULL if the NFA has no captures.
+    rcs_api_size *next_tags;
 
     // ε-states have empty ranges.
     // Only the accepting state is ε.
@@ -58,8 +64,17 @@ struct rcs_nfa_state {
 
     // Match chars not in ranges union.
     rcs_api_bool inverted_match;
+
+    // Counting state: matches `counter_min..counter_max` chars of the ranges in a row and only then
+    // goes to `next`, like `[0-9]{2,5}` does. Entering it again while it counts starts another
+    // count, all of them are tracked. `counter_max` is 0 for plain states and
+    // `RCS_COUNTER_UNBOUNDED` for `{n,}`, `counter_min` must be at least 1 for counting states.
+    // The accepting state can't count.
+    rcs_api_size counter_min, counter_max;
 };
 
+#define RCS_COUNTER_UNBOUNDED UINT32_MAX
+
 struct rcs_nfa {
     struct rcs_nfa_state *states;
     rcs_api_size states_len;
@@ -68,6 +83,20 @@ struct rcs_nfa {
 
     // Must be an ε-state.
     struct rcs_nfa_state *accept;
+
+    // Literal contained in every matched string, may be NULL if `required_literal_len` is 0.
+    // Inputs without it are rejected without running the automaton.
+    uint8_t *required_literal;
+    rcs_api_size required_literal_len;
+
+    // Number of capture groups, the whole match is not counted.
+    rcs_api_size captures_len;
+    // Capture slots referenced by `next_tags` of the states and by `source_tags`.
+    // Slot `2k` is the start of the group `k + 1`, slot `2k + 1` is its end.
+    rcs_api_size *tags;
+    // Tags of entering each of the `sources`, `sources_len + 1` offsets like `next_tags`.
+    // NULL if the NFA has no captures.
+    rcs_api_size *source_tags;
 };
 
 struct rcs_reader {
@@ -78,7 +107,7 @@ struct rcs_reader {
     // Go `n` bytes back.
     // Returns false on error.
     // NOTE: this function may change `buf` address.
-    rcs_api_bool (*unwind)(uint64_t n);
+    rcs_api_bool (*unwind)(void *arg, uint64_t n);
 
     // Pointer to a part of buffer that contains read by `read()` bytes.
     // WARNING: any `read()` on `unwind()` call may change this address.
@@ -87,16 +116,275 @@ struct rcs_reader {
     void *arg;
 };
 
+typedef enum {
+    // Pick the fastest backend that supports the given NFA.
+    RCS_AUTO = 0,
+    RCS_STANDARD,
+    RCS_JIT,
+    // Builds DFA states on demand and caches them.
+    RCS_LAZY_DFA,
+    // Branch-free NFA simulation on a single word, only for small NFAs.
+    RCS_BIT_PARALLEL,
+} rcs_scanner_backend;
+
+struct rcs_scanner_options {
+    uint32_t backend; // value of type rcs_scanner_backend
+
+    // Memory limit of the lazy DFA states cache in bytes, 0 means default.
+    rcs_api_size dfa_cache_size;
+};
+
 struct rcs_scanner;
 
 // Allocates a memory and initiates a scanner for the given `nfa`.
 // Free created scanner with `rcs_scanner_free()` after use.
 rcs_error rcs_scanner_init(const struct rcs_scanner **scanner, const struct rcs_nfa *nfa);
 
+// Same as `rcs_scanner_init()`, but with the explicit options.
+// Fails with `RCS_ERR_UNSUPPORTED_BACKEND` if the requested backend can't handle the `nfa`.
+rcs_error rcs_scanner_init_ex(
+    const struct rcs_scanner **scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_scanner_options *options
+);
+
+// A scanner must not be used by several threads at once, since it keeps the scratch state of a
+// match. Clone it for each thread instead: a clone shares the compiled program (byte classes, JIT
+// code, tables) with the original scanner and only allocates its own scratch state.
+// The original must be freed after all its clones. Clones of clones share the original's program.
+rcs_error
+rcs_scanner_clone(const struct rcs_scanner **out_scanner, const struct rcs_scanner *scanner);
+
+// Compiled image of a scanner program: the NFA, its byte classes and the JIT code in a flat
+// versioned layout. Loading it skips all the compilation, the NFA isn't needed anymore.
+// An image is valid only for the runtime version and the architecture it was saved by, others are
+// rejected with `RCS_ERR_BAD_IMAGE`. The JIT code of an image is executed as is, so images must
+// come from a trusted source.
+
+// Allocates `out_image` and saves the program of `scanner` to it.
+// Free the image with `rcs_image_free()` after use.
+rcs_error
+rcs_scanner_save(uint8_t **out_image, uint64_t *out_len, const struct rcs_scanner *scanner);
+
+void rcs_image_free(uint8_t *image);
+
+// Creates a scanner from the image, that isn't referenced after the call.
+// Free created scanner with `rcs_scanner_free()` after use.
+rcs_error
+rcs_scanner_load(const struct rcs_scanner **out_scanner, const uint8_t *image, uint64_t len);
+
+// Same as `rcs_scanner_load()` for the image in the memory-mapped file at `path`.
+rcs_error rcs_scanner_load_file(const struct rcs_scanner **out_scanner, const char *path);
+
 // Match 8-bit string (may contain 0s).
 rcs_error
 rcs_match(rcs_api_bool *out_ok, struct rcs_scanner *scanner, const struct rcs_reader *reader);
 
+// Same as `rcs_match()` for an input that is already in the memory, no reader calls.
+rcs_error rcs_match_buffer(
+    rcs_api_bool *out_ok,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len
+);
+
+// Same as `rcs_match_buffer()`, but the input is split into chunks matched by several threads.
+// The first chunk is matched as usual, for each of the others a thread finds the states it ends in
+// for every state it may start in. Runs ending in the same states are merged, so it pays off if
+// the NFA converges to a few state sets quickly. Then the chunk results are composed in order.
+// `threads` 0 means the number of CPUs, small inputs are matched by the calling thread.
+rcs_error rcs_match_parallel(
+    rcs_api_bool *out_ok,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    rcs_api_size threads
+);
+
+// Same as `rcs_match()` for the contents of the file at `path`.
+// The file is memory-mapped, so it's read by the kernel readahead without any copying.
+rcs_error rcs_match_file(rcs_api_bool *out_ok, struct rcs_scanner *scanner, const char *path);
+
+// Find the leftmost-longest match `[out_start, out_end)` of the NFA in the input.
+// Unlike `rcs_match()`, the match doesn't have to span the whole input.
+// Offsets are set only if a match was found.
+rcs_error rcs_search(
+    rcs_api_bool *out_found,
+    uint64_t *out_start,
+    uint64_t *out_end,
+    struct rcs_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+// Position of a capture group that didn't participate in the match.
+#define RCS_NO_CAPTURE UINT64_MAX
+
+// Number of capture groups of the scanner's NFA, the whole match is not counted.
+rcs_api_size rcs_captures_len(const struct rcs_scanner *scanner);
+
+// Same as `rcs_match()`, but also finds the bounds of the capture groups, with the priorities of a
+// backtracking engine: alternatives are tried from the left, quantifiers are greedy.
+// Group `k` is `[out_slots[2k], out_slots[2k + 1])`, group 0 is the whole input.
+// `out_slots` must have `2 * (rcs_captures_len() + 1)` items, they are set only on a match.
+// Runs in linear time regardless of the backend, by an NFA simulation that carries the positions.
+rcs_error rcs_match_captures(
+    rcs_api_bool *out_ok,
+    uint64_t *out_slots,
+    struct rcs_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+typedef enum {
+    // The input starts with a match: stops at the end of the shortest matching prefix.
+    RCS_MATCH_PREFIX = 0,
+    // Same result as `rcs_match()`, but stops as soon as the accepting state is reached with a
+    // universal tail active (like a trailing `.*`), so no remaining input can reject the match.
+    RCS_MATCH_UNTIL_DECIDED,
+    // The input starts with a match: stops once no state is active, at the end of the longest
+    // matching prefix.
+    RCS_MATCH_LONGEST_PREFIX,
+} rcs_match_mode;
+
+// Matches in the `mode` (value of type rcs_match_mode) and stops reading the input once the result
+// is known. `out_offset` is set to the number of bytes consumed when it was decided: the end of
+// the match, the position where no state stayed active, or the input length.
+// Runs an NFA simulation for all backends, because it checks the states after each byte. It pays
+// off when the decision comes early, the rest of the input is never read. The required literal
+// filter is not used.
+rcs_error rcs_match_early(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_scanner *scanner,
+    const struct rcs_reader *reader,
+    uint32_t mode
+);
+
+// Same as `rcs_match_early()` for `buf` read backwards from its end, by an NFA with the reversed
+// transitions: the prefixes of the modes are suffixes of `buf`, `out_offset` counts from its end.
+// With RCS_MATCH_UNTIL_DECIDED the result is the one of `rcs_match_buffer()`, but inputs of a regex
+// with a selective suffix like `.*\.(jpg|png)` are decided by their tail alone.
+// With RCS_MATCH_LONGEST_PREFIX it recovers the start of a match known to end at `len`, such as
+// the end found by `rcs_search()`: the leftmost one is `len - out_offset`.
+// The reversed NFA is built by the first call on the scanner.
+rcs_error rcs_match_reverse(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    uint32_t mode
+);
+
+// Input string in the memory.
+struct rcs_input {
+    const uint8_t *ptr;
+    rcs_api_size len;
+};
+
+// Match each of the `inputs` separately, `out_ok[i]` is set to the result for `inputs[i]`.
+// Much faster than `rcs_match()` in a loop for many short inputs: the bit-parallel backend
+// advances several inputs at once, so their steps overlap in the CPU.
+rcs_error rcs_match_batch(
+    rcs_api_bool *out_ok,
+    struct rcs_scanner *scanner,
+    const struct rcs_input *inputs,
+    rcs_api_size inputs_len
+);
+
+struct rcs_grep_options {
+    // Worker threads for big inputs, 0 means the number of CPUs.
+    rcs_api_size threads;
+    // Only count the matched lines, `line_starts` of the result is not collected.
+    rcs_api_bool count_only;
+};
+
+struct rcs_grep_result {
+    uint64_t count;
+    // Offsets of the matched lines in ascending order, NULL if there are none or only counted.
+    uint64_t *line_starts;
+};
+
+// Match each line of the input separately, lines are delimited by '\n' that is not a part of them.
+// The input is split between threads at line boundaries, each extra thread uses a clone of the
+// scanner. Lines without the required literal are skipped by the literal search.
+// Free the result with `rcs_grep_result_free()` after use.
+rcs_error rcs_grep(
+    struct rcs_grep_result *out,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    const struct rcs_grep_options *options
+);
+
+// Same as `rcs_grep()` for the contents of the memory-mapped file at `path`.
+rcs_error rcs_grep_file(
+    struct rcs_grep_result *out,
+    struct rcs_scanner *scanner,
+    const char *path,
+    const struct rcs_grep_options *options
+);
+
+void rcs_grep_result_free(struct rcs_grep_result *result);
+
+// Context of an incremental match, for inputs pushed in chunks by the caller.
+// It is plain data of `rcs_stream_size()` bytes aligned to 8 bytes, owned by the caller.
+// A copy of the context may be resumed later (by the same scanner or its clone) from where it was
+// made.
+// The required literal filter is not used for streams.
+struct rcs_stream;
+
+// Size of the stream context in bytes.
+rcs_api_size rcs_stream_size(const struct rcs_scanner *scanner);
+
+// Starts a new input in `ctx`.
+void rcs_stream_begin(struct rcs_stream *ctx, const struct rcs_scanner *scanner);
+
+// Advances `ctx` by the next chunk of the input.
+rcs_error rcs_stream_feed(
+    struct rcs_stream *ctx,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    rcs_api_size len
+);
+
+// Sets `out_ok` if the input fed since `rcs_stream_begin()` matches.
+// Doesn't change `ctx`, more chunks may be fed after that.
+rcs_error rcs_stream_end(rcs_api_bool *out_ok, const struct rcs_stream *ctx);
+
 void rcs_scanner_free(struct rcs_scanner *scanner);
 
+// NFAs of several patterns merged into one, each pattern has its own accepting state.
+// States of different patterns may be shared.
+struct rcs_nfa_set {
+    struct rcs_nfa_state *states;
+    rcs_api_size states_len;
+    struct rcs_nfa_state **sources;
+    rcs_api_size sources_len;
+
+    // Accepting state of each pattern, ε-states. Must not be empty.
+    struct rcs_nfa_state **accepts;
+    rcs_api_size accepts_len;
+};
+
+struct rcs_set_scanner;
+
+// Allocates a memory and initiates a scanner that matches all patterns of the `set` in one pass.
+// Only `RCS_AUTO` and `RCS_LAZY_DFA` backends are supported.
+// Free created scanner with `rcs_set_scanner_free()` after use.
+rcs_error rcs_set_scanner_init(
+    const struct rcs_set_scanner **scanner,
+    const struct rcs_nfa_set *set,
+    const struct rcs_scanner_options *options
+);
+
+// Sets bit `i` of `out_matched` iff the pattern `i` matches the whole input.
+// `out_matched` must have `ceil(accepts_len / 64)` words.
+rcs_error rcs_set_match(
+    uint64_t *out_matched,
+    struct rcs_set_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+void rcs_set_scanner_free(struct rcs_set_scanner *scanner);
+
 #endif
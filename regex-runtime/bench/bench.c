@@ -0,0 +1,350 @@
+// clock_gettime() is not in C99.
+#define _POSIX_C_SOURCE 200809L
+
+// Benchmark of the scanner backends on a fixed corpus, run by `make bench`.
+//
+// Prints JSON with the results of each case on each backend: throughput, time per matched input,
+// compile latency and JIT code size. The inputs are generated from fixed seeds, so the numbers of
+// runs on the same machine are comparable, and `matched` must be the same for all backends.
+//
+// Usage: regex-bench [substring of the case names to run]
+
+#include "../api.h"
+#include "../jit.h"
+#include "../scanner.h"
+#include "pattern.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Timed runs of each case, the fastest one is reported.
+#define MATCH_RUNS 5
+// Compilations of each case, the median is reported.
+#define COMPILE_RUNS 9
+
+#define MIB (1024 * 1024)
+
+struct corpus {
+    uint8_t *buf;
+    size_t len, cap;
+    struct rcs_input *inputs;
+    size_t inputs_len, inputs_cap;
+};
+
+struct bench_case {
+    const char *name;
+    const char *pattern;
+    void (*generate)(struct corpus *corpus);
+};
+
+static const struct {
+    rcs_scanner_backend backend;
+    const char *name;
+} backends[] = {
+    {RCS_STANDARD, "standard"},
+    {RCS_JIT, "jit"},
+    {RCS_LAZY_DFA, "lazy_dfa"},
+    {RCS_BIT_PARALLEL, "bit_parallel"},
+};
+
+static uint64_t rng_state;
+
+// xorshift64, the corpus must not depend on the libc.
+static uint64_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+static size_t rng_below(size_t n) {
+    return rng_next() % n;
+}
+
+static void *xrealloc(void *ptr, size_t size) {
+    ptr = realloc(ptr, size);
+    if (ptr == NULL) {
+        perror("regex-bench");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+static void put_byte(struct corpus *c, uint8_t b) {
+    if (c->len == c->cap) {
+        c->cap = c->cap == 0 ? MIB : 2 * c->cap;
+        c->buf = xrealloc(c->buf, c->cap);
+    }
+    c->buf[c->len++] = b;
+}
+
+static void put_str(struct corpus *c, const char *s) {
+    while (*s != '\0')
+        put_byte(c, *s++);
+}
+
+// Inputs are stored as offsets until the buffer stops growing, see `finish_corpus()`.
+static void end_input(struct corpus *c, size_t start) {
+    if (c->inputs_len == c->inputs_cap) {
+        c->inputs_cap = c->inputs_cap == 0 ? 1024 : 2 * c->inputs_cap;
+        c->inputs = xrealloc(c->inputs, c->inputs_cap * sizeof(*c->inputs));
+    }
+    c->inputs[c->inputs_len++] = (struct rcs_input){
+        .ptr = (const uint8_t *)(uintptr_t)start,
+        .len = c->len - start,
+    };
+}
+
+static void finish_corpus(struct corpus *c) {
+    for (size_t i = 0; i < c->inputs_len; ++i)
+        c->inputs[i].ptr = c->buf + (uintptr_t)c->inputs[i].ptr;
+}
+
+static void put_number(struct corpus *c, size_t digits) {
+    for (size_t i = 0; i < digits; ++i)
+        put_byte(c, '0' + rng_below(10));
+}
+
+static void put_word(struct corpus *c, size_t max_len) {
+    size_t len = 1 + rng_below(max_len);
+    for (size_t i = 0; i < len; ++i)
+        put_byte(c, 'a' + rng_below(26));
+}
+
+static void put_log_line(struct corpus *c) {
+    static const char *levels[] = {"INFO", "INFO", "INFO", "WARN", "ERROR"};
+    static const char *messages[] = {"request served", "cache miss", "timeout", "retrying"};
+
+    put_str(c, "2024-");
+    put_number(c, 2);
+    put_byte(c, '-');
+    put_number(c, 2);
+    put_byte(c, ' ');
+    put_number(c, 2);
+    put_byte(c, ':');
+    put_number(c, 2);
+    put_byte(c, ':');
+    put_number(c, 2);
+    put_byte(c, '.');
+    put_number(c, 3);
+    put_byte(c, ' ');
+    put_str(c, levels[rng_below(RCS_ARRAY_LEN(levels))]);
+    put_byte(c, ' ');
+    put_word(c, 8);
+    put_byte(c, '.');
+    put_word(c, 8);
+    put_str(c, ": ");
+    put_str(c, messages[rng_below(RCS_ARRAY_LEN(messages))]);
+    put_str(c, " code ");
+    put_number(c, 1 + rng_below(4));
+    for (size_t i = rng_below(6); i > 0; --i) {
+        put_byte(c, ' ');
+        put_word(c, 10);
+    }
+}
+
+// `aaa...az`: backtracking engines take exponential time on `(a*)*bz`.
+static void generate_nested_star(struct corpus *c) {
+    for (size_t i = 0; i < 16 * MIB - 1; ++i)
+        put_byte(c, 'a');
+    put_byte(c, 'z');
+    end_input(c, 0);
+}
+
+// Random `a` and `b`: the minimal DFA of `(a|b)*a(a|b){n}` has `2^n` states.
+static void generate_ab(struct corpus *c) {
+    for (size_t i = 0; i < 4 * MIB; ++i)
+        put_byte(c, rng_below(2) == 0 ? 'a' : 'b');
+    end_input(c, 0);
+}
+
+static void generate_log_lines(struct corpus *c) {
+    for (size_t i = 0; i < 200000; ++i) {
+        size_t start = c->len;
+        put_log_line(c);
+        end_input(c, start);
+    }
+}
+
+// Identifiers and numbers in decimal and hex.
+static void generate_tokens(struct corpus *c) {
+    for (size_t i = 0; i < 1000000; ++i) {
+        size_t start = c->len;
+        switch (rng_below(3)) {
+        case 0:
+            put_word(c, 12);
+            break;
+        case 1:
+            put_byte(c, '1' + rng_below(9));
+            put_number(c, rng_below(8));
+            break;
+        default:
+            put_str(c, "0x");
+            for (size_t k = 1 + rng_below(8); k > 0; --k)
+                put_byte(c, "0123456789abcdefg"[rng_below(17)]);
+        }
+        end_input(c, start);
+    }
+}
+
+// The whole log is a single input, like a file matched by `rcs_match_file()`.
+static void generate_large_log(struct corpus *c) {
+    while (c->len < 64 * MIB) {
+        put_log_line(c);
+        put_byte(c, '\n');
+    }
+    end_input(c, 0);
+}
+
+static const struct bench_case cases[] = {
+    {"nested_star", "(a*)*bz", generate_nested_star},
+    {"exponential_dfa", "(a|b)*a(a|b){20}", generate_ab},
+    {"log_lines",
+     "[0-9]+-[0-9]+-[0-9]+ [0-9:.]+ (WARN|ERROR) [a-z]+\\.[a-z]+: .*timeout.*",
+     generate_log_lines},
+    {"short_tokens", "0|0x[0-9a-f]+|[1-9][0-9]*|[a-z_][a-z0-9_]*", generate_tokens},
+    {"large_log_file", ".*ERROR [a-z]+\\.[a-z]+: timeout.*", generate_large_log},
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s != '\0'; ++s) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static void run_backend(
+    const struct bench_case *bc,
+    const struct bench_pattern *pattern,
+    const struct corpus *corpus,
+    size_t backend_i
+) {
+    struct rcs_scanner_options options = {.backend = backends[backend_i].backend};
+    uint64_t compile_ns[COMPILE_RUNS];
+    const struct rcs_scanner *scanner = NULL;
+    rcs_error err = RCS_OK;
+
+    for (size_t run = 0; run < COMPILE_RUNS; ++run) {
+        if (scanner != NULL)
+            rcs_scanner_free((struct rcs_scanner *)scanner);
+        uint64_t start = now_ns();
+        err = rcs_scanner_init_ex(&scanner, &pattern->nfa, &options);
+        compile_ns[run] = now_ns() - start;
+        if (rcs_failed(err)) {
+            printf("    {\"case\": ");
+            print_json_string(bc->name);
+            printf(", \"backend\": \"%s\", \"error\": ", backends[backend_i].name);
+            print_json_string(rcs_strerror(err));
+            printf("}");
+            return;
+        }
+    }
+    qsort(compile_ns, COMPILE_RUNS, sizeof(*compile_ns), compare_u64);
+
+    uint64_t best_ns = UINT64_MAX;
+    size_t matched = 0;
+    for (size_t run = 0; run < MATCH_RUNS && !rcs_failed(err); ++run) {
+        matched = 0;
+        uint64_t start = now_ns();
+        for (size_t i = 0; i < corpus->inputs_len && !rcs_failed(err); ++i) {
+            rcs_api_bool ok;
+            const struct rcs_input *input = &corpus->inputs[i];
+            err = rcs_match_buffer(&ok, (struct rcs_scanner *)scanner, input->ptr, input->len);
+            matched += ok != 0;
+        }
+        uint64_t elapsed = now_ns() - start;
+        if (elapsed < best_ns)
+            best_ns = elapsed;
+    }
+
+    printf("    {\"case\": ");
+    print_json_string(bc->name);
+    printf(", \"pattern\": ");
+    print_json_string(bc->pattern);
+    printf(", \"backend\": \"%s\"", backends[backend_i].name);
+    if (rcs_failed(err)) {
+        printf(", \"error\": ");
+        print_json_string(rcs_strerror(err));
+    } else {
+        // MB are 10^6 bytes, like in the most of the published regex benchmarks
+        double mb_per_s = best_ns == 0 ? 0 : corpus->len * 1e3 / best_ns;
+        printf(
+            ", \"states\": %zu, \"inputs\": %zu, \"input_bytes\": %zu, \"matched\": %zu",
+            (size_t)pattern->nfa.states_len,
+            corpus->inputs_len,
+            corpus->len,
+            matched
+        );
+        printf(
+            ", \"compile_ns\": %llu, \"ns_per_match\": %.1f, \"mb_per_s\": %.1f",
+            (unsigned long long)compile_ns[COMPILE_RUNS / 2],
+            (double)best_ns / corpus->inputs_len,
+            mb_per_s
+        );
+        if (scanner->backend_type == RCS_JIT) {
+            struct rcs_jit_code code;
+            rcs_jit_scanner_code(&code, &scanner->backend.jit);
+            printf(", \"jit_code_bytes\": %zu", code.len);
+        } else {
+            printf(", \"jit_code_bytes\": null");
+        }
+    }
+    printf("}");
+
+    rcs_scanner_free((struct rcs_scanner *)scanner);
+}
+
+int main(int argc, char **argv) {
+    const char *filter = argc > 1 ? argv[1] : "";
+    bool first = true;
+
+    printf("{\n  \"match_runs\": %d,\n  \"compile_runs\": %d,\n", MATCH_RUNS, COMPILE_RUNS);
+    printf("  \"results\": [");
+    for (size_t i = 0; i < RCS_ARRAY_LEN(cases); ++i) {
+        const struct bench_case *bc = &cases[i];
+        if (strstr(bc->name, filter) == NULL)
+            continue;
+
+        struct bench_pattern pattern;
+        if (!bench_pattern_build(&pattern, bc->pattern)) {
+            fprintf(stderr, "regex-bench: invalid pattern of %s: %s\n", bc->name, bc->pattern);
+            return EXIT_FAILURE;
+        }
+        struct corpus corpus = {0};
+        // each case has its own seed, so its corpus doesn't depend on the filter
+        rng_state = 0x9e3779b97f4a7c15ULL + i;
+        bc->generate(&corpus);
+        finish_corpus(&corpus);
+
+        for (size_t b = 0; b < RCS_ARRAY_LEN(backends); ++b) {
+            printf(first ? "\n" : ",\n");
+            first = false;
+            fflush(stdout);
+            run_backend(bc, &pattern, &corpus, b);
+        }
+
+        free(corpus.buf);
+        free(corpus.inputs);
+        bench_pattern_free(&pattern);
+    }
+    printf("\n  ]\n}\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,390 @@
+#include "pattern.h"
+#include "../bitmap.h"
+#include "../common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_NODE SIZE_MAX
+
+enum node_kind {
+    NODE_EMPTY,
+    NODE_CHAR,
+    NODE_CAT,
+    NODE_ALT,
+    NODE_STAR,
+    NODE_PLUS,
+    NODE_OPT,
+};
+
+struct node {
+    enum node_kind kind;
+    // Children, `right` is used only by NODE_CAT and NODE_ALT.
+    size_t left, right;
+    // NODE_CHAR only: index of the NFA state and the bytes it matches.
+    size_t position;
+    uint8_t bytes[32];
+};
+
+// Children are always added before their parent, so the nodes are in the post-order.
+struct parser {
+    const char *src;
+    size_t i;
+    struct node *nodes;
+    size_t nodes_len, nodes_cap;
+    size_t positions_len;
+};
+
+static size_t add_node(struct parser *p, enum node_kind kind, size_t left, size_t right) {
+    if (p->nodes_len == p->nodes_cap) {
+        size_t cap = p->nodes_cap == 0 ? 64 : 2 * p->nodes_cap;
+        struct node *nodes = realloc(p->nodes, cap * sizeof(*nodes));
+        if (nodes == NULL)
+            return NO_NODE;
+        p->nodes = nodes;
+        p->nodes_cap = cap;
+    }
+    p->nodes[p->nodes_len] = (struct node){.kind = kind, .left = left, .right = right};
+    return p->nodes_len++;
+}
+
+static size_t add_char(struct parser *p, const uint8_t *bytes) {
+    size_t n = add_node(p, NODE_CHAR, NO_NODE, NO_NODE);
+    if (n == NO_NODE)
+        return NO_NODE;
+    p->nodes[n].position = p->positions_len++;
+    memcpy(p->nodes[n].bytes, bytes, sizeof(p->nodes[n].bytes));
+    return n;
+}
+
+static void set_byte(uint8_t *bytes, uint8_t b) {
+    bytes[b / 8] |= 1 << (b % 8);
+}
+
+static bool has_byte(const uint8_t *bytes, uint8_t b) {
+    return bytes[b / 8] & (1 << (b % 8));
+}
+
+static size_t parse_alt(struct parser *p);
+
+// `[...]` set, the opening bracket is consumed.
+static size_t parse_set(struct parser *p) {
+    uint8_t bytes[32] = {0};
+    bool inverted = p->src[p->i] == '^';
+    if (inverted)
+        ++p->i;
+
+    while (p->src[p->i] != ']') {
+        if (p->src[p->i] == '\0')
+            return NO_NODE;
+        if (p->src[p->i] == '\\' && p->src[p->i + 1] != '\0')
+            ++p->i;
+        uint8_t start = p->src[p->i++];
+        uint8_t end = start;
+        if (p->src[p->i] == '-' && p->src[p->i + 1] != ']' && p->src[p->i + 1] != '\0') {
+            end = p->src[p->i + 1];
+            p->i += 2;
+        }
+        for (unsigned b = start; b <= end; ++b)
+            set_byte(bytes, b);
+    }
+    ++p->i;
+
+    if (inverted) {
+        for (size_t k = 0; k < sizeof(bytes); ++k)
+            bytes[k] = ~bytes[k];
+    }
+    return add_char(p, bytes);
+}
+
+static size_t parse_atom(struct parser *p) {
+    uint8_t bytes[32] = {0};
+    char c = p->src[p->i++];
+    switch (c) {
+    case '(': {
+        size_t n = parse_alt(p);
+        if (n == NO_NODE || p->src[p->i] != ')')
+            return NO_NODE;
+        ++p->i;
+        return n;
+    }
+    case '[':
+        return parse_set(p);
+    case '.':
+        memset(bytes, 0xff, sizeof(bytes));
+        return add_char(p, bytes);
+    case '\\':
+        if (p->src[p->i] == '\0')
+            return NO_NODE;
+        set_byte(bytes, p->src[p->i++]);
+        return add_char(p, bytes);
+    case '\0':
+    case ')':
+    case '|':
+    case '*':
+    case '+':
+    case '?':
+    case '{':
+        return NO_NODE;
+    default:
+        set_byte(bytes, c);
+        return add_char(p, bytes);
+    }
+}
+
+// Atom followed by the quantifiers before `stop`. Copies of `{n}` are made by parsing the atom
+// text again, so each one has its own states.
+static size_t parse_repeat(struct parser *p, size_t stop) {
+    size_t atom_start = p->i;
+    size_t n = parse_atom(p);
+
+    while (n != NO_NODE && p->i < stop) {
+        char c = p->src[p->i];
+        if (c == '*' || c == '+' || c == '?') {
+            enum node_kind kind = c == '*' ? NODE_STAR : c == '+' ? NODE_PLUS : NODE_OPT;
+            n = add_node(p, kind, n, NO_NODE);
+            ++p->i;
+        } else if (c == '{') {
+            size_t quantifier_start = p->i;
+            char *end;
+            unsigned long count = strtoul(p->src + p->i + 1, &end, 10);
+            if (*end != '}' || end == p->src + p->i + 1)
+                return NO_NODE;
+            p->i = end - p->src + 1;
+
+            size_t resume = p->i;
+            if (count == 0)
+                n = add_node(p, NODE_EMPTY, NO_NODE, NO_NODE);
+            for (unsigned long k = 1; k < count && n != NO_NODE; ++k) {
+                p->i = atom_start;
+                size_t copy = parse_repeat(p, quantifier_start);
+                n = copy == NO_NODE ? NO_NODE : add_node(p, NODE_CAT, n, copy);
+            }
+            p->i = resume;
+        } else {
+            break;
+        }
+    }
+    return n;
+}
+
+static size_t parse_cat(struct parser *p) {
+    size_t n = add_node(p, NODE_EMPTY, NO_NODE, NO_NODE);
+    while (n != NO_NODE && p->src[p->i] != '\0' && p->src[p->i] != '|' && p->src[p->i] != ')') {
+        size_t next = parse_repeat(p, SIZE_MAX);
+        n = next == NO_NODE ? NO_NODE : add_node(p, NODE_CAT, n, next);
+    }
+    return n;
+}
+
+static size_t parse_alt(struct parser *p) {
+    size_t n = parse_cat(p);
+    while (n != NO_NODE && p->src[p->i] == '|') {
+        ++p->i;
+        size_t next = parse_cat(p);
+        n = next == NO_NODE ? NO_NODE : add_node(p, NODE_ALT, n, next);
+    }
+    return n;
+}
+
+static void bitmap_or(rcs_bitmap_word *dst, const rcs_bitmap_word *src, size_t len) {
+    for (size_t k = 0; k < len; ++k)
+        dst[k] |= src[k];
+}
+
+static size_t bitmap_count(const rcs_bitmap_word *bm, size_t len) {
+    size_t count = 0;
+    for (size_t k = 0; k < len; ++k)
+        count += __builtin_popcountll(bm[k]);
+    return count;
+}
+
+// Positions each node may start and end with, and the ones that may follow each position.
+struct glushkov {
+    size_t words;
+    bool *nullable;
+    rcs_bitmap_word *first;
+    rcs_bitmap_word *last;
+    rcs_bitmap_word *follow;
+};
+
+static bool glushkov_init(struct glushkov *g, const struct parser *p) {
+    g->words = RCS_BITMAP_LEN_WORDS(p->positions_len) + 1;
+    g->nullable = calloc(p->nodes_len, sizeof(*g->nullable));
+    g->first = calloc(p->nodes_len * g->words, sizeof(*g->first));
+    g->last = calloc(p->nodes_len * g->words, sizeof(*g->last));
+    g->follow = calloc((p->positions_len + 1) * g->words, sizeof(*g->follow));
+    if (g->nullable == NULL || g->first == NULL || g->last == NULL || g->follow == NULL)
+        return false;
+
+    for (size_t n = 0; n < p->nodes_len; ++n) {
+        const struct node *node = &p->nodes[n];
+        rcs_bitmap_word *first = &g->first[n * g->words];
+        rcs_bitmap_word *last = &g->last[n * g->words];
+        // missing children are never read, they only keep the pointers in bounds
+        size_t left = node->left != NO_NODE ? node->left : n;
+        size_t right = node->right != NO_NODE ? node->right : n;
+        const rcs_bitmap_word *l_first = &g->first[left * g->words];
+        const rcs_bitmap_word *l_last = &g->last[left * g->words];
+        const rcs_bitmap_word *r_first = &g->first[right * g->words];
+        const rcs_bitmap_word *r_last = &g->last[right * g->words];
+
+        switch (node->kind) {
+        case NODE_EMPTY:
+            g->nullable[n] = true;
+            break;
+        case NODE_CHAR:
+            rcs_bitmap_set(first, node->position);
+            rcs_bitmap_set(last, node->position);
+            break;
+        case NODE_CAT:
+            g->nullable[n] = g->nullable[node->left] && g->nullable[node->right];
+            bitmap_or(first, l_first, g->words);
+            if (g->nullable[node->left])
+                bitmap_or(first, r_first, g->words);
+            bitmap_or(last, r_last, g->words);
+            if (g->nullable[node->right])
+                bitmap_or(last, l_last, g->words);
+            for (size_t i = 0; i < p->positions_len; ++i) {
+                if (rcs_bitmap_get(l_last, i))
+                    bitmap_or(&g->follow[i * g->words], r_first, g->words);
+            }
+            break;
+        case NODE_ALT:
+            g->nullable[n] = g->nullable[node->left] || g->nullable[node->right];
+            bitmap_or(first, l_first, g->words);
+            bitmap_or(first, r_first, g->words);
+            bitmap_or(last, l_last, g->words);
+            bitmap_or(last, r_last, g->words);
+            break;
+        case NODE_STAR:
+        case NODE_PLUS:
+        case NODE_OPT:
+            g->nullable[n] = node->kind != NODE_PLUS || g->nullable[node->left];
+            bitmap_or(first, l_first, g->words);
+            bitmap_or(last, l_last, g->words);
+            if (node->kind == NODE_OPT)
+                break;
+            for (size_t i = 0; i < p->positions_len; ++i) {
+                if (rcs_bitmap_get(l_last, i))
+                    bitmap_or(&g->follow[i * g->words], l_first, g->words);
+            }
+            break;
+        }
+    }
+    return true;
+}
+
+static void glushkov_free(struct glushkov *g) {
+    free(g->nullable);
+    free(g->first);
+    free(g->last);
+    free(g->follow);
+}
+
+static size_t count_ranges(const uint8_t *bytes) {
+    size_t count = 0;
+    for (unsigned b = 0; b < 256; ++b) {
+        if (has_byte(bytes, b) && (b == 0 || !has_byte(bytes, b - 1)))
+            ++count;
+    }
+    return count;
+}
+
+static bool build_nfa(
+    struct bench_pattern *out,
+    const struct parser *p,
+    const struct glushkov *g,
+    size_t root
+) {
+    size_t states_len = p->positions_len + 1;
+    const rcs_bitmap_word *root_first = &g->first[root * g->words];
+    const rcs_bitmap_word *root_last = &g->last[root * g->words];
+
+    size_t transitions_len = bitmap_count(root_first, g->words) + 1;
+    size_t ranges_len = 0;
+    for (size_t n = 0; n < p->nodes_len; ++n) {
+        if (p->nodes[n].kind != NODE_CHAR)
+            continue;
+        size_t i = p->nodes[n].position;
+        transitions_len += bitmap_count(&g->follow[i * g->words], g->words) + 1;
+        ranges_len += count_ranges(p->nodes[n].bytes);
+    }
+
+    struct rcs_nfa_state *states = calloc(states_len, sizeof(*states));
+    out->transitions = malloc(transitions_len * sizeof(*out->transitions));
+    out->ranges = malloc((ranges_len + 1) * sizeof(*out->ranges));
+    if (states == NULL || out->transitions == NULL || out->ranges == NULL) {
+        free(states);
+        return false;
+    }
+
+    struct rcs_nfa_state *accept = &states[states_len - 1];
+    struct rcs_nfa_state **free_transition = out->transitions;
+    struct rcs_nfa_char_range *free_range = out->ranges;
+    for (size_t n = 0; n < p->nodes_len; ++n) {
+        const struct node *node = &p->nodes[n];
+        if (node->kind != NODE_CHAR)
+            continue;
+
+        struct rcs_nfa_state *state = &states[node->position];
+        state->ranges = free_range;
+        for (unsigned b = 0; b < 256; ++b) {
+            if (!has_byte(node->bytes, b))
+                continue;
+            if (b == 0 || !has_byte(node->bytes, b - 1))
+                free_range[state->ranges_len++].start = b;
+            free_range[state->ranges_len - 1].end = b;
+        }
+        free_range += state->ranges_len;
+
+        const rcs_bitmap_word *follow = &g->follow[node->position * g->words];
+        state->next = free_transition;
+        for (size_t i = 0; i < p->positions_len; ++i) {
+            if (rcs_bitmap_get(follow, i))
+                state->next[state->next_len++] = &states[i];
+        }
+        if (rcs_bitmap_get(root_last, node->position))
+            state->next[state->next_len++] = accept;
+        free_transition += state->next_len;
+    }
+
+    out->nfa = (struct rcs_nfa){
+        .states = states,
+        .states_len = states_len,
+        .sources = free_transition,
+        .accept = accept,
+    };
+    for (size_t i = 0; i < p->positions_len; ++i) {
+        if (rcs_bitmap_get(root_first, i))
+            out->nfa.sources[out->nfa.sources_len++] = &states[i];
+    }
+    if (g->nullable[root])
+        out->nfa.sources[out->nfa.sources_len++] = accept;
+    return true;
+}
+
+bool bench_pattern_build(struct bench_pattern *out, const char *pattern) {
+    *out = (struct bench_pattern){0};
+    struct parser p = {.src = pattern};
+    struct glushkov g = {0};
+
+    size_t root = parse_alt(&p);
+    bool ok = root != NO_NODE && pattern[p.i] == '\0' && glushkov_init(&g, &p) &&
+              build_nfa(out, &p, &g, root);
+
+    glushkov_free(&g);
+    free(p.nodes);
+    if (!ok)
+        bench_pattern_free(out);
+    return ok;
+}
+
+void bench_pattern_free(struct bench_pattern *pattern) {
+    free(pattern->nfa.states);
+    free(pattern->transitions);
+    free(pattern->ranges);
+    *pattern = (struct bench_pattern){0};
+}
@@ -0,0 +1,26 @@
+#ifndef REGEX_CS_RUNTIME_BENCH_PATTERN
+#define REGEX_CS_RUNTIME_BENCH_PATTERN
+
+#include "../api.h"
+#include "../common.h"
+#include <stdbool.h>
+
+// NFA of a benchmark pattern, built without the C# frontend.
+//
+// The Glushkov construction makes a state per char of the pattern and transitions between the
+// chars that may follow each other, so the NFA is ε-free like the ones of the optimizer.
+// Supports chars, `.` (any byte), `[...]` sets with ranges and `^`, `\` escapes, groups, `|`,
+// `*`, `+`, `?` and `{n}`.
+struct bench_pattern {
+    struct rcs_nfa nfa;
+    struct rcs_nfa_char_range *ranges;
+    struct rcs_nfa_state **transitions;
+};
+
+// Returns false if the pattern is invalid or the memory is exhausted.
+RCS_NODISCARD
+bool bench_pattern_build(struct bench_pattern *out, const char *pattern);
+
+void bench_pattern_free(struct bench_pattern *pattern);
+
+#endif
@@ -17,6 +17,8 @@ typedef uint32_t rcs_bitmap_word;
 #define RCS_BITMAP_WORD_BYTE_WIDTH 4
 #else
 typedef uint32_t rcs_bitmap_word;
+#define RCS_BITMAP_WORD_BIT_WIDTH 32
+#define RCS_BITMAP_WORD_BYTE_WIDTH 4
 #endif
 
 #define RCS_BITMAP_LEN_WORDS(bits) RCS_DIV_CEILING(bits, RCS_BITMAP_WORD_BIT_WIDTH)
@@ -24,23 +26,51 @@ typedef uint32_t rcs_bitmap_word;
 static inline bool rcs_bitmap_get(const rcs_bitmap_word *bm, size_t index) {
     size_t word_index = index / RCS_BITMAP_WORD_BIT_WIDTH;
     size_t bit_index = index % RCS_BITMAP_WORD_BIT_WIDTH;
-    return bm[word_index] & (1 << bit_index);
+    return bm[word_index] & ((rcs_bitmap_word)1 << bit_index);
 }
 
 static inline void rcs_bitmap_set(rcs_bitmap_word *bm, size_t index) {
     size_t word_index = index / RCS_BITMAP_WORD_BIT_WIDTH;
     size_t bit_index = index % RCS_BITMAP_WORD_BIT_WIDTH;
-    bm[word_index] |= (1 << bit_index);
+    bm[word_index] |= ((rcs_bitmap_word)1 << bit_index);
 }
 
 static inline void rcs_bitmap_clear(rcs_bitmap_word *bm, size_t index) {
     size_t word_index = index / RCS_BITMAP_WORD_BIT_WIDTH;
     size_t bit_index = index % RCS_BITMAP_WORD_BIT_WIDTH;
-    bm[word_index] &= ~(1 << bit_index);
+    bm[word_index] &= ~((rcs_bitmap_word)1 << bit_index);
+}
+
+// Index of the lowest set bit, `w` must not be 0.
+static inline size_t rcs_bitmap_word_ctz(rcs_bitmap_word w) {
+    return __builtin_ctzll(w);
 }
 
 static inline void rcs_bitmap_clear_all(rcs_bitmap_word *bm, size_t bm_len) {
     memset(bm, 0, bm_len * sizeof *bm);
 }
 
+static inline bool rcs_bitmap_is_zero(const rcs_bitmap_word *bm, size_t bm_len) {
+    for (size_t i = 0; i < bm_len; ++i) {
+        if (bm[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+static inline bool
+rcs_bitmap_equal(const rcs_bitmap_word *a, const rcs_bitmap_word *b, size_t bm_len) {
+    return memcmp(a, b, bm_len * sizeof *a) == 0;
+}
+
+// FNV-1a over bitmap words.
+static inline uint64_t rcs_bitmap_hash(const rcs_bitmap_word *bm, size_t bm_len) {
+    uint64_t h = 0xcbf29ce484222325;
+    for (size_t i = 0; i < bm_len; ++i) {
+        h ^= bm[i];
+        h *= 0x100000001b3;
+    }
+    return h;
+}
+
 #endif
@@ -0,0 +1,327 @@
+#include "bitparallel.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t state_bit(const struct rcs_nfa *nfa, const struct rcs_nfa_state *state) {
+    return (uint64_t)1 << (state - nfa->states);
+}
+
+static uint64_t next_states(const struct rcs_nfa *nfa, const struct rcs_nfa_state *state) {
+    uint64_t next = 0;
+    for (size_t j = 0; j < state->next_len; ++j)
+        next |= state_bit(nfa, state->next[j]);
+    return next;
+}
+
+static rcs_error alloc_values(struct rcs_bitparallel_scanner *s) {
+    if (s->counting_len == 0)
+        return RCS_OK;
+    for (size_t i = 0; i < 2; ++i) {
+        s->values[i] = calloc(s->counters->config_len, sizeof(*s->values[i]));
+        if (s->values[i] == NULL)
+            return RCS_MAKE_ERR_LIBC(errno);
+    }
+    return RCS_OK;
+}
+
+RCS_NODISCARD
+bool rcs_bitparallel_scanner_init(
+    rcs_error *err,
+    struct rcs_bitparallel_scanner *s,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters
+) {
+    if (nfa->states_len > RCS_BITPARALLEL_MAX_STATES)
+        return false;
+
+    *s = (struct rcs_bitparallel_scanner){0};
+    *err = RCS_OK;
+
+    s->classes = classes;
+    s->counters = counters;
+
+    s->initial_states = 0;
+    for (size_t i = 0; i < nfa->sources_len; ++i)
+        s->initial_states |= state_bit(nfa, nfa->sources[i]);
+    s->accept_state = state_bit(nfa, nfa->accept);
+    s->states_bm_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+
+    s->class_masks = calloc(classes->len, sizeof(*s->class_masks));
+    if (s->class_masks == NULL)
+        goto malloc_err;
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        for (size_t class_i = 0; class_i < classes->len; ++class_i) {
+            if (rcs_byte_classes_state_matches(classes, i, class_i))
+                s->class_masks[class_i] |= (uint64_t)1 << i;
+        }
+    }
+
+    s->follow_tables_len = RCS_DIV_CEILING(nfa->states_len, 8);
+    s->follow_tables = calloc(s->follow_tables_len * 256, sizeof(*s->follow_tables));
+    if (s->follow_tables == NULL)
+        goto malloc_err;
+    for (size_t k = 0; k < s->follow_tables_len; ++k) {
+        uint64_t *table = s->follow_tables + k * 256;
+        for (size_t b = 0; b < 256; ++b) {
+            for (size_t i = 0; i < 8 && 8 * k + i < nfa->states_len; ++i) {
+                if ((b & (1 << i)) && rcs_counters_get(counters, 8 * k + i) == NULL)
+                    table[b] |= next_states(nfa, &nfa->states[8 * k + i]);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < nfa->states_len; ++i)
+        s->counting_len += rcs_counters_get(counters, i) != NULL;
+    if (s->counting_len > 0) {
+        s->counting = malloc(s->counting_len * sizeof(*s->counting));
+        s->counting_next = malloc(s->counting_len * sizeof(*s->counting_next));
+        if (s->counting == NULL || s->counting_next == NULL)
+            goto malloc_err;
+        size_t k = 0;
+        for (size_t i = 0; i < nfa->states_len; ++i) {
+            if (rcs_counters_get(counters, i) == NULL)
+                continue;
+            s->counting[k] = i;
+            s->counting_next[k++] = next_states(nfa, &nfa->states[i]);
+        }
+    }
+
+    *err = alloc_values(s);
+    if (rcs_failed(*err))
+        rcs_bitparallel_scanner_free(s);
+    return true;
+
+malloc_err:
+    rcs_bitparallel_scanner_free(s);
+    *err = RCS_MAKE_ERR_LIBC(errno);
+    return true;
+}
+
+static inline uint64_t follow(const struct rcs_bitparallel_scanner *sc, uint64_t states) {
+    uint64_t next = 0;
+    for (size_t k = 0; k < sc->follow_tables_len; ++k)
+        next |= sc->follow_tables[k * 256 + ((states >> (8 * k)) & 0xff)];
+    return next;
+}
+
+// Returns the states after `buf`, 0 if the NFA reached the sink.
+static uint64_t
+run(const struct rcs_bitparallel_scanner *sc, uint64_t states, const uint8_t *buf, size_t len) {
+    const uint8_t *class_map = sc->classes->map;
+    for (size_t i = 0; i < len && states != 0; ++i)
+        states = follow(sc, states & sc->class_masks[class_map[buf[i]]]);
+    return states;
+}
+
+// Same as `run()` for an NFA with counting states, their values are in `values[0]`.
+static uint64_t
+run_counters(struct rcs_bitparallel_scanner *sc, uint64_t states, const uint8_t *buf, size_t len) {
+    const uint8_t *class_map = sc->classes->map;
+    for (size_t i = 0; i < len && states != 0; ++i) {
+        uint64_t matched = states & sc->class_masks[class_map[buf[i]]];
+        uint64_t next = follow(sc, matched);
+        uint64_t counting = 0;
+
+        for (size_t k = 0; k < sc->counting_len; ++k) {
+            uint64_t bit = (uint64_t)1 << sc->counting[k];
+            const struct rcs_counter *counter = &sc->counters->states[sc->counting[k]];
+            rcs_bitmap_clear_all(sc->values[1] + counter->offset, counter->len);
+            if (!(matched & bit))
+                continue;
+
+            bool exits;
+            if (rcs_counter_step(counter, sc->values[0], sc->values[1], &exits))
+                counting |= bit;
+            if (exits)
+                next |= sc->counting_next[k];
+        }
+        // counting states reached by the transitions start new counts
+        for (size_t k = 0; k < sc->counting_len; ++k) {
+            if (next & ((uint64_t)1 << sc->counting[k]))
+                sc->values[1][sc->counters->states[sc->counting[k]].offset] |= 1;
+        }
+
+        rcs_bitmap_word *tmp = sc->values[0];
+        sc->values[0] = sc->values[1];
+        sc->values[1] = tmp;
+        states = next | counting;
+    }
+    return states;
+}
+
+// Resets the counter values to the ones of the initial states and returns these states.
+static uint64_t begin(struct rcs_bitparallel_scanner *sc) {
+    for (size_t k = 0; k < sc->counting_len; ++k) {
+        const struct rcs_counter *counter = &sc->counters->states[sc->counting[k]];
+        rcs_bitmap_clear_all(sc->values[0] + counter->offset, counter->len);
+        if (sc->initial_states & ((uint64_t)1 << sc->counting[k]))
+            sc->values[0][counter->offset] = 1;
+    }
+    return sc->initial_states;
+}
+
+static uint64_t
+advance(struct rcs_bitparallel_scanner *sc, uint64_t states, const uint8_t *buf, size_t len) {
+    if (sc->counting_len > 0)
+        return run_counters(sc, states, buf, len);
+    return run(sc, states, buf, len);
+}
+
+RCS_NODISCARD
+rcs_error rcs_bitparallel_match(
+    rcs_api_bool *out_ok,
+    struct rcs_bitparallel_scanner *sc,
+    const struct rcs_reader *reader
+) {
+    uint64_t states = begin(sc);
+
+    rcs_api_size n;
+    while ((n = reader->read(reader->arg)) > 0) {
+        states = advance(sc, states, reader->buf, n);
+        if (states == 0) {
+            // sink
+            *out_ok = false;
+            return RCS_OK;
+        }
+    }
+
+    *out_ok = (states & sc->accept_state) != 0;
+    return RCS_OK;
+}
+
+void rcs_bitparallel_match_batch(
+    rcs_api_bool *out_ok,
+    struct rcs_bitparallel_scanner *sc,
+    const struct rcs_input *inputs,
+    size_t inputs_len
+) {
+    const uint8_t *class_map = sc->classes->map;
+
+    // the counter values of each lane would need their own scratch, so the inputs are run in turn
+    if (sc->counting_len > 0) {
+        for (size_t i = 0; i < inputs_len; ++i) {
+            uint64_t states = run_counters(sc, begin(sc), inputs[i].ptr, inputs[i].len);
+            out_ok[i] = (states & sc->accept_state) != 0;
+        }
+        return;
+    }
+
+    // Lane `l` runs `inputs[input_i[l]]`, `pos[l]` points to its next byte.
+    uint64_t states[RCS_BITPARALLEL_BATCH_LANES];
+    const uint8_t *pos[RCS_BITPARALLEL_BATCH_LANES];
+    size_t left[RCS_BITPARALLEL_BATCH_LANES];
+    size_t input_i[RCS_BITPARALLEL_BATCH_LANES];
+    size_t next_input = 0;
+
+    for (size_t l = 0; l < RCS_BITPARALLEL_BATCH_LANES; ++l) {
+        input_i[l] = SIZE_MAX;
+        left[l] = 0;
+        states[l] = 0;
+    }
+
+    for (;;) {
+        // Retire finished lanes and load the next inputs to them.
+        bool all_busy = true;
+        for (size_t l = 0; l < RCS_BITPARALLEL_BATCH_LANES; ++l) {
+            while (left[l] == 0 || states[l] == 0) {
+                if (input_i[l] != SIZE_MAX)
+                    out_ok[input_i[l]] = (states[l] & sc->accept_state) != 0;
+                if (next_input == inputs_len) {
+                    input_i[l] = SIZE_MAX;
+                    all_busy = false;
+                    break;
+                }
+                input_i[l] = next_input++;
+                pos[l] = inputs[input_i[l]].ptr;
+                left[l] = inputs[input_i[l]].len;
+                states[l] = sc->initial_states;
+            }
+        }
+        if (!all_busy)
+            break;
+
+        size_t steps = left[0];
+        for (size_t l = 1; l < RCS_BITPARALLEL_BATCH_LANES; ++l) {
+            if (left[l] < steps)
+                steps = left[l];
+        }
+
+        // Lanes don't depend on each other, so their dependency chains overlap in the CPU.
+        // A lane that reached the sink stays in it until the next retirement.
+        for (size_t i = 0; i < steps; ++i) {
+            for (size_t l = 0; l < RCS_BITPARALLEL_BATCH_LANES; ++l)
+                states[l] = follow(sc, states[l] & sc->class_masks[class_map[pos[l][i]]]);
+        }
+        for (size_t l = 0; l < RCS_BITPARALLEL_BATCH_LANES; ++l) {
+            pos[l] += steps;
+            left[l] -= steps;
+        }
+    }
+
+    // Too few inputs left to fill all lanes.
+    for (size_t l = 0; l < RCS_BITPARALLEL_BATCH_LANES; ++l) {
+        if (input_i[l] == SIZE_MAX)
+            continue;
+        uint64_t final_states = run(sc, states[l], pos[l], left[l]);
+        out_ok[input_i[l]] = (final_states & sc->accept_state) != 0;
+    }
+}
+
+bool rcs_bitparallel_feed(
+    struct rcs_bitparallel_scanner *sc,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    size_t len
+) {
+    uint64_t states = 0;
+    for (size_t w = 0; w < sc->states_bm_len; ++w)
+        states |= (uint64_t)states_bm[w] << (w * RCS_BITMAP_WORD_BIT_WIDTH);
+    size_t config_size = sc->counters->config_len * sizeof(*states_bm);
+    if (sc->counting_len > 0)
+        memcpy(sc->values[0], states_bm, config_size);
+
+    states = advance(sc, states, buf, len);
+    bool accepted = (states & sc->accept_state) != 0;
+    states &= ~sc->accept_state;
+
+    if (sc->counting_len > 0)
+        memcpy(states_bm, sc->values[0], config_size);
+    for (size_t w = 0; w < sc->states_bm_len; ++w)
+        states_bm[w] = (rcs_bitmap_word)(states >> (w * RCS_BITMAP_WORD_BIT_WIDTH));
+    return accepted;
+}
+
+rcs_error rcs_bitparallel_scanner_clone(
+    struct rcs_bitparallel_scanner *scanner,
+    const struct rcs_bitparallel_scanner *original
+) {
+    *scanner = *original;
+    scanner->shared_tables = true;
+    scanner->values[0] = scanner->values[1] = NULL;
+
+    rcs_error err = alloc_values(scanner);
+    if (rcs_failed(err))
+        rcs_bitparallel_scanner_free(scanner);
+    return err;
+}
+
+void rcs_bitparallel_scanner_free(struct rcs_bitparallel_scanner *scanner) {
+    if (!scanner->shared_tables) {
+        free(scanner->class_masks);
+        free(scanner->follow_tables);
+        free(scanner->counting);
+        free(scanner->counting_next);
+    }
+    free(scanner->values[0]);
+    free(scanner->values[1]);
+    scanner->class_masks = NULL;
+    scanner->follow_tables = NULL;
+    scanner->counting = NULL;
+    scanner->counting_next = NULL;
+    scanner->values[0] = scanner->values[1] = NULL;
+}
@@ -0,0 +1,101 @@
+#ifndef REGEX_CS_RUNTIME_BITPARALLEL
+#define REGEX_CS_RUNTIME_BITPARALLEL
+
+#include "api.h"
+#include "bitmap.h"
+#include "classes.h"
+#include "common.h"
+#include "counters.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Max number of NFA states (including the accepting one) supported by the backend, a counting state
+// is one of them whatever its values are.
+#define RCS_BITPARALLEL_MAX_STATES 64
+
+// Number of inputs advanced in lockstep by `rcs_bitparallel_match_batch()`.
+#define RCS_BITPARALLEL_BATCH_LANES 4
+
+// Branch-free NFA simulation for small automata, the whole states set is a single word.
+// One step is
+//     next = follow(active & class_masks[class(c)])
+// where `follow()` is computed by lookups of each byte of its argument in `follow_tables`.
+// Counting states are left out of the tables, their values are stepped apart, see `rcs_counters`.
+struct rcs_bitparallel_scanner {
+    const struct rcs_byte_classes *classes;
+    const struct rcs_counters *counters;
+
+    uint64_t initial_states;
+    uint64_t accept_state;
+    // Length of the NFA states bitmap of a stream context, `RCS_BITMAP_LEN_WORDS(states_len)`.
+    size_t states_bm_len;
+
+    // States that match the byte class, indexed by class.
+    uint64_t *class_masks;
+
+    // `follow_tables[k * 256 + b]` is the union of next states of the states `8k + i`, where
+    // `i`-th bit of `b` is set.
+    uint64_t *follow_tables;
+    size_t follow_tables_len;
+
+    // Indexes of the counting states and their next states, which they go to once a count
+    // reaches the min.
+    size_t *counting;
+    uint64_t *counting_next;
+    size_t counting_len;
+
+    // The tables above belong to another scanner.
+    bool shared_tables;
+    // Configurations of the current and the next step, only their counter values are used.
+    // NULL if there are no counting states.
+    rcs_bitmap_word *values[2];
+};
+
+// Returns false if the given NFA doesn't fit the requirements.
+// True if the scanner was initialized or an error occurred (`err` is set).
+RCS_NODISCARD
+bool rcs_bitparallel_scanner_init(
+    rcs_error *err,
+    struct rcs_bitparallel_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters
+);
+
+// Initializes `scanner` with the tables of `original`, only the counter values are allocated.
+// The clone must be freed before `original`.
+RCS_NODISCARD
+rcs_error rcs_bitparallel_scanner_clone(
+    struct rcs_bitparallel_scanner *scanner,
+    const struct rcs_bitparallel_scanner *original
+);
+
+RCS_NODISCARD
+rcs_error rcs_bitparallel_match(
+    rcs_api_bool *out_ok,
+    struct rcs_bitparallel_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+// Matches each input separately, interleaving the steps of several inputs.
+void rcs_bitparallel_match_batch(
+    rcs_api_bool *out_ok,
+    struct rcs_bitparallel_scanner *scanner,
+    const struct rcs_input *inputs,
+    size_t inputs_len
+);
+
+// Advances the stream context configuration `states_bm` (accepting state excluded) by `buf`.
+// Returns true if the accepting state was reached by the last byte.
+bool rcs_bitparallel_feed(
+    struct rcs_bitparallel_scanner *scanner,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    size_t len
+);
+
+// Does not free the scanner struct itself, only its inner buffers.
+void rcs_bitparallel_scanner_free(struct rcs_bitparallel_scanner *scanner);
+
+#endif
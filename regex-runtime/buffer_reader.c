@@ -0,0 +1,35 @@
+#include "buffer_reader.h"
+#include <stdint.h>
+
+static rcs_api_size buffer_read(void *arg) {
+    struct rcs_buffer_reader *r = arg;
+
+    size_t n = r->len - r->pos;
+    if (n > UINT32_MAX)
+        n = UINT32_MAX;
+
+    // Readers never write to the buffer.
+    r->reader.buf = (uint8_t *)r->data + r->pos;
+    r->pos += n;
+    return n;
+}
+
+static rcs_api_bool buffer_unwind(void *arg, uint64_t n) {
+    struct rcs_buffer_reader *r = arg;
+    if (n > r->pos)
+        return false;
+    r->pos -= n;
+    return true;
+}
+
+void rcs_buffer_reader_init(struct rcs_buffer_reader *r, const uint8_t *data, size_t len) {
+    r->reader = (struct rcs_reader){
+        .read = buffer_read,
+        .unwind = buffer_unwind,
+        .buf = (uint8_t *)data,
+        .arg = r,
+    };
+    r->data = data;
+    r->len = len;
+    r->pos = 0;
+}
@@ -0,0 +1,20 @@
+#ifndef REGEX_CS_RUNTIME_BUFFER_READER
+#define REGEX_CS_RUNTIME_BUFFER_READER
+
+#include "api.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Reader over a contiguous in-memory buffer, returns the whole rest of the buffer on each read.
+// `reader` is ready to use right after init, the buffer is not copied.
+struct rcs_buffer_reader {
+    struct rcs_reader reader;
+
+    const uint8_t *data;
+    size_t len;
+    size_t pos;
+};
+
+void rcs_buffer_reader_init(struct rcs_buffer_reader *r, const uint8_t *data, size_t len);
+
+#endif
@@ -0,0 +1,55 @@
+#include "byteset.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+// Compares 16 bytes at once with each listed byte.
+static size_t find_listed_sse2(const struct rcs_byteset *set, const uint8_t *buf, size_t len) {
+    __m128i needles[RCS_BYTESET_MAX_LISTED];
+    for (size_t i = 0; i < set->len; ++i)
+        needles[i] = _mm_set1_epi8((char)set->bytes[i]);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i eq = _mm_cmpeq_epi8(chunk, needles[0]);
+        for (size_t j = 1; j < set->len; ++j)
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(chunk, needles[j]));
+
+        unsigned mask = _mm_movemask_epi8(eq);
+        if (mask != 0)
+            return i + __builtin_ctz(mask);
+    }
+
+    for (; i < len; ++i) {
+        if (rcs_byteset_has(set, buf[i]))
+            return i;
+    }
+    return len;
+}
+#endif
+
+size_t rcs_byteset_find(const struct rcs_byteset *set, const uint8_t *buf, size_t len) {
+    if (set->len == 0)
+        return len;
+
+    if (set->len == 1) {
+        // libc memchr is already vectorized
+        const uint8_t *found = memchr(buf, set->bytes[0], len);
+        return found == NULL ? len : (size_t)(found - buf);
+    }
+
+#ifdef __SSE2__
+    if (set->len <= RCS_BYTESET_MAX_LISTED)
+        return find_listed_sse2(set, buf, len);
+#endif
+
+    for (size_t i = 0; i < len; ++i) {
+        if (rcs_byteset_has(set, buf[i]))
+            return i;
+    }
+    return len;
+}
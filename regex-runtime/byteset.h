@@ -0,0 +1,38 @@
+#ifndef REGEX_CS_RUNTIME_BYTESET
+#define REGEX_CS_RUNTIME_BYTESET
+
+#include "bitmap.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes are also listed in `bytes` while the set is small, so it can be scanned with SIMD.
+#define RCS_BYTESET_MAX_LISTED 3
+
+struct rcs_byteset {
+    rcs_bitmap_word bm[RCS_BITMAP_LEN_WORDS(256)];
+    size_t len;
+    uint8_t bytes[RCS_BYTESET_MAX_LISTED];
+};
+
+static inline void rcs_byteset_init(struct rcs_byteset *set) {
+    *set = (struct rcs_byteset){0};
+}
+
+static inline bool rcs_byteset_has(const struct rcs_byteset *set, uint8_t c) {
+    return rcs_bitmap_get(set->bm, c);
+}
+
+static inline void rcs_byteset_add(struct rcs_byteset *set, uint8_t c) {
+    if (rcs_byteset_has(set, c))
+        return;
+    rcs_bitmap_set(set->bm, c);
+    if (set->len < RCS_BYTESET_MAX_LISTED)
+        set->bytes[set->len] = c;
+    ++set->len;
+}
+
+// Returns index of the first byte in `buf` that is in the set, or `len` if there's none.
+size_t rcs_byteset_find(const struct rcs_byteset *set, const uint8_t *buf, size_t len);
+
+#endif
@@ -0,0 +1,189 @@
+#include "captures.h"
+#include "common.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+void rcs_captures_scanner_init(
+    struct rcs_captures_scanner *s,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
+    *s = (struct rcs_captures_scanner){0};
+    s->nfa = nfa;
+    s->classes = classes;
+    s->slots_len = 2 * (size_t)nfa->captures_len;
+    s->states_bm_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+}
+
+static rcs_error alloc_buffers(struct rcs_captures_scanner *s) {
+    size_t states_len = s->nfa->states_len;
+    for (size_t i = 0; i < 2; ++i) {
+        s->states_bm[i] = calloc(s->states_bm_len, sizeof(*s->states_bm[i]));
+        s->states_list[i] = malloc(states_len * sizeof(*s->states_list[i]));
+        // at least one slot, so a successful malloc is never NULL
+        s->slots[i] = malloc((states_len * s->slots_len + 1) * sizeof(*s->slots[i]));
+        if (s->states_bm[i] == NULL || s->states_list[i] == NULL || s->slots[i] == NULL)
+            goto malloc_err;
+    }
+    s->accept_slots = malloc((s->slots_len + 1) * sizeof(*s->accept_slots));
+    if (s->accept_slots == NULL)
+        goto malloc_err;
+    return RCS_OK;
+
+malloc_err:
+    rcs_captures_scanner_free(s);
+    return RCS_MAKE_ERR_LIBC(errno);
+}
+
+// Clears the sparse set `list_i` in O(its length).
+static void clear_states(struct rcs_captures_scanner *sc, size_t list_i) {
+    for (size_t i = 0; i < sc->states_list_len[list_i]; ++i)
+        rcs_bitmap_clear(sc->states_bm[list_i], sc->states_list[list_i][i]);
+    sc->states_list_len[list_i] = 0;
+}
+
+// Moves a thread with the slots `from` along a transition with tags `tags[start..end)` at the input
+// position `pos` to the state `state_i` of the sparse set `list_i`, unless a prior thread is there.
+// The first thread that reaches the accepting state in a step sets `accept_slots` and `accepted`.
+static void follow(
+    struct rcs_captures_scanner *sc,
+    size_t list_i,
+    size_t state_i,
+    const uint64_t *from,
+    size_t start,
+    size_t end,
+    uint64_t pos,
+    bool *accepted
+) {
+    uint64_t *to;
+    if (rcs_nfa_state_is_accept(&sc->nfa->states[state_i])) {
+        if (*accepted)
+            return;
+        *accepted = true;
+        to = sc->accept_slots;
+    } else {
+        if (rcs_bitmap_get(sc->states_bm[list_i], state_i))
+            return;
+        rcs_bitmap_set(sc->states_bm[list_i], state_i);
+        sc->states_list[list_i][sc->states_list_len[list_i]++] = state_i;
+        to = sc->slots[list_i] + state_i * sc->slots_len;
+    }
+
+    memcpy(to, from, sc->slots_len * sizeof(*to));
+    for (size_t t = start; t < end; ++t)
+        to[sc->nfa->tags[t]] = pos;
+}
+
+// Steps the threads of the set 0 by a char of class `class_i` into the set 1.
+// `pos` is the input position after the char.
+// Returns true if the accepting state was reached.
+static bool step(struct rcs_captures_scanner *sc, size_t class_i, uint64_t pos) {
+    const struct rcs_nfa *nfa = sc->nfa;
+    bool accepted = false;
+
+    for (size_t k = 0; k < sc->states_list_len[0]; ++k) {
+        size_t i = sc->states_list[0][k];
+        const struct rcs_nfa_state *state = &nfa->states[i];
+
+        assert(!rcs_nfa_state_is_epsilon(state) && "unexpected epsilon state");
+
+        if (!rcs_byte_classes_state_matches(sc->classes, i, class_i))
+            continue;
+
+        const uint64_t *from = sc->slots[0] + i * sc->slots_len;
+        for (size_t j = 0; j < state->next_len; ++j) {
+            size_t start = state->next_tags != NULL ? state->next_tags[j] : 0;
+            size_t end = state->next_tags != NULL ? state->next_tags[j + 1] : 0;
+            follow(sc, 1, state->next[j] - nfa->states, from, start, end, pos, &accepted);
+        }
+    }
+
+    return accepted;
+}
+
+// Makes the next set current and clears the next one.
+static void swap_states(struct rcs_captures_scanner *sc) {
+    clear_states(sc, 0);
+
+    rcs_bitmap_word *tmp_bm = sc->states_bm[0];
+    sc->states_bm[0] = sc->states_bm[1];
+    sc->states_bm[1] = tmp_bm;
+    size_t *tmp_list = sc->states_list[0];
+    sc->states_list[0] = sc->states_list[1];
+    sc->states_list[1] = tmp_list;
+    uint64_t *tmp_slots = sc->slots[0];
+    sc->slots[0] = sc->slots[1];
+    sc->slots[1] = tmp_slots;
+    sc->states_list_len[0] = sc->states_list_len[1];
+    sc->states_list_len[1] = 0;
+}
+
+rcs_error rcs_captures_scanner_match(
+    rcs_api_bool *out_ok,
+    uint64_t *out_slots,
+    struct rcs_captures_scanner *sc,
+    const struct rcs_reader *reader
+) {
+    const struct rcs_nfa *nfa = sc->nfa;
+    if (sc->accept_slots == NULL) {
+        rcs_error err = alloc_buffers(sc);
+        if (rcs_failed(err))
+            return err;
+    }
+
+    clear_states(sc, 0);
+    clear_states(sc, 1);
+
+    // the slots of the source threads, no group is entered yet
+    uint64_t *unset = sc->slots[1];
+    for (size_t i = 0; i < sc->slots_len; ++i)
+        unset[i] = RCS_NO_CAPTURE;
+
+    // unset slots live in the set 1, that isn't used until the first step
+    bool accepted = false;
+    for (size_t i = 0; i < nfa->sources_len; ++i) {
+        size_t start = nfa->source_tags != NULL ? nfa->source_tags[i] : 0;
+        size_t end = nfa->source_tags != NULL ? nfa->source_tags[i + 1] : 0;
+        follow(sc, 0, nfa->sources[i] - nfa->states, unset, start, end, 0, &accepted);
+    }
+
+    uint64_t pos = 0;
+    rcs_api_size n;
+    while ((n = reader->read(reader->arg)) > 0) {
+        for (rcs_api_size i = 0; i < n; ++i) {
+            if (sc->states_list_len[0] == 0) {
+                // no EOF, but nfa is in sink
+                *out_ok = false;
+                return RCS_OK;
+            }
+
+            accepted = step(sc, sc->classes->map[reader->buf[i]], ++pos);
+            swap_states(sc);
+        }
+    }
+
+    *out_ok = accepted;
+    if (accepted) {
+        out_slots[0] = 0;
+        out_slots[1] = pos;
+        memcpy(out_slots + 2, sc->accept_slots, sc->slots_len * sizeof(*out_slots));
+    }
+    return RCS_OK;
+}
+
+void rcs_captures_scanner_free(struct rcs_captures_scanner *scanner) {
+    for (size_t i = 0; i < 2; ++i) {
+        free(scanner->states_bm[i]);
+        free(scanner->states_list[i]);
+        free(scanner->slots[i]);
+        scanner->states_bm[i] = NULL;
+        scanner->states_list[i] = NULL;
+        scanner->slots[i] = NULL;
+    }
+    free(scanner->accept_slots);
+    scanner->accept_slots = NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef REGEX_CS_RUNTIME_CAPTURES
+#define REGEX_CS_RUNTIME_CAPTURES
+
+#include "api.h"
+#include "bitmap.h"
+#include "classes.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Pike VM: NFA simulation where each thread carries the capture slots of its path.
+// Threads are listed in the priority order and a thread that reaches a state taken by a prior one
+// is dropped, so the surviving paths are the ones a backtracking engine would try first.
+// Used for all scanner backends, since the others don't track paths.
+struct rcs_captures_scanner {
+    const struct rcs_nfa *nfa;
+    const struct rcs_byte_classes *classes;
+    // `2 * nfa->captures_len`
+    size_t slots_len;
+
+    // 0 is the current, 1 is the next
+    // swap on each wave
+    rcs_bitmap_word *states_bm[2];
+    size_t states_bm_len;
+    // Indexes of the active non-accepting states in the priority order.
+    size_t *states_list[2];
+    size_t states_list_len[2];
+    // Capture slots of the thread in each state, `slots_len` per state.
+    // Valid only if the state is set in `states_bm`.
+    uint64_t *slots[2];
+
+    // Slots of the first thread that reached the accepting state by the last step.
+    uint64_t *accept_slots;
+};
+
+// Buffers are allocated by the first match, so scanners that never capture don't pay for them.
+void rcs_captures_scanner_init(
+    struct rcs_captures_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+);
+
+// See `rcs_match_captures()`.
+RCS_NODISCARD
+rcs_error rcs_captures_scanner_match(
+    rcs_api_bool *out_ok,
+    uint64_t *out_slots,
+    struct rcs_captures_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+// Does not free the scanner struct itself, only its inner buffers.
+void rcs_captures_scanner_free(struct rcs_captures_scanner *scanner);
+
+#endif
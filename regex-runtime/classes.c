@@ -0,0 +1,64 @@
+#include "classes.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+rcs_error rcs_byte_classes_init(struct rcs_byte_classes *classes, const struct rcs_nfa *nfa) {
+    *classes = (struct rcs_byte_classes){0};
+
+    // Signature of a byte is the set of states that match it.
+    // Bytes with equal signatures belong to the same class.
+    size_t sig_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+    rcs_bitmap_word *sigs = calloc(256 * sig_len, sizeof(*sigs));
+    if (sigs == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_nfa_state *state = &nfa->states[i];
+        for (size_t c = 0; c < 256; ++c) {
+            if (rcs_nfa_state_matches_char(state, c))
+                rcs_bitmap_set(sigs + c * sig_len, i);
+        }
+    }
+
+    // first byte of each class
+    uint8_t representatives[256];
+    classes->len = 0;
+    for (size_t c = 0; c < 256; ++c) {
+        const rcs_bitmap_word *sig = sigs + c * sig_len;
+
+        size_t class_i = 0;
+        while (class_i < classes->len &&
+               !rcs_bitmap_equal(sigs + representatives[class_i] * sig_len, sig, sig_len))
+            ++class_i;
+
+        if (class_i == classes->len)
+            representatives[classes->len++] = c;
+        classes->map[c] = class_i;
+    }
+
+    classes->state_conds_len = RCS_BITMAP_LEN_WORDS(classes->len);
+    classes->state_conds =
+        calloc(nfa->states_len * classes->state_conds_len, sizeof(*classes->state_conds));
+    if (classes->state_conds == NULL) {
+        free(sigs);
+        return RCS_MAKE_ERR_LIBC(errno);
+    }
+
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        rcs_bitmap_word *cond = classes->state_conds + i * classes->state_conds_len;
+        for (size_t class_i = 0; class_i < classes->len; ++class_i) {
+            if (rcs_bitmap_get(sigs + representatives[class_i] * sig_len, i))
+                rcs_bitmap_set(cond, class_i);
+        }
+    }
+
+    free(sigs);
+    return RCS_OK;
+}
+
+void rcs_byte_classes_free(struct rcs_byte_classes *classes) {
+    free(classes->state_conds);
+    classes->state_conds = NULL;
+}
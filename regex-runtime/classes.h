@@ -0,0 +1,41 @@
+#ifndef REGEX_CS_RUNTIME_CLASSES
+#define REGEX_CS_RUNTIME_CLASSES
+
+#include "api.h"
+#include "bitmap.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Partition of 256 byte values into classes, that every NFA state treats the same way.
+struct rcs_byte_classes {
+    // Class index of each byte.
+    uint8_t map[256];
+    size_t len;
+
+    // Bitmap of classes matched by each NFA state, `state_conds_len` words per state.
+    rcs_bitmap_word *state_conds;
+    size_t state_conds_len;
+};
+
+RCS_NODISCARD
+rcs_error rcs_byte_classes_init(struct rcs_byte_classes *classes, const struct rcs_nfa *nfa);
+
+static inline const rcs_bitmap_word *
+rcs_byte_classes_state_cond(const struct rcs_byte_classes *classes, size_t state_i) {
+    return classes->state_conds + state_i * classes->state_conds_len;
+}
+
+static inline bool rcs_byte_classes_state_matches(
+    const struct rcs_byte_classes *classes,
+    size_t state_i,
+    size_t class_i
+) {
+    return rcs_bitmap_get(rcs_byte_classes_state_cond(classes, state_i), class_i);
+}
+
+// Does not free the struct itself, only its inner buffers.
+void rcs_byte_classes_free(struct rcs_byte_classes *classes);
+
+#endif
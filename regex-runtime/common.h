@@ -3,6 +3,8 @@
 
 #include "api.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 #define RCS_ARRAY_LEN(arr) (sizeof(arr) / sizeof(*arr))
 
@@ -27,6 +29,19 @@ static inline bool rcs_nfa_state_is_accept(const struct rcs_nfa_state *state) {
     return state->next_len == 0;
 }
 
+static inline bool rcs_nfa_state_is_counting(const struct rcs_nfa_state *state) {
+    return state->counter_max != 0;
+}
+
+static inline bool rcs_nfa_state_matches_char(const struct rcs_nfa_state *state, uint8_t c) {
+    for (size_t i = 0; i < state->ranges_len; ++i) {
+        const struct rcs_nfa_char_range range = state->ranges[i];
+        if (range.start <= c && c <= range.end)
+            return !state->inverted_match;
+    }
+    return state->inverted_match;
+}
+
 #if defined(__clang__) || defined(__GNUC__)
 #define RCS_NODISCARD __attribute__((__warn_unused_result__))
 #define RCS_NORETURN __attribute__((noreturn))
@@ -0,0 +1,246 @@
+#include "counters.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+rcs_error rcs_counters_init(struct rcs_counters *counters, const struct rcs_nfa *nfa) {
+    *counters = (struct rcs_counters){0};
+    counters->config_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+
+    bool has_counters = false;
+    for (size_t i = 0; i < nfa->states_len && !has_counters; ++i)
+        has_counters = rcs_nfa_state_is_counting(&nfa->states[i]);
+    if (!has_counters)
+        return RCS_OK;
+
+    counters->states = calloc(nfa->states_len, sizeof(*counters->states));
+    if (counters->states == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_nfa_state *state = &nfa->states[i];
+        if (!rcs_nfa_state_is_counting(state))
+            continue;
+
+        assert(!rcs_nfa_state_is_epsilon(state) && "unexpected epsilon counting state");
+        assert(state->counter_min >= 1 && state->counter_min <= state->counter_max);
+
+        struct rcs_counter *counter = &counters->states[i];
+        counter->unbounded = state->counter_max == RCS_COUNTER_UNBOUNDED;
+        counter->min = state->counter_min;
+        counter->width = counter->unbounded ? state->counter_min : state->counter_max;
+        counter->len = RCS_BITMAP_LEN_WORDS(counter->width);
+        counter->offset = counters->config_len;
+        counters->config_len += counter->len;
+    }
+    return RCS_OK;
+}
+
+bool rcs_counter_step(
+    const struct rcs_counter *counter,
+    const rcs_bitmap_word *cur,
+    rcs_bitmap_word *next,
+    bool *out_exits
+) {
+    const rcs_bitmap_word *src = cur + counter->offset;
+    rcs_bitmap_word *dst = next + counter->offset;
+
+    // values that have consumed `min - 1` chars reach the min with this one
+    size_t exit_w = (counter->min - 1) / RCS_BITMAP_WORD_BIT_WIDTH;
+    size_t exit_bit = (counter->min - 1) % RCS_BITMAP_WORD_BIT_WIDTH;
+    bool exits = (src[exit_w] & (~(rcs_bitmap_word)0 << exit_bit)) != 0;
+    for (size_t w = exit_w + 1; w < counter->len && !exits; ++w)
+        exits = src[w] != 0;
+    *out_exits = exits;
+
+    size_t top_bits = counter->width % RCS_BITMAP_WORD_BIT_WIDTH;
+    rcs_bitmap_word top_mask =
+        top_bits == 0 ? ~(rcs_bitmap_word)0 : ((rcs_bitmap_word)1 << top_bits) - 1;
+
+    bool stays = false;
+    rcs_bitmap_word carry = 0;
+    for (size_t w = 0; w < counter->len; ++w) {
+        rcs_bitmap_word shifted = (src[w] << 1) | carry;
+        carry = src[w] >> (RCS_BITMAP_WORD_BIT_WIDTH - 1);
+        if (w + 1 == counter->len)
+            shifted &= top_mask;
+        dst[w] |= shifted;
+        stays |= shifted != 0;
+    }
+
+    // the last value of an unbounded counter only stays
+    if (counter->unbounded && rcs_bitmap_get(src, counter->width - 1)) {
+        rcs_bitmap_set(dst, counter->width - 1);
+        stays = true;
+    }
+    return stays;
+}
+
+void rcs_counters_free(struct rcs_counters *counters) {
+    free(counters->states);
+    counters->states = NULL;
+}
+
+// Unrolled state being built, it copies the condition of `src`.
+struct unrolled_state {
+    const struct rcs_nfa_state *src;
+    // Next state of the chain or NULL.
+    struct rcs_nfa_state *chain;
+    // Goes to the next states of `src`.
+    bool exits;
+};
+
+// Sets the transitions of `dst` from `transitions[*used]`, and their tag offsets from
+// `next_tags[*tags_used]`: to the chain first, so the captures prefer the longer repetitions, then
+// to the next states of the source state.
+static void set_transitions(
+    struct rcs_unrolled_nfa *u,
+    const struct rcs_nfa *nfa,
+    size_t *used,
+    size_t *tags_used,
+    size_t dst_i,
+    const struct unrolled_state *us
+) {
+    const struct rcs_nfa_state *src = us->src;
+    struct rcs_nfa_state *dst = &u->nfa.states[dst_i];
+
+    dst->next = u->transitions + *used;
+    dst->next_len = 0;
+    if (us->chain != NULL)
+        dst->next[dst->next_len++] = us->chain;
+    if (us->exits) {
+        for (size_t j = 0; j < src->next_len; ++j)
+            dst->next[dst->next_len++] = &u->nfa.states[src->next[j] - nfa->states];
+    }
+
+    if (u->next_tags != NULL) {
+        // not at the transitions plus the state index like in the images, the chain states are
+        // numbered after all the others but set along with their counting states
+        dst->next_tags = u->next_tags + *tags_used;
+        size_t k = 0;
+        if (us->chain != NULL)
+            dst->next_tags[k++] = src->next_tags[0];
+        if (us->exits) {
+            for (size_t j = 0; j <= src->next_len; ++j)
+                dst->next_tags[k++] = src->next_tags[j];
+        } else {
+            dst->next_tags[k++] = src->next_tags[0];
+        }
+        *tags_used += k;
+    }
+
+    dst->ranges = src->ranges;
+    dst->ranges_len = src->ranges_len;
+    dst->inverted_match = src->inverted_match;
+    *used += dst->next_len;
+}
+
+rcs_error rcs_unrolled_nfa_init(
+    struct rcs_unrolled_nfa *u,
+    const struct rcs_nfa *nfa,
+    const struct rcs_counters *counters,
+    const struct rcs_byte_classes *classes
+) {
+    *u = (struct rcs_unrolled_nfa){0};
+
+    size_t states_len = nfa->states_len;
+    size_t transitions_len = 0;
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_counter *counter = rcs_counters_get(counters, i);
+        size_t next_len = nfa->states[i].next_len;
+        if (counter == NULL) {
+            transitions_len += next_len;
+            continue;
+        }
+
+        // each value but the last one goes on, all from `min - 1` exit
+        transitions_len += (counter->width - 1) + (counter->width - counter->min + 1) * next_len;
+        if (counter->unbounded)
+            ++transitions_len;
+        states_len += counter->width - 1;
+    }
+
+    bool has_tags = nfa->source_tags != NULL;
+    struct rcs_nfa_state *states = calloc(states_len, sizeof(*states));
+    u->nfa.states = states;
+    u->transitions = malloc((transitions_len + nfa->sources_len) * sizeof(*u->transitions));
+    if (has_tags)
+        u->next_tags = malloc((transitions_len + states_len) * sizeof(*u->next_tags));
+    u->classes = *classes;
+    u->classes.state_conds =
+        malloc(states_len * classes->state_conds_len * sizeof(*classes->state_conds));
+    if (states == NULL || u->transitions == NULL || (has_tags && u->next_tags == NULL) ||
+        u->classes.state_conds == NULL)
+        goto malloc_err;
+
+    size_t used = 0;
+    size_t tags_used = 0;
+    size_t added_i = nfa->states_len;
+    size_t conds_len = classes->state_conds_len;
+    size_t cond_size = conds_len * sizeof(*classes->state_conds);
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_nfa_state *src = &nfa->states[i];
+        const struct rcs_counter *counter = rcs_counters_get(counters, i);
+        const rcs_bitmap_word *cond = rcs_byte_classes_state_cond(classes, i);
+        memcpy(u->classes.state_conds + i * conds_len, cond, cond_size);
+
+        if (counter == NULL) {
+            struct unrolled_state us = {.src = src, .chain = NULL, .exits = true};
+            set_transitions(u, nfa, &used, &tags_used, i, &us);
+            continue;
+        }
+
+        // value `v` of the counter is the state `v` of the chain
+        for (size_t v = 0; v < counter->width; ++v) {
+            size_t state_i = v == 0 ? i : added_i + v - 1;
+            size_t next_v = v + 1 < counter->width ? v + 1 : v;
+            struct unrolled_state us = {
+                .src = src,
+                .chain = NULL,
+                .exits = v + 1 >= counter->min,
+            };
+            if (v + 1 < counter->width || counter->unbounded)
+                us.chain = &states[next_v == 0 ? i : added_i + next_v - 1];
+            set_transitions(u, nfa, &used, &tags_used, state_i, &us);
+            if (v > 0)
+                memcpy(u->classes.state_conds + state_i * conds_len, cond, cond_size);
+        }
+        added_i += counter->width - 1;
+    }
+
+    struct rcs_nfa_state **sources = u->transitions + used;
+    for (size_t i = 0; i < nfa->sources_len; ++i)
+        sources[i] = &states[nfa->sources[i] - nfa->states];
+
+    u->nfa = (struct rcs_nfa){
+        .states = states,
+        .states_len = states_len,
+        .sources = sources,
+        .sources_len = nfa->sources_len,
+        .accept = &states[nfa->accept - nfa->states],
+        .required_literal = nfa->required_literal,
+        .required_literal_len = nfa->required_literal_len,
+        .captures_len = nfa->captures_len,
+        .tags = nfa->tags,
+        .source_tags = nfa->source_tags,
+    };
+    return RCS_OK;
+
+malloc_err:
+    rcs_unrolled_nfa_free(u);
+    return RCS_MAKE_ERR_LIBC(errno);
+}
+
+void rcs_unrolled_nfa_free(struct rcs_unrolled_nfa *u) {
+    free(u->nfa.states);
+    free(u->transitions);
+    free(u->next_tags);
+    free(u->classes.state_conds);
+    u->nfa.states = NULL;
+    u->transitions = NULL;
+    u->next_tags = NULL;
+    u->classes.state_conds = NULL;
+}
@@ -0,0 +1,113 @@
+#ifndef REGEX_CS_RUNTIME_COUNTERS
+#define REGEX_CS_RUNTIME_COUNTERS
+
+#include "api.h"
+#include "bitmap.h"
+#include "classes.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Values of a counting state are a bitmap: bit `v` is set if some count has consumed `v` chars.
+// A char of the state's class shifts the bitmap by one, others clear it. So a counter costs a few
+// word operations per step, while the same repetition of plain states costs a state per value.
+struct rcs_counter {
+    // Word offset of the values in a configuration, see `rcs_counters`.
+    size_t offset;
+    // Bits of the values: `counter_max`, or `counter_min` for unbounded counters, where the last
+    // value stands for all the greater ones.
+    size_t width;
+    // Words of the values.
+    size_t len;
+    size_t min;
+    bool unbounded;
+};
+
+// Layout of a configuration: the NFA states bitmap followed by the values of each counting state.
+// The bit of a counting state in the states bitmap is set iff some of its values are.
+// Configurations are the states of the NFA simulations that support counters (standard, lazy DFA,
+// bit-parallel) and of the stream contexts.
+struct rcs_counters {
+    // Counter of each state, `width` is 0 for plain states.
+    // NULL if the NFA has no counting states.
+    struct rcs_counter *states;
+    // Words of a configuration.
+    size_t config_len;
+};
+
+RCS_NODISCARD
+rcs_error rcs_counters_init(struct rcs_counters *counters, const struct rcs_nfa *nfa);
+
+// Returns the counter of the state, NULL if it's a plain one.
+// `counters` may be NULL if the NFA has no counting states.
+static inline const struct rcs_counter *
+rcs_counters_get(const struct rcs_counters *counters, size_t state_i) {
+    if (counters == NULL || counters->states == NULL || counters->states[state_i].width == 0)
+        return NULL;
+    return &counters->states[state_i];
+}
+
+// Activates the state in `config`, a counting state starts a new count.
+static inline void rcs_counters_enter(
+    const struct rcs_counters *counters,
+    rcs_bitmap_word *config,
+    size_t state_i
+) {
+    rcs_bitmap_set(config, state_i);
+    const struct rcs_counter *counter = rcs_counters_get(counters, state_i);
+    if (counter != NULL)
+        config[counter->offset] |= 1;
+}
+
+// Deactivates the state in `config` and clears its values.
+static inline void rcs_counters_leave(
+    const struct rcs_counters *counters,
+    rcs_bitmap_word *config,
+    size_t state_i
+) {
+    rcs_bitmap_clear(config, state_i);
+    const struct rcs_counter *counter = rcs_counters_get(counters, state_i);
+    if (counter != NULL)
+        rcs_bitmap_clear_all(config + counter->offset, counter->len);
+}
+
+// Advances the values of `cur` by a char of the counter's class and adds them to `next`.
+// `out_exits` is set if some count has reached the min, so the state goes to its next states.
+// Returns true if some count goes on.
+bool rcs_counter_step(
+    const struct rcs_counter *counter,
+    const rcs_bitmap_word *cur,
+    rcs_bitmap_word *next,
+    bool *out_exits
+);
+
+// Does not free the struct itself, only its inner buffers.
+void rcs_counters_free(struct rcs_counters *counters);
+
+// The NFA with each counting state unrolled into a chain of plain states, one per value, for the
+// simulations that don't support counters. Counting states keep their indexes as the first states
+// of the chains, the rest of the chains follow the original states, so the sources and the
+// accepting state are the same. Captures of the chains are the ones of a greedy repetition.
+struct rcs_unrolled_nfa {
+    struct rcs_nfa nfa;
+    // The classes of the original NFA with the conditions of the added states.
+    struct rcs_byte_classes classes;
+
+    // Next lists and tags of all the states in single allocations.
+    struct rcs_nfa_state **transitions;
+    rcs_api_size *next_tags;
+};
+
+RCS_NODISCARD
+rcs_error rcs_unrolled_nfa_init(
+    struct rcs_unrolled_nfa *unrolled,
+    const struct rcs_nfa *nfa,
+    const struct rcs_counters *counters,
+    const struct rcs_byte_classes *classes
+);
+
+// Does not free the struct itself, only its inner buffers.
+void rcs_unrolled_nfa_free(struct rcs_unrolled_nfa *unrolled);
+
+#endif
@@ -0,0 +1,284 @@
+#include "early.h"
+#include "common.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+void rcs_early_scanner_init(
+    struct rcs_early_scanner *s,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
+    *s = (struct rcs_early_scanner){0};
+    s->nfa = nfa;
+    s->classes = classes;
+    s->states_bm_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+}
+
+static bool matches_any_byte(const struct rcs_early_scanner *sc, size_t state_i) {
+    for (size_t c = 0; c < sc->classes->len; ++c) {
+        if (!rcs_byte_classes_state_matches(sc->classes, state_i, c))
+            return false;
+    }
+    return true;
+}
+
+// Finds the greatest set of states that match any byte and have the accepting state and a state
+// of the set among the next ones. Once such a state is active, each byte activates another one
+// along with the accepting state, so the match can't be lost.
+static void find_universal(struct rcs_early_scanner *sc) {
+    const struct rcs_nfa *nfa = sc->nfa;
+
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_nfa_state *state = &nfa->states[i];
+        if (rcs_nfa_state_is_accept(state) || !matches_any_byte(sc, i))
+            continue;
+        for (size_t j = 0; j < state->next_len; ++j) {
+            if (rcs_nfa_state_is_accept(state->next[j]))
+                rcs_bitmap_set(sc->universal_bm, i);
+        }
+    }
+
+    // drop the candidates that can leave the set until none does
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t i = 0; i < nfa->states_len; ++i) {
+            if (!rcs_bitmap_get(sc->universal_bm, i))
+                continue;
+
+            const struct rcs_nfa_state *state = &nfa->states[i];
+            bool stays = false;
+            for (size_t j = 0; j < state->next_len && !stays; ++j)
+                stays = rcs_bitmap_get(sc->universal_bm, state->next[j] - nfa->states);
+            if (!stays) {
+                rcs_bitmap_clear(sc->universal_bm, i);
+                changed = true;
+            }
+        }
+    }
+}
+
+static rcs_error alloc_buffers(struct rcs_early_scanner *s) {
+    size_t states_len = s->nfa->states_len;
+    for (size_t i = 0; i < 2; ++i) {
+        s->states_bm[i] = calloc(s->states_bm_len, sizeof(*s->states_bm[i]));
+        s->states_list[i] = malloc(states_len * sizeof(*s->states_list[i]));
+        if (s->states_bm[i] == NULL || s->states_list[i] == NULL)
+            goto malloc_err;
+    }
+    // at least one word, so a successful calloc is never NULL
+    s->universal_bm = calloc(s->states_bm_len + 1, sizeof(*s->universal_bm));
+    if (s->universal_bm == NULL)
+        goto malloc_err;
+
+    find_universal(s);
+    return RCS_OK;
+
+malloc_err:
+    rcs_early_scanner_free(s);
+    return RCS_MAKE_ERR_LIBC(errno);
+}
+
+// Adds the state to the sparse set `list_i`, unless it's already there.
+// Accepting state is not listed, returns true if it was reached instead.
+static bool activate_state(struct rcs_early_scanner *sc, size_t list_i, size_t state_i) {
+    if (rcs_nfa_state_is_accept(&sc->nfa->states[state_i]))
+        return true;
+    if (rcs_bitmap_get(sc->states_bm[list_i], state_i))
+        return false;
+
+    rcs_bitmap_set(sc->states_bm[list_i], state_i);
+    sc->states_list[list_i][sc->states_list_len[list_i]++] = state_i;
+    if (rcs_bitmap_get(sc->universal_bm, state_i))
+        sc->has_universal[list_i] = true;
+    return false;
+}
+
+// Clears the sparse set `list_i` in O(its length).
+static void clear_states(struct rcs_early_scanner *sc, size_t list_i) {
+    for (size_t i = 0; i < sc->states_list_len[list_i]; ++i)
+        rcs_bitmap_clear(sc->states_bm[list_i], sc->states_list[list_i][i]);
+    sc->states_list_len[list_i] = 0;
+    sc->has_universal[list_i] = false;
+}
+
+// Steps the states of the set 0 by a char of class `class_i` into the set 1.
+// Returns true if the accepting state was reached.
+static bool step(struct rcs_early_scanner *sc, size_t class_i) {
+    bool accepted = false;
+
+    for (size_t k = 0; k < sc->states_list_len[0]; ++k) {
+        size_t i = sc->states_list[0][k];
+        const struct rcs_nfa_state *state = &sc->nfa->states[i];
+
+        assert(!rcs_nfa_state_is_epsilon(state) && "unexpected epsilon state");
+
+        if (!rcs_byte_classes_state_matches(sc->classes, i, class_i))
+            continue;
+
+        for (size_t j = 0; j < state->next_len; ++j) {
+            if (activate_state(sc, 1, state->next[j] - sc->nfa->states))
+                accepted = true;
+        }
+    }
+
+    return accepted;
+}
+
+// Makes the next set current and clears the next one.
+static void swap_states(struct rcs_early_scanner *sc) {
+    clear_states(sc, 0);
+
+    rcs_bitmap_word *tmp_bm = sc->states_bm[0];
+    sc->states_bm[0] = sc->states_bm[1];
+    sc->states_bm[1] = tmp_bm;
+    size_t *tmp_list = sc->states_list[0];
+    sc->states_list[0] = sc->states_list[1];
+    sc->states_list[1] = tmp_list;
+    sc->states_list_len[0] = sc->states_list_len[1];
+    sc->states_list_len[1] = 0;
+    sc->has_universal[0] = sc->has_universal[1];
+    sc->has_universal[1] = false;
+}
+
+// Progress of a match, the same for the input read forward and backwards.
+struct early_progress {
+    // Bytes consumed.
+    uint64_t pos;
+    // The accepting state was reached by the last byte.
+    bool accepted;
+    // Some prefix matched, `match_end` is the end of the longest one.
+    bool matched;
+    uint64_t match_end;
+};
+
+// Activates the sources, source could also be accepting.
+static void begin(struct rcs_early_scanner *sc, struct early_progress *p) {
+    clear_states(sc, 0);
+    clear_states(sc, 1);
+    *p = (struct early_progress){0};
+    for (size_t i = 0; i < sc->nfa->sources_len; ++i) {
+        if (activate_state(sc, 0, sc->nfa->sources[i] - sc->nfa->states))
+            p->accepted = true;
+    }
+    p->matched = p->accepted;
+}
+
+static bool is_decided(
+    const struct rcs_early_scanner *sc,
+    const struct early_progress *p,
+    rcs_match_mode mode
+) {
+    switch (mode) {
+    case RCS_MATCH_PREFIX:
+        return p->accepted;
+    case RCS_MATCH_UNTIL_DECIDED:
+        return p->accepted && sc->has_universal[0];
+    case RCS_MATCH_LONGEST_PREFIX:
+        return sc->states_list_len[0] == 0;
+    default:
+        assert(0 && "invalid match mode");
+        return false;
+    }
+}
+
+// Steps by the byte, returns true if the result is decided.
+static bool
+feed(struct rcs_early_scanner *sc, struct early_progress *p, uint8_t byte, rcs_match_mode mode) {
+    if (sc->states_list_len[0] == 0) {
+        // no EOF, but nfa is in sink
+        p->accepted = false;
+        return true;
+    }
+
+    p->accepted = step(sc, sc->classes->map[byte]);
+    swap_states(sc);
+    ++p->pos;
+    if (p->accepted) {
+        p->matched = true;
+        p->match_end = p->pos;
+    }
+    return is_decided(sc, p, mode);
+}
+
+static void finish(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    const struct early_progress *p,
+    rcs_match_mode mode
+) {
+    if (mode == RCS_MATCH_LONGEST_PREFIX) {
+        *out_ok = p->matched;
+        *out_offset = p->matched ? p->match_end : p->pos;
+    } else {
+        *out_ok = p->accepted;
+        *out_offset = p->pos;
+    }
+}
+
+rcs_error rcs_early_scanner_match(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_early_scanner *sc,
+    const struct rcs_reader *reader,
+    rcs_match_mode mode
+) {
+    if (sc->universal_bm == NULL) {
+        rcs_error err = alloc_buffers(sc);
+        if (rcs_failed(err))
+            return err;
+    }
+
+    struct early_progress p;
+    begin(sc, &p);
+    rcs_api_size n;
+    while (!is_decided(sc, &p, mode) && (n = reader->read(reader->arg)) > 0) {
+        for (rcs_api_size i = 0; i < n; ++i) {
+            if (feed(sc, &p, reader->buf[i], mode))
+                goto done;
+        }
+    }
+
+done:
+    finish(out_ok, out_offset, &p, mode);
+    return RCS_OK;
+}
+
+rcs_error rcs_early_scanner_match_reversed(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_early_scanner *sc,
+    const uint8_t *buf,
+    uint64_t len,
+    rcs_match_mode mode
+) {
+    if (sc->universal_bm == NULL) {
+        rcs_error err = alloc_buffers(sc);
+        if (rcs_failed(err))
+            return err;
+    }
+
+    struct early_progress p;
+    begin(sc, &p);
+    bool decided = is_decided(sc, &p, mode);
+    while (!decided && p.pos < len)
+        decided = feed(sc, &p, buf[len - 1 - p.pos], mode);
+
+    finish(out_ok, out_offset, &p, mode);
+    return RCS_OK;
+}
+
+void rcs_early_scanner_free(struct rcs_early_scanner *scanner) {
+    for (size_t i = 0; i < 2; ++i) {
+        free(scanner->states_bm[i]);
+        free(scanner->states_list[i]);
+        scanner->states_bm[i] = NULL;
+        scanner->states_list[i] = NULL;
+    }
+    free(scanner->universal_bm);
+    scanner->universal_bm = NULL;
+}
@@ -0,0 +1,65 @@
+#ifndef REGEX_CS_RUNTIME_EARLY
+#define REGEX_CS_RUNTIME_EARLY
+
+#include "api.h"
+#include "bitmap.h"
+#include "classes.h"
+#include "common.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// NFA simulation that checks the states after each byte and stops once the result is known.
+// Used for all scanner backends, since the others report the result only at the end of a buffer.
+struct rcs_early_scanner {
+    const struct rcs_nfa *nfa;
+    const struct rcs_byte_classes *classes;
+
+    // States that match any byte and always keep the accepting state and some universal state
+    // active, like the one of a trailing `.*`.
+    rcs_bitmap_word *universal_bm;
+
+    // 0 is the current, 1 is the next
+    // swap on each wave
+    rcs_bitmap_word *states_bm[2];
+    size_t states_bm_len;
+    // Indexes of the active non-accepting states, same as in `states_bm`.
+    size_t *states_list[2];
+    size_t states_list_len[2];
+    // Some state of the list is universal.
+    bool has_universal[2];
+};
+
+// Buffers are allocated and the universal states are found by the first match, so scanners that
+// never stop early don't pay for them.
+void rcs_early_scanner_init(
+    struct rcs_early_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+);
+
+// See `rcs_match_early()`.
+RCS_NODISCARD
+rcs_error rcs_early_scanner_match(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_early_scanner *scanner,
+    const struct rcs_reader *reader,
+    rcs_match_mode mode
+);
+
+// Same as `rcs_early_scanner_match()` for the bytes of `buf` from the last to the first.
+RCS_NODISCARD
+rcs_error rcs_early_scanner_match_reversed(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_early_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    rcs_match_mode mode
+);
+
+// Does not free the scanner struct itself, only its inner buffers.
+void rcs_early_scanner_free(struct rcs_early_scanner *scanner);
+
+#endif
@@ -0,0 +1,268 @@
+#include "api.h"
+#include "common.h"
+#include "literal.h"
+#include "mmap.h"
+#include "scanner.h"
+#include "vec.h"
+#include "workers.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Smaller inputs are not worth a thread.
+#define MIN_CHUNK_LEN (1 << 20)
+
+// Lines passed to `rcs_match_batch()` at once.
+#define BATCH_LEN 256
+
+// Line-aligned part of the input grepped by one thread.
+struct chunk {
+    // Clone owned by the chunk, except the first one that uses the caller's scanner.
+    struct rcs_scanner *scanner;
+    const uint8_t *buf;
+    size_t len;
+    // Offset of `buf` in the whole input.
+    uint64_t base;
+
+    bool count_only;
+    uint64_t count;
+    struct rcs_vec line_starts;
+
+    rcs_error err;
+    pthread_t thread;
+    bool thread_started;
+};
+
+static rcs_error add_line(struct chunk *c, size_t start) {
+    ++c->count;
+    if (c->count_only)
+        return RCS_OK;
+    uint64_t offset = c->base + start;
+    return rcs_vec_push(&c->line_starts, &offset);
+}
+
+static size_t line_end(const uint8_t *buf, size_t len, size_t start) {
+    const uint8_t *nl = memchr(buf + start, '\n', len - start);
+    return nl == NULL ? len : (size_t)(nl - buf);
+}
+
+// Runs `rcs_match_batch()` on the lines `[start, start + len)` collected in `inputs`.
+static rcs_error
+flush_batch(struct chunk *c, const struct rcs_input *inputs, const size_t *starts, size_t len) {
+    rcs_api_bool ok[BATCH_LEN];
+    rcs_error err = rcs_match_batch(ok, c->scanner, inputs, len);
+    for (size_t i = 0; i < len && !rcs_failed(err); ++i) {
+        if (ok[i])
+            err = add_line(c, starts[i]);
+    }
+    return err;
+}
+
+// Matches every line.
+static rcs_error grep_all_lines(struct chunk *c) {
+    struct rcs_input inputs[BATCH_LEN];
+    size_t starts[BATCH_LEN];
+    size_t batch_len = 0;
+    rcs_error err = RCS_OK;
+
+    for (size_t start = 0; start < c->len && !rcs_failed(err);) {
+        size_t end = line_end(c->buf, c->len, start);
+
+        if (end - start > UINT32_MAX) {
+            rcs_api_bool ok;
+            err = rcs_match_buffer(&ok, c->scanner, c->buf + start, end - start);
+            if (!rcs_failed(err) && ok)
+                err = add_line(c, start);
+        } else {
+            inputs[batch_len] = (struct rcs_input){.ptr = c->buf + start, .len = end - start};
+            starts[batch_len] = start;
+            if (++batch_len == BATCH_LEN) {
+                err = flush_batch(c, inputs, starts, batch_len);
+                batch_len = 0;
+            }
+        }
+
+        start = end + 1;
+    }
+
+    if (!rcs_failed(err) && batch_len > 0)
+        err = flush_batch(c, inputs, starts, batch_len);
+    return err;
+}
+
+// Matches only the lines containing the required literal, the rest is skipped by the literal
+// search.
+static rcs_error grep_literal_lines(struct chunk *c) {
+    const struct rcs_literal_filter *filter = &c->scanner->literal_filter;
+
+    size_t start = 0;
+    while (start < c->len) {
+        size_t hit =
+            start + rcs_literal_find(filter->literal, filter->len, c->buf + start, c->len - start);
+        if (hit == c->len)
+            break;
+
+        // `start` is always a line start, so the line of the hit doesn't begin before it
+        size_t hit_line = hit;
+        while (hit_line > start && c->buf[hit_line - 1] != '\n')
+            --hit_line;
+        size_t end = line_end(c->buf, c->len, hit);
+
+        rcs_api_bool ok;
+        rcs_error err = rcs_match_buffer(&ok, c->scanner, c->buf + hit_line, end - hit_line);
+        if (!rcs_failed(err) && ok)
+            err = add_line(c, hit_line);
+        if (rcs_failed(err))
+            return err;
+
+        start = end + 1;
+    }
+    return RCS_OK;
+}
+
+static void *grep_chunk(void *arg) {
+    struct chunk *c = arg;
+    const struct rcs_literal_filter *filter = &c->scanner->literal_filter;
+
+    // A literal with a line break may be split between lines.
+    if (filter->len > 0 && memchr(filter->literal, '\n', filter->len) == NULL)
+        c->err = grep_literal_lines(c);
+    else
+        c->err = grep_all_lines(c);
+    return NULL;
+}
+
+static void chunks_free(struct chunk *chunks, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (chunks[i].thread_started)
+            pthread_join(chunks[i].thread, NULL);
+    }
+    for (size_t i = 0; i < len; ++i) {
+        if (i > 0 && chunks[i].scanner != NULL)
+            rcs_scanner_free(chunks[i].scanner);
+        rcs_vec_free_data(&chunks[i].line_starts);
+    }
+    free(chunks);
+}
+
+rcs_error rcs_grep(
+    struct rcs_grep_result *out,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    const struct rcs_grep_options *options
+) {
+    rcs_error err = RCS_OK;
+    *out = (struct rcs_grep_result){0};
+
+    size_t chunks_len = rcs_workers_number(options->threads, len, MIN_CHUNK_LEN);
+    struct chunk *chunks = calloc(chunks_len, sizeof(*chunks));
+    if (chunks == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    size_t start = 0;
+    for (size_t i = 0; i < chunks_len; ++i) {
+        struct chunk *c = &chunks[i];
+
+        size_t end = len;
+        if (i + 1 < chunks_len) {
+            end = len / chunks_len * (i + 1);
+            end = line_end(buf, len, end < start ? start : end);
+            end = end < len ? end + 1 : len;
+        }
+
+        c->buf = buf + start;
+        c->len = end - start;
+        c->base = start;
+        c->count_only = options->count_only;
+        c->line_starts = rcs_zero_vec;
+        start = end;
+
+        if (!c->count_only) {
+            err = rcs_vec_init(&c->line_starts, sizeof(uint64_t), 16);
+            if (rcs_failed(err))
+                goto free_chunks;
+        }
+
+        if (i == 0) {
+            c->scanner = scanner;
+            continue;
+        }
+
+        const struct rcs_scanner *worker_scanner;
+        err = rcs_scanner_clone(&worker_scanner, scanner);
+        if (rcs_failed(err))
+            goto free_chunks;
+        c->scanner = (struct rcs_scanner *)worker_scanner;
+    }
+
+    // If a thread can't be created, its chunk is grepped by the caller's thread.
+    for (size_t i = 1; i < chunks_len; ++i) {
+        int rc = pthread_create(&chunks[i].thread, NULL, grep_chunk, &chunks[i]);
+        chunks[i].thread_started = rc == 0;
+    }
+    grep_chunk(&chunks[0]);
+    for (size_t i = 1; i < chunks_len; ++i) {
+        if (chunks[i].thread_started) {
+            pthread_join(chunks[i].thread, NULL);
+            chunks[i].thread_started = false;
+        } else {
+            grep_chunk(&chunks[i]);
+        }
+    }
+
+    for (size_t i = 0; i < chunks_len; ++i) {
+        if (rcs_failed(chunks[i].err)) {
+            err = chunks[i].err;
+            goto free_chunks;
+        }
+        out->count += chunks[i].count;
+    }
+
+    if (!options->count_only && out->count > 0) {
+        out->line_starts = malloc(out->count * sizeof(uint64_t));
+        if (out->line_starts == NULL) {
+            err = RCS_MAKE_ERR_LIBC(errno);
+            goto free_chunks;
+        }
+
+        uint64_t *dst = out->line_starts;
+        for (size_t i = 0; i < chunks_len; ++i) {
+            memcpy(dst, chunks[i].line_starts.data, chunks[i].count * sizeof(uint64_t));
+            dst += chunks[i].count;
+        }
+    }
+
+free_chunks:
+    chunks_free(chunks, chunks_len);
+    if (rcs_failed(err))
+        *out = (struct rcs_grep_result){0};
+    return err;
+}
+
+rcs_error rcs_grep_file(
+    struct rcs_grep_result *out,
+    struct rcs_scanner *scanner,
+    const char *path,
+    const struct rcs_grep_options *options
+) {
+    const void *addr;
+    size_t len;
+    rcs_error err = rcs_mmap_file(&addr, &len, path);
+    if (rcs_failed(err))
+        return err;
+
+    err = rcs_grep(out, scanner, addr, len, options);
+    if (addr != NULL)
+        rcs_mmap_free((void *)addr, len);
+    return err;
+}
+
+void rcs_grep_result_free(struct rcs_grep_result *result) {
+    free(result->line_starts);
+    result->line_starts = NULL;
+}
@@ -0,0 +1,568 @@
+#include "api.h"
+#include "bitmap.h"
+#include "classes.h"
+#include "common.h"
+#include "jit.h"
+#include "mmap.h"
+#include "scanner.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Image layout, all numbers are in the native byte order:
+//
+//     struct image_header
+//     sections located by the header, each aligned to `SECTION_ALIGNMENT` from the image start
+//
+// Bump `IMAGE_VERSION` on any change of the layout, of the byte classes or of the JIT code
+// conventions (registers, data offsets).
+#define IMAGE_MAGIC "RCSIMAGE"
+#define IMAGE_VERSION 3
+#define SECTION_ALIGNMENT 8
+
+#if defined(__x86_64__)
+#define IMAGE_ARCH 1
+#else
+#define IMAGE_ARCH 0
+#endif
+
+enum image_section_kind {
+    // `struct image_state[states_len]`
+    SECTION_STATES,
+    // `uint32_t` state indices, next lists of all states one after another
+    SECTION_NEXT,
+    // `struct rcs_nfa_char_range`, ranges of all states one after another
+    SECTION_RANGES,
+    // `uint32_t` state indices
+    SECTION_SOURCES,
+    // `uint8_t[required_literal_len]`
+    SECTION_LITERAL,
+    // `uint8_t[256]`, class index of each byte
+    SECTION_CLASS_MAP,
+    // `rcs_bitmap_word[states_len][RCS_BITMAP_LEN_WORDS(classes_len)]`
+    SECTION_STATE_CONDS,
+    // Mapping of the JIT scanner (code and data), empty for other backends.
+    SECTION_JIT_CODE,
+    // `uint32_t` capture slots, the `tags` of the NFA.
+    // This and the other tag sections are empty if the NFA has no captures.
+    SECTION_TAGS,
+    // `uint32_t` offsets in the tags, the `next_tags` of all states one after another.
+    // A state has `next_len + 1` of them, so they start at `next_start` plus the state index.
+    SECTION_NEXT_TAGS,
+    // `uint32_t[sources_len + 1]` offsets in the tags
+    SECTION_SOURCE_TAGS,
+    SECTIONS_LEN,
+};
+
+struct image_section {
+    uint64_t offset;
+    uint64_t len;
+};
+
+struct image_header {
+    char magic[8];
+    struct image_section sections[SECTIONS_LEN];
+    uint64_t jit_data_offset;
+
+    uint32_t version;
+    uint32_t arch;
+    uint32_t word_size; // `sizeof(rcs_bitmap_word)`
+    uint32_t backend;   // never `RCS_AUTO`
+    uint32_t dfa_cache_size;
+
+    uint32_t states_len;
+    uint32_t accept; // index of the accepting state
+    uint32_t classes_len;
+    uint32_t jit_use_avx2;
+    uint32_t captures_len;
+};
+
+struct image_state {
+    uint32_t next_start;
+    uint32_t next_len;
+    uint32_t ranges_start;
+    uint32_t ranges_len;
+    uint32_t inverted_match;
+    uint32_t counter_min;
+    uint32_t counter_max;
+};
+
+#define BAD_IMAGE RCS_MAKE_ERR(RCS_ERR_BAD_IMAGE)
+
+static uint32_t state_index(const struct rcs_nfa *nfa, const struct rcs_nfa_state *state) {
+    return state - nfa->states;
+}
+
+// Number of the capture slots referenced by the tags of the NFA.
+static size_t tags_len(const struct rcs_nfa *nfa) {
+    size_t len = nfa->source_tags != NULL ? nfa->source_tags[nfa->sources_len] : 0;
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_nfa_state *state = &nfa->states[i];
+        if (state->next_tags != NULL && state->next_tags[state->next_len] > len)
+            len = state->next_tags[state->next_len];
+    }
+    return len;
+}
+
+// Writes `len + 1` tag offsets, all 0 if `offsets` is NULL.
+static void write_tag_offsets(uint32_t *dst, const rcs_api_size *offsets, size_t len) {
+    for (size_t i = 0; i <= len; ++i)
+        dst[i] = offsets != NULL ? offsets[i] : 0;
+}
+
+rcs_error
+rcs_scanner_save(uint8_t **out_image, uint64_t *out_len, const struct rcs_scanner *scanner) {
+    const struct rcs_scanner *program = rcs_scanner_program(scanner);
+    const struct rcs_nfa *nfa = program->nfa;
+    const struct rcs_byte_classes *classes = &program->classes;
+
+    size_t next_len = 0, ranges_len = 0;
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        next_len += nfa->states[i].next_len;
+        ranges_len += nfa->states[i].ranges_len;
+    }
+
+    struct rcs_jit_code jit = {0};
+    if (program->backend_type == RCS_JIT)
+        rcs_jit_scanner_code(&jit, &program->backend.jit);
+
+    struct image_header header = {
+        .jit_data_offset = jit.data_offset,
+        .version = IMAGE_VERSION,
+        .arch = IMAGE_ARCH,
+        .word_size = sizeof(rcs_bitmap_word),
+        .backend = program->backend_type,
+        .dfa_cache_size = program->options.dfa_cache_size,
+        .states_len = nfa->states_len,
+        .accept = state_index(nfa, nfa->accept),
+        .classes_len = classes->len,
+        .jit_use_avx2 = jit.use_avx2,
+        .captures_len = nfa->captures_len,
+    };
+    memcpy(header.magic, IMAGE_MAGIC, sizeof header.magic);
+
+    bool has_tags = nfa->captures_len > 0;
+    const uint64_t sections_len[SECTIONS_LEN] = {
+        [SECTION_STATES] = nfa->states_len * sizeof(struct image_state),
+        [SECTION_NEXT] = next_len * sizeof(uint32_t),
+        [SECTION_RANGES] = ranges_len * sizeof(struct rcs_nfa_char_range),
+        [SECTION_SOURCES] = nfa->sources_len * sizeof(uint32_t),
+        [SECTION_LITERAL] = nfa->required_literal_len,
+        [SECTION_CLASS_MAP] = sizeof classes->map,
+        [SECTION_STATE_CONDS] =
+            nfa->states_len * classes->state_conds_len * sizeof(*classes->state_conds),
+        [SECTION_JIT_CODE] = jit.len,
+        [SECTION_TAGS] = has_tags ? tags_len(nfa) * sizeof(uint32_t) : 0,
+        [SECTION_NEXT_TAGS] = has_tags ? (next_len + nfa->states_len) * sizeof(uint32_t) : 0,
+        [SECTION_SOURCE_TAGS] = has_tags ? (nfa->sources_len + 1) * sizeof(uint32_t) : 0,
+    };
+    uint64_t len = sizeof header;
+    for (size_t i = 0; i < SECTIONS_LEN; ++i) {
+        len = RCS_DIV_CEILING(len, SECTION_ALIGNMENT) * SECTION_ALIGNMENT;
+        header.sections[i] = (struct image_section){.offset = len, .len = sections_len[i]};
+        len += sections_len[i];
+    }
+
+    // zeroed padding, so the same program always gives the same image
+    uint8_t *image = calloc(len, 1);
+    if (image == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+    memcpy(image, &header, sizeof header);
+
+    struct image_state *states = (void *)(image + header.sections[SECTION_STATES].offset);
+    uint32_t *next = (void *)(image + header.sections[SECTION_NEXT].offset);
+    uint8_t *ranges = image + header.sections[SECTION_RANGES].offset;
+    size_t next_i = 0, ranges_i = 0;
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_nfa_state *state = &nfa->states[i];
+        states[i] = (struct image_state){
+            .next_start = next_i,
+            .next_len = state->next_len,
+            .ranges_start = ranges_i,
+            .ranges_len = state->ranges_len,
+            .inverted_match = state->inverted_match,
+            .counter_min = state->counter_min,
+            .counter_max = state->counter_max,
+        };
+        for (size_t j = 0; j < state->next_len; ++j)
+            next[next_i++] = state_index(nfa, state->next[j]);
+        if (state->ranges_len > 0) {
+            size_t n = state->ranges_len * sizeof(struct rcs_nfa_char_range);
+            memcpy(ranges + ranges_i * sizeof(struct rcs_nfa_char_range), state->ranges, n);
+            ranges_i += state->ranges_len;
+        }
+    }
+
+    uint32_t *sources = (void *)(image + header.sections[SECTION_SOURCES].offset);
+    for (size_t i = 0; i < nfa->sources_len; ++i)
+        sources[i] = state_index(nfa, nfa->sources[i]);
+
+    if (has_tags) {
+        uint32_t *tags = (void *)(image + header.sections[SECTION_TAGS].offset);
+        for (size_t i = 0; i < tags_len(nfa); ++i)
+            tags[i] = nfa->tags[i];
+
+        uint32_t *next_tags = (void *)(image + header.sections[SECTION_NEXT_TAGS].offset);
+        for (size_t i = 0; i < nfa->states_len; ++i) {
+            const struct rcs_nfa_state *state = &nfa->states[i];
+            uint32_t *dst = next_tags + states[i].next_start + i;
+            write_tag_offsets(dst, state->next_tags, state->next_len);
+        }
+        uint32_t *source_tags = (void *)(image + header.sections[SECTION_SOURCE_TAGS].offset);
+        write_tag_offsets(source_tags, nfa->source_tags, nfa->sources_len);
+    }
+
+    const struct {
+        enum image_section_kind kind;
+        const void *data;
+    } copied[] = {
+        {SECTION_LITERAL, nfa->required_literal},
+        {SECTION_CLASS_MAP, classes->map},
+        {SECTION_STATE_CONDS, classes->state_conds},
+        {SECTION_JIT_CODE, jit.code},
+    };
+    for (size_t i = 0; i < RCS_ARRAY_LEN(copied); ++i) {
+        const struct image_section *section = &header.sections[copied[i].kind];
+        if (section->len > 0)
+            memcpy(image + section->offset, copied[i].data, section->len);
+    }
+
+    *out_image = image;
+    *out_len = len;
+    return RCS_OK;
+}
+
+void rcs_image_free(uint8_t *image) {
+    free(image);
+}
+
+// Returns the section data if it lies within the image and consists of whole `elem_size` elements,
+// NULL otherwise. The data may be unaligned.
+static const uint8_t *find_section(
+    size_t *out_count,
+    const uint8_t *image,
+    uint64_t len,
+    const struct image_header *header,
+    enum image_section_kind kind,
+    size_t elem_size
+) {
+    const struct image_section *section = &header->sections[kind];
+    if (section->offset > len || section->len > len - section->offset ||
+        section->len % elem_size != 0)
+        return NULL;
+    *out_count = section->len / elem_size;
+    return image + section->offset;
+}
+
+static uint32_t read_u32(const uint8_t *data, size_t i) {
+    uint32_t value;
+    memcpy(&value, data + i * sizeof(value), sizeof(value));
+    return value;
+}
+
+// Sections of the NFA in the image.
+struct image_nfa {
+    const uint8_t *states, *next, *ranges, *sources, *literal, *tags, *next_tags, *source_tags;
+    size_t states_len, next_len, ranges_len, sources_len, literal_len, tags_len, next_tags_len,
+        source_tags_len;
+};
+
+// Checks that `len + 1` tag offsets don't decrease and are within the tags.
+static bool tag_offsets_valid(const struct image_nfa *in, const uint8_t *offsets, size_t len) {
+    for (size_t i = 0; i <= len; ++i) {
+        uint32_t offset = read_u32(offsets, i);
+        if (offset > in->tags_len || (i > 0 && offset < read_u32(offsets, i - 1)))
+            return false;
+    }
+    return true;
+}
+
+// Checks the tags sections, they're either all empty or complete.
+static bool tags_valid(const struct image_nfa *in, const struct image_header *header) {
+    if (header->captures_len == 0)
+        return in->tags_len == 0 && in->next_tags_len == 0 && in->source_tags_len == 0;
+
+    if (in->next_tags_len != in->next_len + in->states_len ||
+        in->source_tags_len != in->sources_len + 1 ||
+        !tag_offsets_valid(in, in->source_tags, in->sources_len))
+        return false;
+    for (size_t i = 0; i < in->tags_len; ++i) {
+        if (read_u32(in->tags, i) >= 2 * (uint64_t)header->captures_len)
+            return false;
+    }
+    return true;
+}
+
+// Checks the state invariants of `struct rcs_nfa_state` and that all its references are in bounds.
+static bool state_valid(
+    const struct image_nfa *in,
+    const struct image_state *state,
+    size_t i,
+    bool is_accept
+) {
+    bool is_epsilon = state->ranges_len == 0 && !state->inverted_match;
+    if (is_accept != (state->next_len == 0) || is_accept != is_epsilon)
+        return false;
+    if (state->counter_max != 0 &&
+        (is_epsilon || state->counter_min == 0 || state->counter_min > state->counter_max))
+        return false;
+    if (state->next_len > in->next_len || state->next_start > in->next_len - state->next_len)
+        return false;
+    if (state->ranges_len > in->ranges_len ||
+        state->ranges_start > in->ranges_len - state->ranges_len)
+        return false;
+
+    for (size_t j = 0; j < state->next_len; ++j) {
+        if (read_u32(in->next, state->next_start + j) >= in->states_len)
+            return false;
+    }
+
+    // the offsets of the state start at `next_start + i`, it's in bounds if `next_start` is
+    return in->next_tags_len == 0 ||
+           tag_offsets_valid(
+               in,
+               in->next_tags + (state->next_start + i) * sizeof(uint32_t),
+               state->next_len
+           );
+}
+
+// Builds the NFA in a single allocation, so it's freed with `free()`.
+static rcs_error
+load_nfa(struct rcs_nfa **out_nfa, const struct image_nfa *in, const struct image_header *header) {
+    if (in->states_len == 0 || in->states_len != header->states_len ||
+        header->accept >= in->states_len || !tags_valid(in, header))
+        return BAD_IMAGE;
+
+    size_t tags_words = in->tags_len + in->next_tags_len + in->source_tags_len;
+    size_t len = sizeof(struct rcs_nfa) + in->states_len * sizeof(struct rcs_nfa_state) +
+                 (in->next_len + in->sources_len) * sizeof(struct rcs_nfa_state *) +
+                 tags_words * sizeof(rcs_api_size) +
+                 in->ranges_len * sizeof(struct rcs_nfa_char_range) + in->literal_len;
+    struct rcs_nfa *nfa = malloc(len);
+    if (nfa == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    uint8_t *p = (uint8_t *)(nfa + 1);
+    struct rcs_nfa_state *states = (void *)p;
+    p += in->states_len * sizeof(*states);
+    struct rcs_nfa_state **next = (void *)p;
+    p += in->next_len * sizeof(*next);
+    struct rcs_nfa_state **sources = (void *)p;
+    p += in->sources_len * sizeof(*sources);
+    rcs_api_size *tags = (void *)p;
+    p += in->tags_len * sizeof(*tags);
+    rcs_api_size *next_tags = (void *)p;
+    p += in->next_tags_len * sizeof(*next_tags);
+    rcs_api_size *source_tags = (void *)p;
+    p += in->source_tags_len * sizeof(*source_tags);
+    struct rcs_nfa_char_range *ranges = (void *)p;
+    p += in->ranges_len * sizeof(*ranges);
+    uint8_t *literal = p;
+
+    for (size_t i = 0; i < in->states_len; ++i) {
+        struct image_state state;
+        memcpy(&state, in->states + i * sizeof(state), sizeof(state));
+        if (!state_valid(in, &state, i, i == header->accept)) {
+            free(nfa);
+            return BAD_IMAGE;
+        }
+
+        for (size_t j = 0; j < state.next_len; ++j)
+            next[state.next_start + j] = &states[read_u32(in->next, state.next_start + j)];
+        states[i] = (struct rcs_nfa_state){
+            .next = &next[state.next_start],
+            .next_len = state.next_len,
+            .next_tags = in->next_tags_len > 0 ? &next_tags[state.next_start + i] : NULL,
+            .ranges = &ranges[state.ranges_start],
+            .ranges_len = state.ranges_len,
+            .inverted_match = state.inverted_match != 0,
+            .counter_min = state.counter_min,
+            .counter_max = state.counter_max,
+        };
+    }
+
+    for (size_t i = 0; i < in->sources_len; ++i) {
+        uint32_t src_i = read_u32(in->sources, i);
+        if (src_i >= in->states_len) {
+            free(nfa);
+            return BAD_IMAGE;
+        }
+        sources[i] = &states[src_i];
+    }
+
+    for (size_t i = 0; i < in->tags_len; ++i)
+        tags[i] = read_u32(in->tags, i);
+    for (size_t i = 0; i < in->next_tags_len; ++i)
+        next_tags[i] = read_u32(in->next_tags, i);
+    for (size_t i = 0; i < in->source_tags_len; ++i)
+        source_tags[i] = read_u32(in->source_tags, i);
+    memcpy(ranges, in->ranges, in->ranges_len * sizeof(*ranges));
+    memcpy(literal, in->literal, in->literal_len);
+
+    *nfa = (struct rcs_nfa){
+        .states = states,
+        .states_len = in->states_len,
+        .sources = sources,
+        .sources_len = in->sources_len,
+        .accept = &states[header->accept],
+        .required_literal = in->literal_len > 0 ? literal : NULL,
+        .required_literal_len = in->literal_len,
+        .captures_len = header->captures_len,
+        .tags = in->tags_len > 0 ? tags : NULL,
+        .source_tags = in->source_tags_len > 0 ? source_tags : NULL,
+    };
+    *out_nfa = nfa;
+    return RCS_OK;
+}
+
+static rcs_error load_classes(
+    struct rcs_byte_classes *out,
+    const uint8_t *image,
+    uint64_t len,
+    const struct image_header *header
+) {
+    size_t map_len, conds_len;
+    const uint8_t *map = find_section(&map_len, image, len, header, SECTION_CLASS_MAP, 1);
+    const uint8_t *conds = find_section(
+        &conds_len,
+        image,
+        len,
+        header,
+        SECTION_STATE_CONDS,
+        sizeof(rcs_bitmap_word)
+    );
+    if (map == NULL || conds == NULL || map_len != sizeof out->map)
+        return BAD_IMAGE;
+
+    size_t state_conds_len = RCS_BITMAP_LEN_WORDS(header->classes_len);
+    if (header->classes_len == 0 || header->classes_len > 256 ||
+        conds_len != header->states_len * state_conds_len)
+        return BAD_IMAGE;
+    for (size_t c = 0; c < map_len; ++c) {
+        if (map[c] >= header->classes_len)
+            return BAD_IMAGE;
+    }
+
+    *out = (struct rcs_byte_classes){
+        .len = header->classes_len,
+        .state_conds_len = state_conds_len,
+    };
+    memcpy(out->map, map, map_len);
+    out->state_conds = malloc(conds_len * sizeof(rcs_bitmap_word));
+    if (out->state_conds == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+    memcpy(out->state_conds, conds, conds_len * sizeof(rcs_bitmap_word));
+    return RCS_OK;
+}
+
+static bool header_valid(const struct image_header *header) {
+    return memcmp(header->magic, IMAGE_MAGIC, sizeof header->magic) == 0 &&
+           header->version == IMAGE_VERSION && header->arch == IMAGE_ARCH &&
+           header->word_size == sizeof(rcs_bitmap_word) && header->backend != RCS_AUTO &&
+           header->backend <= RCS_BIT_PARALLEL;
+}
+
+rcs_error
+rcs_scanner_load(const struct rcs_scanner **out_scanner, const uint8_t *image, uint64_t len) {
+    struct image_header header;
+    if (len < sizeof header)
+        return BAD_IMAGE;
+    memcpy(&header, image, sizeof header);
+    if (!header_valid(&header))
+        return BAD_IMAGE;
+
+    struct image_nfa in;
+    in.states = find_section(
+        &in.states_len,
+        image,
+        len,
+        &header,
+        SECTION_STATES,
+        sizeof(struct image_state)
+    );
+    in.next = find_section(&in.next_len, image, len, &header, SECTION_NEXT, sizeof(uint32_t));
+    in.ranges = find_section(
+        &in.ranges_len,
+        image,
+        len,
+        &header,
+        SECTION_RANGES,
+        sizeof(struct rcs_nfa_char_range)
+    );
+    in.sources =
+        find_section(&in.sources_len, image, len, &header, SECTION_SOURCES, sizeof(uint32_t));
+    in.literal = find_section(&in.literal_len, image, len, &header, SECTION_LITERAL, 1);
+    in.tags = find_section(&in.tags_len, image, len, &header, SECTION_TAGS, sizeof(uint32_t));
+    in.next_tags = find_section(
+        &in.next_tags_len,
+        image,
+        len,
+        &header,
+        SECTION_NEXT_TAGS,
+        sizeof(uint32_t)
+    );
+    in.source_tags = find_section(
+        &in.source_tags_len,
+        image,
+        len,
+        &header,
+        SECTION_SOURCE_TAGS,
+        sizeof(uint32_t)
+    );
+    if (in.states == NULL || in.next == NULL || in.ranges == NULL || in.sources == NULL ||
+        in.literal == NULL || in.tags == NULL || in.next_tags == NULL || in.source_tags == NULL)
+        return BAD_IMAGE;
+
+    struct rcs_jit_code jit = {
+        .data_offset = header.jit_data_offset,
+        .use_avx2 = header.jit_use_avx2 != 0,
+    };
+    jit.code = find_section(&jit.len, image, len, &header, SECTION_JIT_CODE, 1);
+    bool has_jit = header.backend == RCS_JIT;
+    if (jit.code == NULL || has_jit != (jit.len > 0) || (has_jit && jit.data_offset >= jit.len))
+        return BAD_IMAGE;
+
+    struct rcs_nfa *nfa;
+    rcs_error err = load_nfa(&nfa, &in, &header);
+    if (rcs_failed(err))
+        return err;
+
+    struct rcs_byte_classes classes;
+    err = load_classes(&classes, image, len, &header);
+    if (rcs_failed(err)) {
+        free(nfa);
+        return err;
+    }
+
+    struct rcs_scanner_options options = {
+        .backend = header.backend,
+        .dfa_cache_size = header.dfa_cache_size,
+    };
+    const struct rcs_scanner *scanner;
+    err = rcs_scanner_init_compiled(&scanner, nfa, &classes, &options, has_jit ? &jit : NULL);
+    if (rcs_failed(err)) {
+        free(nfa);
+        return err;
+    }
+
+    ((struct rcs_scanner *)scanner)->owned_nfa = nfa;
+    *out_scanner = scanner;
+    return RCS_OK;
+}
+
+rcs_error rcs_scanner_load_file(const struct rcs_scanner **out_scanner, const char *path) {
+    const void *addr;
+    size_t len;
+    rcs_error err = rcs_mmap_file(&addr, &len, path);
+    if (rcs_failed(err))
+        return err;
+    if (addr == NULL)
+        return BAD_IMAGE;
+
+    err = rcs_scanner_load(out_scanner, addr, len);
+    rcs_mmap_free((void *)addr, len);
+    return err;
+}
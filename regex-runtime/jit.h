@@ -1,6 +1,8 @@
 #ifndef REGEX_CS_RUNTIME_JIT
 #define REGEX_CS_RUNTIME_JIT
 
+#include "bitmap.h"
+#include "classes.h"
 #include "common.h"
 #include "stdbool.h"
 
@@ -20,7 +22,8 @@ RCS_NODISCARD
 bool rcs_jit_scanner_init(
     rcs_error *err,
     struct rcs_jit_scanner *scanner,
-    const struct rcs_nfa *nfa
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
 );
 
 RCS_NODISCARD
@@ -30,6 +33,46 @@ rcs_error rcs_jit_match(
     const struct rcs_reader *reader
 );
 
+// Initializes `scanner` with the code of `original`, only the scratch bitmaps are allocated.
+// The clone must be freed before `original`.
+RCS_NODISCARD
+rcs_error
+rcs_jit_scanner_clone(struct rcs_jit_scanner *scanner, const struct rcs_jit_scanner *original);
+
+// Position-independent machine code of a JIT scanner with its read-only data, as saved to an image.
+struct rcs_jit_code {
+    const uint8_t *code;
+    size_t len;
+    // Offset of the data in `code`.
+    size_t data_offset;
+    // The code uses AVX2 instructions.
+    bool use_avx2;
+};
+
+// Sets `out` to the code of `scanner`, it's valid while the scanner is.
+void rcs_jit_scanner_code(struct rcs_jit_code *out, const struct rcs_jit_scanner *scanner);
+
+// Same as `rcs_jit_scanner_init()`, but the code is copied from `code` compiled for the same `nfa`
+// and `classes` instead of being generated.
+// Returns false if the code can't run on this CPU.
+RCS_NODISCARD
+bool rcs_jit_scanner_load(
+    rcs_error *err,
+    struct rcs_jit_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_jit_code *code
+);
+
+// Advances the stream context states `states_bm` (accepting state excluded) by `buf`.
+// `len` must not be 0.
+// Returns true if the accepting state was reached by the last byte.
+bool rcs_jit_feed(
+    struct rcs_jit_scanner *scanner,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    rcs_api_size len
+);
+
 // Does not free the scanner struct itself, only its inner resources.
 void rcs_jit_scanner_free(struct rcs_jit_scanner *scanner);
 
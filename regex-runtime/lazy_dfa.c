@@ -0,0 +1,284 @@
+#include "lazy_dfa.h"
+#include "buffer_reader.h"
+#include "common.h"
+#include "standard.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Cache must be able to hold at least this number of states.
+#define MIN_CACHED_STATES 4
+
+// Set of NFA states with the counter values.
+// Allocated in the scanner's arena, the configuration is placed right after the transitions.
+struct rcs_lazy_dfa_state {
+    struct rcs_lazy_dfa_state *hash_next;
+    uint64_t hash;
+    rcs_bitmap_word *states_bm;
+
+    // Empty set, any further input doesn't match.
+    bool sink;
+
+    // Indexed by byte class, NULL if the transition was not computed yet.
+    struct rcs_lazy_dfa_state *next[];
+};
+
+static size_t round_up_pow2(size_t x) {
+    size_t p = 1;
+    while (p < x)
+        p <<= 1;
+    return p;
+}
+
+rcs_error rcs_lazy_dfa_scanner_init(
+    struct rcs_lazy_dfa_scanner *s,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters,
+    size_t cache_size
+) {
+    *s = (struct rcs_lazy_dfa_scanner){0};
+
+    s->nfa = nfa;
+    s->classes = classes;
+    s->counters = counters;
+    s->states_bm_len = counters->config_len;
+    s->dfa_state_size = sizeof(struct rcs_lazy_dfa_state) +
+                        classes->len * sizeof(struct rcs_lazy_dfa_state *) +
+                        s->states_bm_len * sizeof(rcs_bitmap_word);
+
+    if (cache_size == 0)
+        cache_size = RCS_LAZY_DFA_DEFAULT_CACHE_SIZE;
+    if (cache_size < MIN_CACHED_STATES * s->dfa_state_size)
+        cache_size = MIN_CACHED_STATES * s->dfa_state_size;
+
+    s->arena_size = cache_size;
+    s->arena_used = 0;
+    s->arena = malloc(s->arena_size);
+    if (s->arena == NULL)
+        goto malloc_err;
+
+    s->buckets_len = round_up_pow2(s->arena_size / s->dfa_state_size);
+    s->buckets = calloc(s->buckets_len, sizeof(*s->buckets));
+    if (s->buckets == NULL)
+        goto malloc_err;
+
+    s->initial_states_bm = calloc(s->states_bm_len, sizeof(rcs_bitmap_word));
+    if (s->initial_states_bm == NULL)
+        goto malloc_err;
+    for (size_t i = 0; i < nfa->sources_len; ++i)
+        rcs_counters_enter(counters, s->initial_states_bm, nfa->sources[i] - nfa->states);
+
+    for (size_t i = 0; i < 2; ++i) {
+        s->scratch_bm[i] = malloc(s->states_bm_len * sizeof(rcs_bitmap_word));
+        if (s->scratch_bm[i] == NULL)
+            goto malloc_err;
+    }
+
+    return RCS_OK;
+
+malloc_err:
+    rcs_lazy_dfa_scanner_free(s);
+    return RCS_MAKE_ERR_LIBC(errno);
+}
+
+static void cache_flush(struct rcs_lazy_dfa_scanner *sc) {
+    memset(sc->buckets, 0, sc->buckets_len * sizeof(*sc->buckets));
+    sc->arena_used = 0;
+    sc->dfa_states_len = 0;
+    ++sc->flushes;
+}
+
+// Finds or creates the DFA state for the given NFA states.
+// Flushes the cache if it's full, so all previously returned pointers may become invalid.
+static struct rcs_lazy_dfa_state *
+get_state(struct rcs_lazy_dfa_scanner *sc, const rcs_bitmap_word *states_bm) {
+    uint64_t hash = rcs_bitmap_hash(states_bm, sc->states_bm_len);
+    struct rcs_lazy_dfa_state **bucket = &sc->buckets[hash & (sc->buckets_len - 1)];
+
+    for (struct rcs_lazy_dfa_state *st = *bucket; st != NULL; st = st->hash_next) {
+        if (st->hash == hash && rcs_bitmap_equal(st->states_bm, states_bm, sc->states_bm_len))
+            return st;
+    }
+
+    if (sc->arena_used + sc->dfa_state_size > sc->arena_size) {
+        cache_flush(sc);
+        bucket = &sc->buckets[hash & (sc->buckets_len - 1)];
+    }
+
+    struct rcs_lazy_dfa_state *st = (struct rcs_lazy_dfa_state *)(sc->arena + sc->arena_used);
+    sc->arena_used += sc->dfa_state_size;
+    ++sc->dfa_states_len;
+
+    memset(st->next, 0, sc->classes->len * sizeof(*st->next));
+    st->hash = hash;
+    st->states_bm = (rcs_bitmap_word *)(st->next + sc->classes->len);
+    memcpy(st->states_bm, states_bm, sc->states_bm_len * sizeof(rcs_bitmap_word));
+    st->sink = rcs_bitmap_is_zero(states_bm, sc->states_bm_len);
+
+    st->hash_next = *bucket;
+    *bucket = st;
+
+    return st;
+}
+
+// Computes the transition of `state` by a char of class `class_i` and caches it.
+// May flush the cache (`state` pointer becomes invalid then).
+static struct rcs_lazy_dfa_state *add_transition(
+    struct rcs_lazy_dfa_scanner *sc,
+    struct rcs_lazy_dfa_state *state,
+    size_t class_i
+) {
+    rcs_bitmap_word *next_bm = sc->scratch_bm[1];
+    rcs_bitmap_clear_all(next_bm, sc->states_bm_len);
+    rcs_standard_step(sc->nfa, sc->classes, sc->counters, state->states_bm, next_bm, class_i);
+
+    size_t flushes = sc->flushes;
+    struct rcs_lazy_dfa_state *next = get_state(sc, next_bm);
+    if (sc->flushes == flushes)
+        state->next[class_i] = next;
+    return next;
+}
+
+// Same as `rcs_lazy_dfa_final_states()`, but starts from the given NFA states.
+static rcs_error run(
+    const rcs_bitmap_word **out_states_bm,
+    struct rcs_lazy_dfa_scanner *sc,
+    const rcs_bitmap_word *start_bm,
+    const struct rcs_reader *reader
+) {
+    struct rcs_lazy_dfa_state *state = get_state(sc, start_bm);
+
+    // Set when the cache is thrashing, then the NFA is simulated in the scratch bitmaps for the
+    // rest of the input.
+    bool nfa_fallback = false;
+    rcs_bitmap_word *cur = sc->scratch_bm[0];
+    rcs_bitmap_word *next = sc->scratch_bm[1];
+
+    size_t input_pos = 0;
+    size_t last_flush_pos = 0;
+
+    rcs_api_size n;
+    while ((n = reader->read(reader->arg)) > 0) {
+        const uint8_t *buf = reader->buf;
+        size_t i = 0;
+
+        for (; i < n && !nfa_fallback; ++i) {
+            size_t class_i = sc->classes->map[buf[i]];
+            struct rcs_lazy_dfa_state *next_state = state->next[class_i];
+
+            if (next_state == NULL) {
+                size_t cached_states = sc->dfa_states_len;
+                size_t flushes = sc->flushes;
+
+                next_state = add_transition(sc, state, class_i);
+
+                if (sc->flushes != flushes) {
+                    size_t consumed = input_pos + i - last_flush_pos;
+                    if (consumed < RCS_LAZY_DFA_MIN_BYTES_PER_STATE * cached_states) {
+                        nfa_fallback = true;
+                        memcpy(cur, next_state->states_bm, sc->states_bm_len * sizeof(*cur));
+                    }
+                    last_flush_pos = input_pos + i;
+                }
+            }
+
+            state = next_state;
+            if (state->sink) {
+                *out_states_bm = NULL;
+                return RCS_OK;
+            }
+        }
+
+        for (; i < n; ++i) {
+            rcs_bitmap_clear_all(next, sc->states_bm_len);
+            bool has_active_states = rcs_standard_step(
+                sc->nfa,
+                sc->classes,
+                sc->counters,
+                cur,
+                next,
+                sc->classes->map[buf[i]]
+            );
+
+            rcs_bitmap_word *tmp = cur;
+            cur = next;
+            next = tmp;
+
+            if (!has_active_states && rcs_bitmap_is_zero(cur, sc->states_bm_len)) {
+                *out_states_bm = NULL;
+                return RCS_OK;
+            }
+        }
+
+        input_pos += n;
+    }
+
+    *out_states_bm = nfa_fallback ? cur : state->states_bm;
+    return RCS_OK;
+}
+
+rcs_error rcs_lazy_dfa_final_states(
+    const rcs_bitmap_word **out_states_bm,
+    struct rcs_lazy_dfa_scanner *sc,
+    const struct rcs_reader *reader
+) {
+    return run(out_states_bm, sc, sc->initial_states_bm, reader);
+}
+
+rcs_error rcs_lazy_dfa_feed(
+    rcs_api_bool *out_accepted,
+    struct rcs_lazy_dfa_scanner *sc,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    size_t len
+) {
+    struct rcs_buffer_reader r;
+    rcs_buffer_reader_init(&r, buf, len);
+
+    const rcs_bitmap_word *final_bm;
+    rcs_error err = run(&final_bm, sc, states_bm, &r.reader);
+    if (rcs_failed(err))
+        return err;
+
+    if (final_bm == NULL) {
+        rcs_bitmap_clear_all(states_bm, sc->states_bm_len);
+        *out_accepted = false;
+        return RCS_OK;
+    }
+
+    size_t accept_i = sc->nfa->accept - sc->nfa->states;
+    memcpy(states_bm, final_bm, sc->states_bm_len * sizeof(*states_bm));
+    *out_accepted = rcs_bitmap_get(states_bm, accept_i);
+    rcs_bitmap_clear(states_bm, accept_i);
+    return RCS_OK;
+}
+
+rcs_error rcs_lazy_dfa_match(
+    rcs_api_bool *out_ok,
+    struct rcs_lazy_dfa_scanner *sc,
+    const struct rcs_reader *reader
+) {
+    const rcs_bitmap_word *states_bm;
+    rcs_error err = rcs_lazy_dfa_final_states(&states_bm, sc, reader);
+    if (rcs_failed(err))
+        return err;
+
+    *out_ok = states_bm != NULL && rcs_bitmap_get(states_bm, sc->nfa->accept - sc->nfa->states);
+    return RCS_OK;
+}
+
+void rcs_lazy_dfa_scanner_free(struct rcs_lazy_dfa_scanner *scanner) {
+    free(scanner->arena);
+    free(scanner->buckets);
+    free(scanner->initial_states_bm);
+    free(scanner->scratch_bm[0]);
+    free(scanner->scratch_bm[1]);
+    scanner->arena = NULL;
+    scanner->buckets = NULL;
+    scanner->initial_states_bm = NULL;
+    scanner->scratch_bm[0] = scanner->scratch_bm[1] = NULL;
+}
@@ -0,0 +1,93 @@
+#ifndef REGEX_CS_RUNTIME_LAZY_DFA
+#define REGEX_CS_RUNTIME_LAZY_DFA
+
+#include "api.h"
+#include "bitmap.h"
+#include "classes.h"
+#include "counters.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Used when `rcs_scanner_options.dfa_cache_size` is 0.
+#define RCS_LAZY_DFA_DEFAULT_CACHE_SIZE (2 * 1024 * 1024)
+
+// If the cache was flushed before the scanner consumed this number of bytes per each cached state,
+// the cache is considered useless for the input and the scanner falls back to the NFA simulation.
+#define RCS_LAZY_DFA_MIN_BYTES_PER_STATE 10
+
+struct rcs_lazy_dfa_state;
+
+// DFA states (sets of NFA states with the counter values) are built on demand and cached.
+// All cached states are flushed at once when the cache runs out of memory.
+struct rcs_lazy_dfa_scanner {
+    const struct rcs_nfa *nfa;
+    const struct rcs_byte_classes *classes;
+    const struct rcs_counters *counters;
+    // Words of a configuration, see `rcs_counters`.
+    size_t states_bm_len;
+
+    // Size of the single DFA state in the arena, including its transitions and bitmap.
+    size_t dfa_state_size;
+
+    // All DFA states are allocated here.
+    unsigned char *arena;
+    size_t arena_size;
+    size_t arena_used;
+
+    // Hash table of DFA states, chained through `rcs_lazy_dfa_state.hash_next`.
+    // Length is a power of 2.
+    struct rcs_lazy_dfa_state **buckets;
+    size_t buckets_len;
+    size_t dfa_states_len;
+
+    // NFA states of the DFA initial state.
+    rcs_bitmap_word *initial_states_bm;
+
+    // Scratch bitmaps for the transition computation and the NFA fallback.
+    rcs_bitmap_word *scratch_bm[2];
+
+    // Number of times the cache was flushed, only for stats.
+    size_t flushes;
+};
+
+RCS_NODISCARD
+rcs_error rcs_lazy_dfa_scanner_init(
+    struct rcs_lazy_dfa_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters,
+    size_t cache_size
+);
+
+RCS_NODISCARD
+rcs_error rcs_lazy_dfa_match(
+    rcs_api_bool *out_ok,
+    struct rcs_lazy_dfa_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+// Runs the DFA over the whole input.
+// `out_states_bm` is set to the configuration after the last step, accepting states included,
+// or to NULL if the automaton sinked. It's valid until the next call.
+RCS_NODISCARD
+rcs_error rcs_lazy_dfa_final_states(
+    const rcs_bitmap_word **out_states_bm,
+    struct rcs_lazy_dfa_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+// Advances the stream context configuration `states_bm` (accepting state excluded) by `buf`.
+// `out_accepted` is set if the accepting state was reached by the last byte.
+RCS_NODISCARD
+rcs_error rcs_lazy_dfa_feed(
+    rcs_api_bool *out_accepted,
+    struct rcs_lazy_dfa_scanner *scanner,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    size_t len
+);
+
+// Does not free the scanner struct itself, only its inner buffers.
+void rcs_lazy_dfa_scanner_free(struct rcs_lazy_dfa_scanner *scanner);
+
+#endif
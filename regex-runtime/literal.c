@@ -0,0 +1,136 @@
+#include "literal.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// First byte is found with memchr, the rest is compared.
+static size_t
+find_scalar(const uint8_t *literal, size_t literal_len, const uint8_t *buf, size_t len) {
+    size_t i = 0;
+    while (i + literal_len <= len) {
+        const uint8_t *found = memchr(buf + i, literal[0], len - i - literal_len + 1);
+        if (found == NULL)
+            break;
+
+        i = found - buf;
+        if (memcmp(buf + i + 1, literal + 1, literal_len - 1) == 0)
+            return i;
+        ++i;
+    }
+    return len;
+}
+
+size_t
+rcs_literal_find(const uint8_t *literal, size_t literal_len, const uint8_t *buf, size_t len) {
+    if (literal_len == 0)
+        return 0;
+    if (literal_len > len)
+        return len;
+
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // Candidates are positions where both the first and the last byte of the literal match,
+    // 16 positions are checked at once.
+    if (literal_len > 1) {
+        __m128i first = _mm_set1_epi8((char)literal[0]);
+        __m128i last = _mm_set1_epi8((char)literal[literal_len - 1]);
+
+        for (; i + literal_len - 1 + 16 <= len; i += 16) {
+            __m128i first_eq =
+                _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf + i)), first);
+            __m128i last_eq = _mm_cmpeq_epi8(
+                _mm_loadu_si128((const __m128i *)(buf + i + literal_len - 1)),
+                last
+            );
+
+            unsigned mask = _mm_movemask_epi8(_mm_and_si128(first_eq, last_eq));
+            for (; mask != 0; mask &= mask - 1) {
+                size_t pos = i + __builtin_ctz(mask);
+                if (memcmp(buf + pos + 1, literal + 1, literal_len - 2) == 0)
+                    return pos;
+            }
+        }
+    }
+#endif
+
+    size_t found = find_scalar(literal, literal_len, buf + i, len - i);
+    return found == len - i ? len : i + found;
+}
+
+rcs_error
+rcs_literal_filter_init(struct rcs_literal_filter *filter, const uint8_t *literal, size_t len) {
+    *filter = (struct rcs_literal_filter){0};
+    filter->literal = literal;
+    filter->len = len;
+
+    if (len > 1) {
+        filter->window = malloc(2 * (len - 1));
+        if (filter->window == NULL)
+            return RCS_MAKE_ERR_LIBC(errno);
+    }
+
+    return RCS_OK;
+}
+
+rcs_error rcs_literal_filter_run(
+    rcs_api_bool *out_found,
+    struct rcs_literal_filter *filter,
+    const struct rcs_reader *reader
+) {
+    const size_t tail_max = filter->len - 1;
+    // `window[0..tail_len)` is the tail of the input read so far
+    size_t tail_len = 0;
+    uint64_t total = 0;
+    bool found = false;
+
+    rcs_api_size n;
+    while (!found && (n = reader->read(reader->arg)) > 0) {
+        const uint8_t *buf = reader->buf;
+        total += n;
+
+        // crossing the boundary
+        if (tail_len != 0) {
+            size_t head_len = n < tail_max ? n : tail_max;
+            memcpy(filter->window + tail_len, buf, head_len);
+            size_t window_len = tail_len + head_len;
+            found = rcs_literal_find(filter->literal, filter->len, filter->window, window_len) !=
+                    window_len;
+        }
+
+        if (!found)
+            found = rcs_literal_find(filter->literal, filter->len, buf, n) != n;
+
+        if (tail_max == 0) {
+            // single byte literal never crosses the boundary
+        } else if (n >= tail_max) {
+            tail_len = tail_max;
+            memcpy(filter->window, buf + n - tail_len, tail_len);
+        } else {
+            // the whole chunk follows the tail in the window
+            if (tail_len == 0)
+                memcpy(filter->window, buf, n);
+            size_t window_len = tail_len + n;
+            tail_len = window_len < tail_max ? window_len : tail_max;
+            memmove(filter->window, filter->window + window_len - tail_len, tail_len);
+        }
+    }
+
+    if (found && !reader->unwind(reader->arg, total))
+        return RCS_MAKE_ERR(RCS_ERR_READER);
+
+    *out_found = found;
+    return RCS_OK;
+}
+
+void rcs_literal_filter_free(struct rcs_literal_filter *filter) {
+    free(filter->window);
+    filter->window = NULL;
+}
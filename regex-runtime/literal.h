@@ -0,0 +1,40 @@
+#ifndef REGEX_CS_RUNTIME_LITERAL
+#define REGEX_CS_RUNTIME_LITERAL
+
+#include "api.h"
+#include "common.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Rejects the input early if it doesn't contain a literal that every match must contain.
+struct rcs_literal_filter {
+    const uint8_t *literal;
+    size_t len;
+
+    // Tail of the previous chunk followed by the head of the next one, `2 * (len - 1)` bytes.
+    // Literal may cross the chunks boundary.
+    uint8_t *window;
+};
+
+// Returns index of the first occurence of the literal in `buf`, or `len` if there's none.
+size_t
+rcs_literal_find(const uint8_t *literal, size_t literal_len, const uint8_t *buf, size_t len);
+
+// The literal is not copied, it must outlive the filter.
+RCS_NODISCARD
+rcs_error
+rcs_literal_filter_init(struct rcs_literal_filter *filter, const uint8_t *literal, size_t len);
+
+// Reads the input until the literal is found, then unwinds the reader back to the input start.
+// The reader is not unwound if the literal was not found.
+RCS_NODISCARD
+rcs_error rcs_literal_filter_run(
+    rcs_api_bool *out_found,
+    struct rcs_literal_filter *filter,
+    const struct rcs_reader *reader
+);
+
+// Does not free the filter struct itself, only its inner buffers.
+void rcs_literal_filter_free(struct rcs_literal_filter *filter);
+
+#endif
@@ -1,9 +1,14 @@
+// MAP_ANONYMOUS is not in C99/POSIX.1-2008.
+#define _DEFAULT_SOURCE
+
 #include "mmap.h"
 
-#include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <stddef.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 RCS_NODISCARD
 rcs_error rcs_mmap_for_write(void **out_addr, size_t len) {
@@ -15,13 +20,48 @@ rcs_error rcs_mmap_for_write(void **out_addr, size_t len) {
 
 RCS_NODISCARD
 rcs_error rcs_mmap_make_exec(void *addr, size_t len) {
-    int rc = mprotect(addr, len, PROT_EXEC);
+    int rc = mprotect(addr, len, PROT_READ | PROT_EXEC);
     if (rc < 0)
         return RCS_MAKE_ERR_LIBC(errno);
     return RCS_OK;
 }
 
+RCS_NODISCARD
+rcs_error rcs_mmap_file(const void **out_addr, size_t *out_len, const char *path) {
+    rcs_error err = RCS_OK;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        err = RCS_MAKE_ERR_LIBC(errno);
+        goto close_fd;
+    }
+
+    *out_len = st.st_size;
+    *out_addr = NULL;
+    if (*out_len == 0)
+        goto close_fd;
+
+    // No MAP_POPULATE: it would read the whole file before the scanner starts, while the scanner
+    // may stop at the first bytes. The readahead keeps ahead of the scanner anyway.
+    void *addr = mmap(NULL, *out_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+        err = RCS_MAKE_ERR_LIBC(errno);
+        goto close_fd;
+    }
+    // only a hint, the mapping works without it
+    madvise(addr, *out_len, MADV_SEQUENTIAL);
+    *out_addr = addr;
+
+close_fd:
+    close(fd);
+    return err;
+}
+
 void rcs_mmap_free(void *addr, size_t len) {
-    int rc = munmap(addr, len);
-    assert(rc > 0 && "munmap() failed");
+    // fails only for invalid arguments, and there's nothing a caller could do about it
+    munmap(addr, len);
 }
@@ -8,9 +8,15 @@
 RCS_NODISCARD
 rcs_error rcs_mmap_for_write(void **out_addr, size_t len);
 
+// Code may also read its data placed in the same mapping.
 RCS_NODISCARD
 rcs_error rcs_mmap_make_exec(void *addr, size_t len);
 
+// Maps the whole file for reading, advised for the sequential access.
+// `out_addr` is set to NULL for an empty file.
+RCS_NODISCARD
+rcs_error rcs_mmap_file(const void **out_addr, size_t *out_len, const char *path);
+
 void rcs_mmap_free(void *addr, size_t len);
 
 #endif
@@ -9,7 +9,28 @@ RCS_NODISCARD
 bool rcs_jit_scanner_init(
     rcs_error *err,
     struct rcs_jit_scanner *scanner,
-    const struct rcs_nfa *nfa
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
+    return false;
+}
+
+RCS_NODISCARD
+rcs_error
+rcs_jit_scanner_clone(struct rcs_jit_scanner *scanner, const struct rcs_jit_scanner *original) {
+    assert(0 && "not implemented");
+}
+
+void rcs_jit_scanner_code(struct rcs_jit_code *out, const struct rcs_jit_scanner *scanner) {
+    assert(0 && "not implemented");
+}
+
+RCS_NODISCARD
+bool rcs_jit_scanner_load(
+    rcs_error *err,
+    struct rcs_jit_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_jit_code *code
 ) {
     return false;
 }
@@ -23,6 +44,15 @@ rcs_error rcs_jit_match(
     assert(0 && "not implemented");
 }
 
+bool rcs_jit_feed(
+    struct rcs_jit_scanner *scanner,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    rcs_api_size len
+) {
+    assert(0 && "not implemented");
+}
+
 void rcs_jit_scanner_free(struct rcs_jit_scanner *scanner) {
     assert(0 && "not implemented");
 }
@@ -0,0 +1,272 @@
+#include "api.h"
+#include "bitmap.h"
+#include "common.h"
+#include "scanner.h"
+#include "workers.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Each chunk after the first costs a simulation per distinct state set, which is at least as much
+// as the whole sequential match of a small input.
+#define MIN_CHUNK_LEN (16 << 20)
+
+// Runs are compared after each block, the first blocks are short to merge them as soon as they
+// converge.
+#define FIRST_BLOCK_LEN 256
+#define MAX_BLOCK_LEN (64 << 10)
+
+// Transfer function of an input chunk: maps each NFA state active at the chunk start to the
+// states active at its end. The entries are the bits of a configuration (see `rcs_counters`), so
+// each value of a counter is mapped like a state.
+// A run is simulated for each entry, runs that reached the same configuration are merged.
+struct transfer {
+    // Owned clone, each thread needs its own scratch state.
+    struct rcs_scanner *scanner;
+    const uint8_t *buf;
+    size_t len;
+
+    // Stream contexts of the distinct runs, `ctx_size` bytes each.
+    uint8_t *runs;
+    size_t runs_len;
+    size_t ctx_size;
+    // Run of each entry, indexed by configuration bit. Not set for the accepting state, the
+    // counting states and the unused bits.
+    size_t *entry_run;
+
+    rcs_error err;
+    pthread_t thread;
+    bool thread_started;
+};
+
+static struct rcs_stream *run_ctx(const struct transfer *t, size_t run_i) {
+    return (struct rcs_stream *)(t->runs + run_i * t->ctx_size);
+}
+
+// Entries of a configuration, an upper bound of the number of runs.
+static size_t entries_len(const struct rcs_scanner *scanner) {
+    return rcs_scanner_program(scanner)->counters.config_len * RCS_BITMAP_WORD_BIT_WIDTH;
+}
+
+// Merges equal runs, keeps the first one of them.
+// `scratch` has 2 words per entry.
+static void merge_runs(struct transfer *t, size_t entries_len, uint64_t *scratch) {
+    size_t ctx_words = t->ctx_size / sizeof(rcs_bitmap_word);
+    uint64_t *hashes = scratch;
+    uint64_t *run_remap = scratch + entries_len;
+
+    size_t distinct = 0;
+    for (size_t i = 0; i < t->runs_len; ++i) {
+        uint64_t hash = rcs_bitmap_hash((const rcs_bitmap_word *)run_ctx(t, i), ctx_words);
+
+        size_t j = 0;
+        while (j < distinct &&
+               (hashes[j] != hash || memcmp(run_ctx(t, j), run_ctx(t, i), t->ctx_size) != 0))
+            ++j;
+        if (j == distinct) {
+            if (j != i)
+                memcpy(run_ctx(t, j), run_ctx(t, i), t->ctx_size);
+            hashes[j] = hash;
+            ++distinct;
+        }
+        run_remap[i] = j;
+    }
+
+    for (size_t e = 0; e < entries_len; ++e) {
+        if (t->entry_run[e] != SIZE_MAX)
+            t->entry_run[e] = run_remap[t->entry_run[e]];
+    }
+    t->runs_len = distinct;
+}
+
+// Adds a run from the state `state_i` with only the entry `entry_i` of it active, which is the
+// state itself or a value of its counter.
+static void add_run(struct transfer *t, size_t config_len, size_t state_i, size_t entry_i) {
+    struct rcs_stream *ctx = run_ctx(t, t->runs_len);
+    ctx->accepted = false;
+    rcs_bitmap_clear_all(ctx->states_bm, config_len);
+    rcs_bitmap_set(ctx->states_bm, state_i);
+    rcs_bitmap_set(ctx->states_bm, entry_i);
+    t->entry_run[entry_i] = t->runs_len++;
+}
+
+static rcs_error compute_transfer(struct transfer *t) {
+    const struct rcs_nfa *nfa = t->scanner->nfa;
+    const struct rcs_counters *counters = &rcs_scanner_program(t->scanner)->counters;
+    size_t entries = entries_len(t->scanner);
+
+    uint64_t *scratch = malloc(2 * entries * sizeof(*scratch));
+    if (scratch == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    t->runs_len = 0;
+    for (size_t e = 0; e < entries; ++e)
+        t->entry_run[e] = SIZE_MAX;
+    for (size_t s = 0; s < nfa->states_len; ++s) {
+        if (&nfa->states[s] == nfa->accept)
+            continue;
+
+        const struct rcs_counter *counter = rcs_counters_get(counters, s);
+        if (counter == NULL) {
+            add_run(t, counters->config_len, s, s);
+            continue;
+        }
+        for (size_t v = 0; v < counter->width; ++v)
+            add_run(t, counters->config_len, s, counter->offset * RCS_BITMAP_WORD_BIT_WIDTH + v);
+    }
+
+    rcs_error err = RCS_OK;
+    size_t block_len = FIRST_BLOCK_LEN;
+    for (size_t pos = 0; pos < t->len && !rcs_failed(err);) {
+        size_t n = t->len - pos < block_len ? t->len - pos : block_len;
+        for (size_t i = 0; i < t->runs_len && !rcs_failed(err); ++i)
+            err = rcs_stream_feed(run_ctx(t, i), t->scanner, t->buf + pos, n);
+
+        merge_runs(t, entries, scratch);
+        pos += n;
+        if (block_len < MAX_BLOCK_LEN)
+            block_len *= 2;
+    }
+
+    free(scratch);
+    return err;
+}
+
+static void *transfer_thread(void *arg) {
+    struct transfer *t = arg;
+    t->err = compute_transfer(t);
+    return NULL;
+}
+
+// Feeds the whole buffer, `rcs_stream_feed()` takes at most `UINT32_MAX` bytes at once.
+static rcs_error
+feed_all(struct rcs_stream *ctx, struct rcs_scanner *scanner, const uint8_t *buf, size_t len) {
+    rcs_error err = RCS_OK;
+    for (size_t pos = 0; pos < len && !rcs_failed(err);) {
+        size_t n = len - pos < UINT32_MAX ? len - pos : UINT32_MAX;
+        err = rcs_stream_feed(ctx, scanner, buf + pos, n);
+        pos += n;
+    }
+    return err;
+}
+
+// Applies the transfer function `t` to `ctx`.
+static void apply_transfer(struct rcs_stream *ctx, const struct transfer *t, size_t config_len) {
+    rcs_bitmap_word accepted = false;
+    rcs_bitmap_word *exit_bm = (rcs_bitmap_word *)(t->runs + t->runs_len * t->ctx_size);
+    rcs_bitmap_clear_all(exit_bm, config_len);
+
+    for (size_t w = 0; w < config_len; ++w) {
+        for (rcs_bitmap_word word = ctx->states_bm[w]; word != 0; word &= word - 1) {
+            size_t e = w * RCS_BITMAP_WORD_BIT_WIDTH + rcs_bitmap_word_ctz(word);
+            // a counting state is mapped by its values
+            if (t->entry_run[e] == SIZE_MAX)
+                continue;
+
+            const struct rcs_stream *run = run_ctx(t, t->entry_run[e]);
+            accepted |= run->accepted;
+            for (size_t k = 0; k < config_len; ++k)
+                exit_bm[k] |= run->states_bm[k];
+        }
+    }
+
+    ctx->accepted = accepted;
+    memcpy(ctx->states_bm, exit_bm, config_len * sizeof(rcs_bitmap_word));
+}
+
+static void transfers_free(struct transfer *transfers, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        if (transfers[i].thread_started)
+            pthread_join(transfers[i].thread, NULL);
+        if (transfers[i].scanner != NULL)
+            rcs_scanner_free(transfers[i].scanner);
+        free(transfers[i].runs);
+        free(transfers[i].entry_run);
+    }
+    free(transfers);
+}
+
+rcs_error rcs_match_parallel(
+    rcs_api_bool *out_ok,
+    struct rcs_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    rcs_api_size threads
+) {
+    size_t chunks_len = rcs_workers_number(threads, len, MIN_CHUNK_LEN);
+    if (chunks_len == 1)
+        return rcs_match_buffer(out_ok, scanner, buf, len);
+
+    size_t config_len = rcs_scanner_program(scanner)->counters.config_len;
+    size_t entries = entries_len(scanner);
+    size_t ctx_size = rcs_stream_size(scanner);
+    size_t chunk_len = len / chunks_len;
+    rcs_error err = RCS_OK;
+
+    // The first chunk is matched from the initial states by the caller's scanner, the others
+    // get a transfer function each.
+    size_t transfers_len = chunks_len - 1;
+    struct transfer *transfers = calloc(transfers_len, sizeof(*transfers));
+    struct rcs_stream *ctx = malloc(ctx_size);
+    if (transfers == NULL || ctx == NULL) {
+        free(transfers);
+        free(ctx);
+        return RCS_MAKE_ERR_LIBC(errno);
+    }
+
+    for (size_t i = 0; i < transfers_len; ++i) {
+        struct transfer *t = &transfers[i];
+        t->buf = buf + chunk_len * (i + 1);
+        t->len = i + 1 == transfers_len ? len - chunk_len * (i + 1) : chunk_len;
+        t->ctx_size = ctx_size;
+
+        // one more context is the scratch exit states of `apply_transfer()`
+        t->runs = malloc(entries * ctx_size + ctx_size);
+        t->entry_run = malloc(entries * sizeof(*t->entry_run));
+        if (t->runs == NULL || t->entry_run == NULL) {
+            err = RCS_MAKE_ERR_LIBC(errno);
+            goto free_transfers;
+        }
+
+        const struct rcs_scanner *worker_scanner;
+        err = rcs_scanner_clone(&worker_scanner, scanner);
+        if (rcs_failed(err))
+            goto free_transfers;
+        t->scanner = (struct rcs_scanner *)worker_scanner;
+    }
+
+    // If a thread can't be created, its transfer function is computed by the caller's thread.
+    for (size_t i = 0; i < transfers_len; ++i) {
+        int rc = pthread_create(&transfers[i].thread, NULL, transfer_thread, &transfers[i]);
+        transfers[i].thread_started = rc == 0;
+    }
+
+    rcs_stream_begin(ctx, scanner);
+    err = feed_all(ctx, scanner, buf, chunk_len);
+
+    for (size_t i = 0; i < transfers_len; ++i) {
+        struct transfer *t = &transfers[i];
+        if (t->thread_started) {
+            pthread_join(t->thread, NULL);
+            t->thread_started = false;
+        } else {
+            t->err = compute_transfer(t);
+        }
+        if (!rcs_failed(err))
+            err = t->err;
+        if (!rcs_failed(err))
+            apply_transfer(ctx, t, config_len);
+    }
+
+    if (!rcs_failed(err))
+        err = rcs_stream_end(out_ok, ctx);
+
+free_transfers:
+    transfers_free(transfers, transfers_len);
+    free(ctx);
+    return err;
+}
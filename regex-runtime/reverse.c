@@ -0,0 +1,127 @@
+#include "reverse.h"
+#include "common.h"
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+void rcs_reverse_scanner_init(
+    struct rcs_reverse_scanner *s,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
+    *s = (struct rcs_reverse_scanner){0};
+    s->forward = nfa;
+    s->classes = classes;
+}
+
+// Turns each transition `i -> j` of the forward NFA into `j -> i`. The states that lead to the
+// accepting one become the sources, and the sources lead to the accepting state.
+static rcs_error build(struct rcs_reverse_scanner *s) {
+    const struct rcs_nfa *fwd = s->forward;
+    size_t states_len = fwd->states_len;
+    size_t accept_i = fwd->accept - fwd->states;
+
+    // sources are bounded by the number of states, each one is listed once, and so are the loops
+    // of unreachable states
+    size_t transitions_len = 2 * states_len + fwd->sources_len;
+    for (size_t i = 0; i < states_len; ++i)
+        transitions_len += fwd->states[i].next_len;
+
+    struct rcs_nfa_state *states = calloc(states_len, sizeof(*states));
+    s->transitions = malloc(transitions_len * sizeof(*s->transitions));
+    if (states == NULL || s->transitions == NULL) {
+        free(states);
+        free(s->transitions);
+        s->transitions = NULL;
+        return RCS_MAKE_ERR_LIBC(errno);
+    }
+
+    // count the next lists first to lay them out in `transitions`
+    for (size_t i = 0; i < fwd->sources_len; ++i)
+        ++states[fwd->sources[i] - fwd->states].next_len;
+    for (size_t i = 0; i < states_len; ++i) {
+        const struct rcs_nfa_state *state = &fwd->states[i];
+        for (size_t j = 0; j < state->next_len; ++j) {
+            if (state->next[j] != fwd->accept)
+                ++states[state->next[j] - fwd->states].next_len;
+        }
+    }
+    // the accepting state keeps an empty next list
+    states[accept_i].next_len = 0;
+
+    struct rcs_nfa_state **free_slot = s->transitions + states_len;
+    for (size_t i = 0; i < states_len; ++i) {
+        states[i].next = free_slot;
+        // a slot for the loop of an unreachable state
+        free_slot += states[i].next_len > 0 ? states[i].next_len : 1;
+        states[i].next_len = 0;
+        states[i].ranges = fwd->states[i].ranges;
+        states[i].ranges_len = fwd->states[i].ranges_len;
+        states[i].inverted_match = fwd->states[i].inverted_match;
+    }
+
+    struct rcs_nfa_state **sources = s->transitions;
+    size_t sources_len = 0;
+    for (size_t i = 0; i < fwd->sources_len; ++i) {
+        size_t source_i = fwd->sources[i] - fwd->states;
+        if (source_i == accept_i)
+            sources[sources_len++] = &states[accept_i];
+        else
+            states[source_i].next[states[source_i].next_len++] = &states[accept_i];
+    }
+    for (size_t i = 0; i < states_len; ++i) {
+        const struct rcs_nfa_state *state = &fwd->states[i];
+        for (size_t j = 0; j < state->next_len; ++j) {
+            size_t next_i = state->next[j] - fwd->states;
+            if (next_i == accept_i) {
+                sources[sources_len++] = &states[i];
+            } else {
+                struct rcs_nfa_state *rev = &states[next_i];
+                rev->next[rev->next_len++] = &states[i];
+            }
+        }
+    }
+
+    // states unreachable in the forward NFA would look accepting, they loop instead
+    for (size_t i = 0; i < states_len; ++i) {
+        if (i != accept_i && states[i].next_len == 0)
+            states[i].next[states[i].next_len++] = &states[i];
+    }
+
+    s->nfa = (struct rcs_nfa){
+        .states = states,
+        .states_len = states_len,
+        .sources = sources,
+        .sources_len = sources_len,
+        .accept = &states[accept_i],
+    };
+    rcs_early_scanner_init(&s->early, &s->nfa, s->classes);
+    return RCS_OK;
+}
+
+rcs_error rcs_reverse_scanner_match(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_reverse_scanner *s,
+    const uint8_t *buf,
+    uint64_t len,
+    rcs_match_mode mode
+) {
+    if (s->nfa.states == NULL) {
+        rcs_error err = build(s);
+        if (rcs_failed(err))
+            return err;
+    }
+
+    return rcs_early_scanner_match_reversed(out_ok, out_offset, &s->early, buf, len, mode);
+}
+
+void rcs_reverse_scanner_free(struct rcs_reverse_scanner *s) {
+    if (s->nfa.states != NULL)
+        rcs_early_scanner_free(&s->early);
+    free(s->nfa.states);
+    free(s->transitions);
+    s->nfa.states = NULL;
+    s->transitions = NULL;
+}
@@ -0,0 +1,48 @@
+#ifndef REGEX_CS_RUNTIME_REVERSE
+#define REGEX_CS_RUNTIME_REVERSE
+
+#include "api.h"
+#include "classes.h"
+#include "common.h"
+#include "early.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Early-exit simulation of the NFA with the reversed transitions, it matches the reversed input.
+// States keep their indexes and conditions, so the byte classes of the forward NFA are valid for
+// it. Used for all scanner backends.
+struct rcs_reverse_scanner {
+    const struct rcs_nfa *forward;
+    const struct rcs_byte_classes *classes;
+
+    // Shares the char ranges with `forward`, `states` is NULL until the first match.
+    struct rcs_nfa nfa;
+    // Next lists of all the states and the sources in a single allocation.
+    struct rcs_nfa_state **transitions;
+
+    struct rcs_early_scanner early;
+};
+
+// The reversed NFA is built by the first match, so scanners that never match backwards don't pay
+// for it.
+void rcs_reverse_scanner_init(
+    struct rcs_reverse_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+);
+
+// See `rcs_match_reverse()`.
+RCS_NODISCARD
+rcs_error rcs_reverse_scanner_match(
+    rcs_api_bool *out_ok,
+    uint64_t *out_offset,
+    struct rcs_reverse_scanner *scanner,
+    const uint8_t *buf,
+    uint64_t len,
+    rcs_match_mode mode
+);
+
+// Does not free the scanner struct itself, only its inner buffers.
+void rcs_reverse_scanner_free(struct rcs_reverse_scanner *scanner);
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef REGEX_CS_RUNTIME_SCANNER
+#define REGEX_CS_RUNTIME_SCANNER
+
+#include "api.h"
+#include "bitparallel.h"
+#include "captures.h"
+#include "classes.h"
+#include "counters.h"
+#include "early.h"
+#include "jit.h"
+#include "lazy_dfa.h"
+#include "literal.h"
+#include "reverse.h"
+#include "search.h"
+#include "standard.h"
+
+// Opaque for the API users, shared by the runtime modules built on top of the matching API.
+//
+// Consists of the read-only compiled program (byte classes, JIT code, bit-parallel tables) and the
+// scratch state of a match. Clones share the program of the scanner they were made from.
+struct rcs_scanner {
+    // Scanner that owns the program, NULL if it's this one.
+    const struct rcs_scanner *program;
+    // NFA loaded from an image in a single allocation, NULL if it's owned by the API user.
+    struct rcs_nfa *owned_nfa;
+    // NFA of the program, it may have counting states.
+    const struct rcs_nfa *nfa;
+
+    rcs_scanner_backend backend_type;
+    union {
+        struct rcs_standard_scanner standard;
+        struct rcs_jit_scanner jit;
+        struct rcs_lazy_dfa_scanner lazy_dfa;
+        struct rcs_bitparallel_scanner bitparallel;
+    } backend;
+
+    // Options the scanner was created with, `backend` is replaced by the chosen one.
+    // Scanners created with them behave exactly like this one.
+    struct rcs_scanner_options options;
+
+    // These simulations don't support counters, they run `unrolled` if the NFA has counting states.
+    // Used by `rcs_search()` for all backends.
+    struct rcs_search_scanner search;
+    // Used by `rcs_match_captures()` for all backends.
+    struct rcs_captures_scanner captures;
+    // Used by `rcs_match_early()` for all backends.
+    struct rcs_early_scanner early;
+    // Used by `rcs_match_reverse()` for all backends.
+    struct rcs_reverse_scanner reverse;
+
+    // Shared by all backends. Not initialized in clones, they use the classes of `program`.
+    struct rcs_byte_classes classes;
+    // Layout of the configurations, shared like `classes`.
+    struct rcs_counters counters;
+    // Built only if the NFA has counting states, shared like `classes`.
+    struct rcs_unrolled_nfa unrolled;
+
+    // Used if the NFA has a required literal.
+    struct rcs_literal_filter literal_filter;
+};
+
+// Same as `rcs_scanner_init_ex()`, but with the byte classes already built for `nfa`, the scanner
+// takes them even on failure. The JIT backend copies `jit_code` if it's not NULL instead of
+// compiling the NFA.
+RCS_NODISCARD
+rcs_error rcs_scanner_init_compiled(
+    const struct rcs_scanner **out_scanner,
+    const struct rcs_nfa *nfa,
+    struct rcs_byte_classes *classes,
+    const struct rcs_scanner_options *options,
+    const struct rcs_jit_code *jit_code
+);
+
+// Returns the scanner that owns the program of `scanner`.
+static inline const struct rcs_scanner *rcs_scanner_program(const struct rcs_scanner *scanner) {
+    return scanner->program != NULL ? scanner->program : scanner;
+}
+
+struct rcs_stream {
+    // The accepting state was reached by the last fed byte.
+    rcs_bitmap_word accepted;
+    // Configuration of the active NFA states except the accepting one, `counters.config_len`
+    // words of the program.
+    rcs_bitmap_word states_bm[];
+};
+
+#endif
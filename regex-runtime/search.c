@@ -0,0 +1,198 @@
+#include "search.h"
+#include "common.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define NO_START UINT64_MAX
+
+rcs_error rcs_search_scanner_init(
+    struct rcs_search_scanner *s,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+) {
+    *s = (struct rcs_search_scanner){0};
+
+    s->nfa = nfa;
+    s->classes = classes;
+
+    rcs_byteset_init(&s->first_bytes);
+    s->has_accepting_source = false;
+    for (size_t i = 0; i < nfa->sources_len; ++i) {
+        const struct rcs_nfa_state *src = nfa->sources[i];
+        if (rcs_nfa_state_is_accept(src)) {
+            s->has_accepting_source = true;
+            continue;
+        }
+
+        for (size_t c = 0; c < 256; ++c) {
+            if (rcs_byte_classes_state_matches(classes, src - nfa->states, classes->map[c]))
+                rcs_byteset_add(&s->first_bytes, c);
+        }
+    }
+
+    s->states_bm_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+    for (size_t i = 0; i < 2; ++i) {
+        s->states_bm[i] = malloc(s->states_bm_len * sizeof(*s->states_bm[i]));
+        if (s->states_bm[i] == NULL)
+            goto malloc_err;
+        s->starts[i] = malloc(nfa->states_len * sizeof(*s->starts[i]));
+        if (s->starts[i] == NULL)
+            goto malloc_err;
+    }
+
+    return RCS_OK;
+
+malloc_err:
+    rcs_search_scanner_free(s);
+    return RCS_MAKE_ERR_LIBC(errno);
+}
+
+// Start new threads from source states at input position `pos`.
+static void add_source_threads(struct rcs_search_scanner *sc, uint64_t pos) {
+    for (size_t i = 0; i < sc->nfa->sources_len; ++i) {
+        const struct rcs_nfa_state *src = sc->nfa->sources[i];
+        size_t src_i = src - sc->nfa->states;
+        if (rcs_nfa_state_is_accept(src) || rcs_bitmap_get(sc->states_bm[0], src_i))
+            continue; // earlier thread is already there
+
+        rcs_bitmap_set(sc->states_bm[0], src_i);
+        sc->starts[0][src_i] = pos;
+    }
+}
+
+// Threads that started after `max_start` are dropped.
+// Returns true if at least one non-accepting state was activated.
+static bool step(struct rcs_search_scanner *sc, uint8_t c, uint64_t max_start) {
+    const struct rcs_nfa *nfa = sc->nfa;
+    const rcs_bitmap_word *cur = sc->states_bm[0];
+    rcs_bitmap_word *next = sc->states_bm[1];
+    const uint64_t *cur_starts = sc->starts[0];
+    uint64_t *next_starts = sc->starts[1];
+    const size_t class_i = sc->classes->map[c];
+    bool has_active_states = false;
+
+    rcs_bitmap_clear_all(next, sc->states_bm_len);
+
+    for (size_t i = 0; i < nfa->states_len; ++i) {
+        const struct rcs_nfa_state *state = &nfa->states[i];
+
+        if (!rcs_bitmap_get(cur, i) || rcs_nfa_state_is_accept(state))
+            continue;
+        if (cur_starts[i] > max_start)
+            continue;
+        if (!rcs_byte_classes_state_matches(sc->classes, i, class_i))
+            continue;
+
+        for (size_t j = 0; j < state->next_len; ++j) {
+            size_t next_i = state->next[j] - nfa->states;
+            if (!rcs_bitmap_get(next, next_i)) {
+                rcs_bitmap_set(next, next_i);
+                next_starts[next_i] = cur_starts[i];
+            } else if (cur_starts[i] < next_starts[next_i]) {
+                next_starts[next_i] = cur_starts[i];
+            }
+
+            if (!rcs_nfa_state_is_accept(state->next[j]))
+                has_active_states = true;
+        }
+    }
+
+    // swap
+    rcs_bitmap_word *tmp_bm = sc->states_bm[0];
+    sc->states_bm[0] = sc->states_bm[1];
+    sc->states_bm[1] = tmp_bm;
+    uint64_t *tmp_starts = sc->starts[0];
+    sc->starts[0] = sc->starts[1];
+    sc->starts[1] = tmp_starts;
+
+    return has_active_states;
+}
+
+rcs_error rcs_search_scanner_search(
+    rcs_api_bool *out_found,
+    uint64_t *out_start,
+    uint64_t *out_end,
+    struct rcs_search_scanner *sc,
+    const struct rcs_reader *reader
+) {
+    const size_t accept_i = sc->nfa->accept - sc->nfa->states;
+
+    uint64_t best_start = NO_START;
+    uint64_t best_end = 0;
+    bool has_active_states = false;
+
+    // number of bytes consumed before the current chunk
+    uint64_t chunk_pos = 0;
+    const uint8_t *buf = NULL;
+    size_t buf_len = 0;
+    size_t i = 0;
+
+    rcs_bitmap_clear_all(sc->states_bm[0], sc->states_bm_len);
+
+    while (true) {
+        if (i == buf_len) {
+            chunk_pos += buf_len;
+            buf_len = reader->read(reader->arg);
+            buf = reader->buf;
+            i = 0;
+        }
+        uint64_t pos = chunk_pos + i;
+
+        // match ending at `pos`
+        if (rcs_bitmap_get(sc->states_bm[0], accept_i)) {
+            uint64_t start = sc->starts[0][accept_i];
+            if (start < best_start || (start == best_start && pos > best_end)) {
+                best_start = start;
+                best_end = pos;
+            }
+        }
+        if (best_start == NO_START && sc->has_accepting_source) {
+            best_start = pos;
+            best_end = pos;
+        }
+
+        if (buf_len == 0)
+            // EOF
+            break;
+
+        // threads started here can still make the leftmost match
+        bool add_threads = best_start == NO_START || best_start == pos;
+
+        if (!has_active_states && !add_threads)
+            // no thread can beat the found match
+            break;
+
+        if (!has_active_states && best_start == NO_START) {
+            // nothing to continue, jump to the next possible match start
+            i += rcs_byteset_find(&sc->first_bytes, buf + i, buf_len - i);
+            if (i == buf_len)
+                continue;
+            pos = chunk_pos + i;
+        }
+
+        uint8_t c = buf[i++];
+        if (add_threads && rcs_byteset_has(&sc->first_bytes, c))
+            add_source_threads(sc, pos);
+
+        has_active_states = step(sc, c, best_start);
+    }
+
+    *out_found = best_start != NO_START;
+    if (*out_found) {
+        *out_start = best_start;
+        *out_end = best_end;
+    }
+    return RCS_OK;
+}
+
+void rcs_search_scanner_free(struct rcs_search_scanner *scanner) {
+    for (size_t i = 0; i < 2; ++i) {
+        free(scanner->states_bm[i]);
+        free(scanner->starts[i]);
+        scanner->states_bm[i] = NULL;
+        scanner->starts[i] = NULL;
+    }
+}
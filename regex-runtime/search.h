@@ -0,0 +1,53 @@
+#ifndef REGEX_CS_RUNTIME_SEARCH
+#define REGEX_CS_RUNTIME_SEARCH
+
+#include "api.h"
+#include "bitmap.h"
+#include "byteset.h"
+#include "classes.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Unanchored NFA simulation that remembers where each thread started.
+// Used for all scanner backends, since the others can't track match positions.
+struct rcs_search_scanner {
+    const struct rcs_nfa *nfa;
+    const struct rcs_byte_classes *classes;
+
+    // Chars that may be consumed by source states.
+    // The scanner skips to the next one of them when no threads are active.
+    struct rcs_byteset first_bytes;
+    // Accepting source, empty string matches at any position.
+    bool has_accepting_source;
+
+    // 0 is the current, 1 is the next
+    // swap on each wave
+    rcs_bitmap_word *states_bm[2];
+    size_t states_bm_len;
+    // Input position where the leftmost thread that reached the state started.
+    // Indexed by state, valid only if the state is set in `states_bm`.
+    uint64_t *starts[2];
+};
+
+RCS_NODISCARD
+rcs_error rcs_search_scanner_init(
+    struct rcs_search_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes
+);
+
+// Finds the leftmost-longest match.
+RCS_NODISCARD
+rcs_error rcs_search_scanner_search(
+    rcs_api_bool *out_found,
+    uint64_t *out_start,
+    uint64_t *out_end,
+    struct rcs_search_scanner *scanner,
+    const struct rcs_reader *reader
+);
+
+// Does not free the scanner struct itself, only its inner buffers.
+void rcs_search_scanner_free(struct rcs_search_scanner *scanner);
+
+#endif
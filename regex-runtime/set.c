@@ -0,0 +1,106 @@
+#include "api.h"
+#include "bitmap.h"
+#include "classes.h"
+#include "common.h"
+#include "counters.h"
+#include "lazy_dfa.h"
+#include <assert.h>
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+// All patterns are simulated by one lazy DFA, then the accepting states of the last step are
+// collected.
+struct rcs_set_scanner {
+    // Same states as in the set, `accept` is the first pattern accepting state.
+    struct rcs_nfa nfa;
+    struct rcs_nfa_state **accepts;
+    size_t accepts_len;
+
+    struct rcs_byte_classes classes;
+    struct rcs_counters counters;
+    struct rcs_lazy_dfa_scanner dfa;
+};
+
+rcs_error rcs_set_scanner_init(
+    const struct rcs_set_scanner **out_scanner,
+    const struct rcs_nfa_set *set,
+    const struct rcs_scanner_options *options
+) {
+    rcs_error err = RCS_OK;
+
+    assert(set->accepts_len != 0);
+    if (options->backend != RCS_AUTO && options->backend != RCS_LAZY_DFA)
+        return RCS_MAKE_ERR(RCS_ERR_UNSUPPORTED_BACKEND);
+
+    struct rcs_set_scanner *s = malloc(sizeof(struct rcs_set_scanner));
+    if (s == NULL)
+        return RCS_MAKE_ERR_LIBC(errno);
+
+    s->nfa = (struct rcs_nfa){
+        .states = set->states,
+        .states_len = set->states_len,
+        .sources = set->sources,
+        .sources_len = set->sources_len,
+        .accept = set->accepts[0],
+    };
+    s->accepts = set->accepts;
+    s->accepts_len = set->accepts_len;
+
+    err = rcs_byte_classes_init(&s->classes, &s->nfa);
+    if (rcs_failed(err)) {
+        free(s);
+        return err;
+    }
+
+    err = rcs_counters_init(&s->counters, &s->nfa);
+    if (rcs_failed(err)) {
+        rcs_byte_classes_free(&s->classes);
+        free(s);
+        return err;
+    }
+
+    err = rcs_lazy_dfa_scanner_init(
+        &s->dfa,
+        &s->nfa,
+        &s->classes,
+        &s->counters,
+        options->dfa_cache_size
+    );
+    if (rcs_failed(err)) {
+        rcs_counters_free(&s->counters);
+        rcs_byte_classes_free(&s->classes);
+        free(s);
+        return err;
+    }
+
+    *out_scanner = s;
+    return RCS_OK;
+}
+
+rcs_error rcs_set_match(
+    uint64_t *out_matched,
+    struct rcs_set_scanner *scanner,
+    const struct rcs_reader *reader
+) {
+    memset(out_matched, 0, RCS_DIV_CEILING(scanner->accepts_len, 64) * sizeof(*out_matched));
+
+    const rcs_bitmap_word *states_bm;
+    rcs_error err = rcs_lazy_dfa_final_states(&states_bm, &scanner->dfa, reader);
+    if (rcs_failed(err) || states_bm == NULL)
+        return err;
+
+    for (size_t i = 0; i < scanner->accepts_len; ++i) {
+        if (rcs_bitmap_get(states_bm, scanner->accepts[i] - scanner->nfa.states))
+            out_matched[i / 64] |= (uint64_t)1 << (i % 64);
+    }
+    return RCS_OK;
+}
+
+void rcs_set_scanner_free(struct rcs_set_scanner *scanner) {
+    rcs_lazy_dfa_scanner_free(&scanner->dfa);
+    rcs_counters_free(&scanner->counters);
+    rcs_byte_classes_free(&scanner->classes);
+    free(scanner);
+}
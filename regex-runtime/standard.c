@@ -5,17 +5,28 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string.h>
 
-rcs_error rcs_standard_scanner_init(struct rcs_standard_scanner *s, const struct rcs_nfa *nfa) {
+rcs_error rcs_standard_scanner_init(
+    struct rcs_standard_scanner *s,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters
+) {
     *s = (struct rcs_standard_scanner){0};
 
     s->nfa = nfa;
+    s->classes = classes;
+    s->counters = counters;
 
-    s->states_bm_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+    s->states_bm_len = counters->config_len;
     for (size_t i = 0; i < 2; ++i) {
-        s->states_bm[i] = malloc(s->states_bm_len * sizeof(*s->states_bm[i]));
+        s->states_bm[i] = calloc(s->states_bm_len, sizeof(*s->states_bm[i]));
         if (s->states_bm[i] == NULL)
             goto malloc_err;
+        s->states_list[i] = malloc(nfa->states_len * sizeof(*s->states_list[i]));
+        if (s->states_list[i] == NULL)
+            goto malloc_err;
     }
 
     s->input_buf_index = 0;
@@ -24,8 +35,7 @@ rcs_error rcs_standard_scanner_init(struct rcs_standard_scanner *s, const struct
     return RCS_OK;
 
 malloc_err:
-    free(s->states_bm[0]);
-    free(s->states_bm[1]);
+    rcs_standard_scanner_free(s);
     return RCS_MAKE_ERR_LIBC(errno);
 }
 
@@ -43,13 +53,126 @@ static int read_char(struct rcs_standard_scanner *sc, const struct rcs_reader *r
     return reader->buf[0];
 }
 
-static bool state_matches_char(const struct rcs_nfa_state *state, uint8_t c) {
-    for (size_t i = 0; i < state->ranges_len; ++i) {
-        const struct rcs_nfa_char_range range = state->ranges[i];
-        if (range.start <= c && c <= range.end)
-            return !state->inverted_match;
+bool rcs_standard_step(
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters,
+    const rcs_bitmap_word *cur,
+    rcs_bitmap_word *next,
+    size_t class_i
+) {
+    bool has_active_states = false;
+    size_t bm_len = RCS_BITMAP_LEN_WORDS(nfa->states_len);
+
+    // only set bits are visited
+    for (size_t w = 0; w < bm_len; ++w) {
+        for (rcs_bitmap_word word = cur[w]; word != 0; word &= word - 1) {
+            size_t i = w * RCS_BITMAP_WORD_BIT_WIDTH + rcs_bitmap_word_ctz(word);
+            const struct rcs_nfa_state *state = &nfa->states[i];
+
+            if (rcs_nfa_state_is_accept(state))
+                continue;
+
+            assert(!rcs_nfa_state_is_epsilon(state) && "unexpected epsilon state");
+
+            if (!rcs_byte_classes_state_matches(classes, i, class_i))
+                continue;
+
+            const struct rcs_counter *counter = rcs_counters_get(counters, i);
+            if (counter != NULL) {
+                bool exits;
+                if (rcs_counter_step(counter, cur, next, &exits)) {
+                    rcs_bitmap_set(next, i);
+                    has_active_states = true;
+                }
+                if (!exits)
+                    continue;
+            }
+
+            for (size_t j = 0; j < state->next_len; ++j) {
+                rcs_counters_enter(counters, next, state->next[j] - nfa->states);
+                if (!rcs_nfa_state_is_accept(state->next[j]))
+                    has_active_states = true;
+            }
+        }
+    }
+
+    return has_active_states;
+}
+
+// Adds the state to the sparse set `list_i`, unless it's already there.
+static void list_state(struct rcs_standard_scanner *sc, size_t list_i, size_t state_i) {
+    if (rcs_bitmap_get(sc->states_bm[list_i], state_i))
+        return;
+
+    rcs_bitmap_set(sc->states_bm[list_i], state_i);
+    sc->states_list[list_i][sc->states_list_len[list_i]++] = state_i;
+}
+
+// Enters the state in the sparse set `list_i`, a counting state starts a new count.
+// Accepting state is not listed, returns true if it was reached instead.
+static bool activate_state(struct rcs_standard_scanner *sc, size_t list_i, size_t state_i) {
+    if (rcs_nfa_state_is_accept(&sc->nfa->states[state_i]))
+        return true;
+
+    const struct rcs_counter *counter = rcs_counters_get(sc->counters, state_i);
+    if (counter != NULL)
+        sc->states_bm[list_i][counter->offset] |= 1;
+    list_state(sc, list_i, state_i);
+    return false;
+}
+
+// Clears the sparse set `list_i` in O(its length).
+static void clear_states(struct rcs_standard_scanner *sc, size_t list_i) {
+    for (size_t i = 0; i < sc->states_list_len[list_i]; ++i)
+        rcs_counters_leave(sc->counters, sc->states_bm[list_i], sc->states_list[list_i][i]);
+    sc->states_list_len[list_i] = 0;
+}
+
+// Same as `rcs_standard_step()`, but on the sparse sets, from 0 to 1.
+// Returns true if the accepting state was reached.
+static bool sparse_step(struct rcs_standard_scanner *sc, size_t class_i) {
+    bool accepted = false;
+
+    for (size_t k = 0; k < sc->states_list_len[0]; ++k) {
+        size_t i = sc->states_list[0][k];
+        const struct rcs_nfa_state *state = &sc->nfa->states[i];
+
+        assert(!rcs_nfa_state_is_epsilon(state) && "unexpected epsilon state");
+
+        if (!rcs_byte_classes_state_matches(sc->classes, i, class_i))
+            continue;
+
+        const struct rcs_counter *counter = rcs_counters_get(sc->counters, i);
+        if (counter != NULL) {
+            bool exits;
+            if (rcs_counter_step(counter, sc->states_bm[0], sc->states_bm[1], &exits))
+                list_state(sc, 1, i);
+            if (!exits)
+                continue;
+        }
+
+        for (size_t j = 0; j < state->next_len; ++j) {
+            if (activate_state(sc, 1, state->next[j] - sc->nfa->states))
+                accepted = true;
+        }
     }
-    return state->inverted_match;
+
+    return accepted;
+}
+
+// Makes the next set current and clears the next one.
+static void swap_states(struct rcs_standard_scanner *sc) {
+    clear_states(sc, 0);
+
+    rcs_bitmap_word *tmp_bm = sc->states_bm[0];
+    sc->states_bm[0] = sc->states_bm[1];
+    sc->states_bm[1] = tmp_bm;
+    size_t *tmp_list = sc->states_list[0];
+    sc->states_list[0] = sc->states_list[1];
+    sc->states_list[1] = tmp_list;
+    sc->states_list_len[0] = sc->states_list_len[1];
+    sc->states_list_len[1] = 0;
 }
 
 rcs_error rcs_standard_match(
@@ -57,79 +180,76 @@ rcs_error rcs_standard_match(
     struct rcs_standard_scanner *sc,
     const struct rcs_reader *reader
 ) {
-    bool accepted_last_step = false;
-    bool has_active_states = false;
+    bool accepted = false;
 
     sc->input_buf_len = 0;
     sc->input_buf_index = 0;
 
-    rcs_bitmap_clear_all(sc->states_bm[0], sc->states_bm_len);
-    rcs_bitmap_clear_all(sc->states_bm[1], sc->states_bm_len);
+    clear_states(sc, 0);
+    clear_states(sc, 1);
     // activate source states
+    // source could also be accepting
     for (size_t i = 0; i < sc->nfa->sources_len; ++i) {
-        const struct rcs_nfa_state *src = sc->nfa->sources[i];
-        if (rcs_nfa_state_is_accept(src)) {
-            // source could also be accepting
-            // remember that accept state is epsilon, so we don't add it to active states
-            accepted_last_step = true;
-        } else {
-            has_active_states = true;
-            rcs_bitmap_set(sc->states_bm[0], sc->nfa->sources[i] - sc->nfa->states);
-        }
+        if (activate_state(sc, 0, sc->nfa->sources[i] - sc->nfa->states))
+            accepted = true;
     }
 
     while (true) {
         int c_or_eof = read_char(sc, reader);
         if (c_or_eof < 0) {
-            *out_ok = accepted_last_step;
+            *out_ok = accepted;
             break;
         }
 
-        if (!has_active_states) {
+        if (sc->states_list_len[0] == 0) {
             // no EOF, but nfa is in sink
             *out_ok = false;
             break;
         }
 
-        uint8_t c = c_or_eof;
-
-        accepted_last_step = false;
-        has_active_states = false;
-
-        for (size_t i = 0; i < sc->nfa->states_len; ++i) {
-            const struct rcs_nfa_state *state = &sc->nfa->states[i];
-
-            if (!rcs_bitmap_get(sc->states_bm[0], i))
-                continue;
-
-            assert(!rcs_nfa_state_is_accept(state) && "unexpected accept state");
-            assert(!rcs_nfa_state_is_epsilon(state) && "unexpected epsilon state");
+        accepted = sparse_step(sc, sc->classes->map[c_or_eof]);
+        swap_states(sc);
+    }
 
-            if (!state_matches_char(state, c))
-                continue;
+    return RCS_OK;
+}
 
-            for (size_t j = 0; j < state->next_len; ++j) {
-                if (rcs_nfa_state_is_accept(state->next[j])) {
-                    accepted_last_step = true;
-                } else {
-                    rcs_bitmap_set(sc->states_bm[1], state->next[j] - sc->nfa->states);
-                    has_active_states = true;
-                }
-            }
+bool rcs_standard_feed(
+    struct rcs_standard_scanner *sc,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    size_t len
+) {
+    clear_states(sc, 0);
+    clear_states(sc, 1);
+    memcpy(sc->states_bm[0], states_bm, sc->states_bm_len * sizeof(*states_bm));
+    for (size_t w = 0; w < RCS_BITMAP_LEN_WORDS(sc->nfa->states_len); ++w) {
+        for (rcs_bitmap_word word = states_bm[w]; word != 0; word &= word - 1) {
+            size_t state_i = w * RCS_BITMAP_WORD_BIT_WIDTH + rcs_bitmap_word_ctz(word);
+            sc->states_list[0][sc->states_list_len[0]++] = state_i;
         }
+    }
 
-        rcs_bitmap_clear_all(sc->states_bm[0], sc->states_bm_len);
-        // swap
-        rcs_bitmap_word *tmp = sc->states_bm[0];
-        sc->states_bm[0] = sc->states_bm[1];
-        sc->states_bm[1] = tmp;
+    bool accepted = false;
+    for (size_t i = 0; i < len; ++i) {
+        if (sc->states_list_len[0] == 0) {
+            // sinked before the last byte
+            accepted = false;
+            break;
+        }
+        accepted = sparse_step(sc, sc->classes->map[buf[i]]);
+        swap_states(sc);
     }
 
-    return RCS_OK;
+    memcpy(states_bm, sc->states_bm[0], sc->states_bm_len * sizeof(*states_bm));
+    return accepted;
 }
 
 void rcs_standard_scanner_free(struct rcs_standard_scanner *scanner) {
-    free(scanner->states_bm[0]);
-    free(scanner->states_bm[1]);
-    scanner->states_bm[0] = scanner->states_bm[1] = NULL;
+    for (size_t i = 0; i < 2; ++i) {
+        free(scanner->states_bm[i]);
+        free(scanner->states_list[i]);
+        scanner->states_bm[i] = NULL;
+        scanner->states_list[i] = NULL;
+    }
 }
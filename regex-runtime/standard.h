@@ -3,23 +3,39 @@
 
 #include "api.h"
 #include "bitmap.h"
+#include "classes.h"
+#include "counters.h"
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
+// Active states are kept in a sparse set: a list for the iteration and a bitmap for the membership
+// test, so each step costs O(active states) regardless of the NFA size.
 struct rcs_standard_scanner {
     const struct rcs_nfa *nfa;
+    const struct rcs_byte_classes *classes;
+    const struct rcs_counters *counters;
 
+    // Configurations with the counter values, see `rcs_counters`.
     // 0 is the current, 1 is the next
     // swap on each wave
     rcs_bitmap_word *states_bm[2];
     size_t states_bm_len;
 
+    // Indexes of the active non-accepting states, same as in `states_bm`.
+    size_t *states_list[2];
+    size_t states_list_len[2];
+
     size_t input_buf_len;
     size_t input_buf_index;
 };
 
-rcs_error
-rcs_standard_scanner_init(struct rcs_standard_scanner *scanner, const struct rcs_nfa *nfa);
+rcs_error rcs_standard_scanner_init(
+    struct rcs_standard_scanner *scanner,
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters
+);
 
 rcs_error rcs_standard_match(
     rcs_api_bool *out_ok,
@@ -27,6 +43,30 @@ rcs_error rcs_standard_match(
     const struct rcs_reader *reader
 );
 
+// Advances the stream context configuration `states_bm` (accepting state excluded) by `buf`.
+// Returns true if the accepting state was reached by the last byte.
+bool rcs_standard_feed(
+    struct rcs_standard_scanner *scanner,
+    rcs_bitmap_word *states_bm,
+    const uint8_t *buf,
+    size_t len
+);
+
+// Activates states reachable from `cur` by a char of class `class_i` in `next`.
+// `cur` and `next` are configurations of `counters`, which may be NULL if the NFA has no counting
+// states. `next` must be cleared before the call.
+// The bit of `nfa->accept` in `next` is set if the accepting state was reached.
+// It's ignored in `cur`.
+// Returns true if at least one non-accepting state was activated.
+bool rcs_standard_step(
+    const struct rcs_nfa *nfa,
+    const struct rcs_byte_classes *classes,
+    const struct rcs_counters *counters,
+    const rcs_bitmap_word *cur,
+    rcs_bitmap_word *next,
+    size_t class_i
+);
+
 // Does not free the scanner struct itself, only its inner buffers.
 void rcs_standard_scanner_free(struct rcs_standard_scanner *scanner);
 
@@ -0,0 +1,20 @@
+// sysconf(_SC_NPROCESSORS_ONLN) is not in POSIX.
+#define _DEFAULT_SOURCE
+
+#include "workers.h"
+#include <unistd.h>
+
+#define MAX_WORKERS 64
+
+size_t rcs_workers_number(rcs_api_size requested, uint64_t len, uint64_t min_chunk_len) {
+    size_t n = requested;
+    if (n == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        n = cpus > 0 ? cpus : 1;
+    }
+    if (n > MAX_WORKERS)
+        n = MAX_WORKERS;
+    if (n > len / min_chunk_len)
+        n = len / min_chunk_len;
+    return n == 0 ? 1 : n;
+}
@@ -0,0 +1,12 @@
+#ifndef REGEX_CS_RUNTIME_WORKERS
+#define REGEX_CS_RUNTIME_WORKERS
+
+#include "api.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of threads to split an input of `len` bytes between, at least 1.
+// `requested` 0 means the number of CPUs. Each thread gets at least `min_chunk_len` bytes.
+size_t rcs_workers_number(rcs_api_size requested, uint64_t len, uint64_t min_chunk_len);
+
+#endif
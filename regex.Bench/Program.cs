@@ -0,0 +1,177 @@
+// Benchmark of the full CompiledRegex path: parsing and optimization on compile, marshalling and
+// reader callbacks on match. Complements `make bench` in regex-runtime, which measures the native
+// backends alone on the same kind of corpus.
+//
+// Prints JSON with the results of each case on each backend and API.
+// Usage: dotnet run -c Release --project regex.Bench [substring of the case names to run]
+
+using System.Diagnostics;
+using System.Text;
+using System.Text.Json;
+using Regex;
+using Regex.Runtime;
+
+const int MatchRuns = 5;
+const int CompileRuns = 9;
+const int MiB = 1024 * 1024;
+
+var filter = args.Length > 0 ? args[0] : "";
+var cases = new (string name, string pattern, Func<Random, List<byte[]>> generate)[]
+{
+    ("nested_star", "(a*)*bz", _ => [Encoding.ASCII.GetBytes(new string('a', 16 * MiB - 1) + "z")]),
+    ("exponential_dfa", "(a|b)*a(a|b){20}", rnd => [RandomBytes(rnd, 4 * MiB, "ab")]),
+    (
+        "log_lines",
+        @"[0-9]+-[0-9]+-[0-9]+ [0-9:.]+ (WARN|ERROR) [a-z]+\.[a-z]+: .*timeout.*",
+        rnd => Enumerable.Range(0, 200_000).Select(_ => Encoding.ASCII.GetBytes(LogLine(rnd))).ToList()
+    ),
+    (
+        "short_tokens",
+        "0|0x[0-9a-f]+|[1-9][0-9]*|[a-z_][a-z0-9_]*",
+        rnd => Enumerable.Range(0, 1_000_000).Select(_ => Encoding.ASCII.GetBytes(Token(rnd))).ToList()
+    ),
+    ("large_log_file", @".*ERROR [a-z]+\.[a-z]+: timeout.*", rnd => [LargeLog(rnd, 64 * MiB)]),
+};
+
+var results = new List<Result>();
+for (int i = 0; i < cases.Length; ++i)
+{
+    var (name, pattern, generate) = cases[i];
+    if (!name.Contains(filter))
+        continue;
+
+    // each case has its own seed, so its corpus doesn't depend on the filter
+    var inputs = generate(new Random(i + 1));
+    long bytes = inputs.Sum(input => (long)input.Length);
+
+    foreach (var backend in Enum.GetValues<Backend>())
+    {
+        var options = new ScannerOptions(backend);
+        var compileNs = new long[CompileRuns];
+        CompiledRegex regex;
+        try
+        {
+            for (int run = 0; run < CompileRuns; ++run)
+            {
+                var sw = Stopwatch.StartNew();
+                using var compiled = new CompiledRegex(pattern, options);
+                compileNs[run] = (long)sw.Elapsed.TotalNanoseconds;
+            }
+            regex = new CompiledRegex(pattern, options);
+        }
+        catch (NativeAPIException e)
+        {
+            results.Add(new Result(name, pattern, backend.ToString(), Error: e.Message));
+            continue;
+        }
+        Array.Sort(compileNs);
+
+        using (regex)
+        {
+            Result Measure(string api, Func<int> run)
+            {
+                long bestNs = long.MaxValue;
+                int matched = 0;
+                for (int k = 0; k < MatchRuns; ++k)
+                {
+                    var sw = Stopwatch.StartNew();
+                    matched = run();
+                    bestNs = Math.Min(bestNs, (long)sw.Elapsed.TotalNanoseconds);
+                }
+                return new Result(name, pattern, backend.ToString(), api)
+                {
+                    Inputs = inputs.Count,
+                    InputBytes = bytes,
+                    Matched = matched,
+                    CompileNs = compileNs[CompileRuns / 2],
+                    NsPerMatch = (double)bestNs / inputs.Count,
+                    // MB are 10^6 bytes, like in the most of the published regex benchmarks
+                    MbPerS = bestNs == 0 ? 0 : bytes * 1e3 / bestNs,
+                };
+            }
+
+            results.Add(Measure("span", () => inputs.Count(input => regex.Match(input.AsSpan()))));
+            results.Add(Measure("reader", () => inputs.Count(input => regex.Match(new ByteArrayReader(input)))));
+            if (inputs.Count > 1)
+                results.Add(Measure("batch", () => regex.MatchBatch(inputs).Count(ok => ok)));
+        }
+    }
+}
+
+var json = new JsonSerializerOptions
+{
+    WriteIndented = true,
+    PropertyNamingPolicy = JsonNamingPolicy.SnakeCaseLower,
+    DefaultIgnoreCondition = System.Text.Json.Serialization.JsonIgnoreCondition.WhenWritingNull,
+    // keeps the patterns readable
+    Encoder = System.Text.Encodings.Web.JavaScriptEncoder.UnsafeRelaxedJsonEscaping,
+};
+Console.WriteLine(JsonSerializer.Serialize(new { MatchRuns, CompileRuns, Results = results }, json));
+
+static byte[] RandomBytes(Random rnd, int len, string alphabet)
+{
+    var bytes = new byte[len];
+    for (int i = 0; i < len; ++i)
+        bytes[i] = (byte)alphabet[rnd.Next(alphabet.Length)];
+    return bytes;
+}
+
+static string Number(Random rnd, int digits)
+{
+    return string.Concat(Enumerable.Range(0, digits).Select(_ => (char)('0' + rnd.Next(10))));
+}
+
+static string Word(Random rnd, int maxLen)
+{
+    return string.Concat(Enumerable.Range(0, 1 + rnd.Next(maxLen)).Select(_ => (char)('a' + rnd.Next(26))));
+}
+
+static string LogLine(Random rnd)
+{
+    string[] levels = ["INFO", "INFO", "INFO", "WARN", "ERROR"];
+    string[] messages = ["request served", "cache miss", "timeout", "retrying"];
+    var sb = new StringBuilder();
+    sb.Append($"2024-{Number(rnd, 2)}-{Number(rnd, 2)} ");
+    sb.Append($"{Number(rnd, 2)}:{Number(rnd, 2)}:{Number(rnd, 2)}.{Number(rnd, 3)} ");
+    sb.Append($"{levels[rnd.Next(levels.Length)]} {Word(rnd, 8)}.{Word(rnd, 8)}: ");
+    sb.Append($"{messages[rnd.Next(messages.Length)]} code {Number(rnd, 1 + rnd.Next(4))}");
+    for (int i = rnd.Next(6); i > 0; --i)
+        sb.Append(' ').Append(Word(rnd, 10));
+    return sb.ToString();
+}
+
+// Identifiers and numbers in decimal and hex.
+static string Token(Random rnd)
+{
+    return rnd.Next(3) switch
+    {
+        0 => Word(rnd, 12),
+        1 => (char)('1' + rnd.Next(9)) + Number(rnd, rnd.Next(8)),
+        _ => "0x" + string.Concat(Enumerable.Range(0, 1 + rnd.Next(8)).Select(_ => "0123456789abcdefg"[rnd.Next(17)])),
+    };
+}
+
+// The whole log is a single input, like a file matched by MatchFile().
+static byte[] LargeLog(Random rnd, int len)
+{
+    var sb = new StringBuilder(len + 256);
+    while (sb.Length < len)
+        sb.Append(LogLine(rnd)).Append('\n');
+    return Encoding.ASCII.GetBytes(sb.ToString());
+}
+
+record Result(
+    string Case,
+    string Pattern,
+    string Backend,
+    string? Api = null,
+    string? Error = null
+)
+{
+    public int? Inputs { get; init; }
+    public long? InputBytes { get; init; }
+    public int? Matched { get; init; }
+    public long? CompileNs { get; init; }
+    public double? NsPerMatch { get; init; }
+    public double? MbPerS { get; init; }
+}
@@ -71,9 +71,11 @@ public class UnitTest1
         bool reuseCompiled,
         string dotNetRe,
         IEnumerable<char> alphabet,
-        int maxWordLen)
+        int maxWordLen,
+        ScannerOptions? options = null)
     {
-        var cre = new CompiledRegex(re);
+        options ??= new ScannerOptions();
+        var cre = new CompiledRegex(re, options);
 
         var dotNetCRe = new System.Text.RegularExpressions.Regex(dotNetRe);
 
@@ -81,7 +83,7 @@ public class UnitTest1
         foreach (var w in lang.Words())
         {
             if (!reuseCompiled)
-                cre = new CompiledRegex(re);
+                cre = new CompiledRegex(re, options);
 
 
             var ws = System.Text.Encoding.UTF8.GetString(w);
@@ -122,4 +124,751 @@ public class UnitTest1
             maxWordLen
         );
     }
+
+    [Theory]
+    [InlineData("a{3}")]
+    [InlineData("(a|bc){2,}")]
+    [InlineData("(ab?){1,3}c")]
+    [InlineData("a{0,2}b{2}")]
+    [InlineData("(a{2}){2,3}")]
+    [InlineData("(c{0}|a){1,}b?")]
+    [InlineData("\\{a}")]
+    [InlineData("a{b|{a}")]
+    [InlineData("a{,2}b{")]
+    public void TestRepetitionOnKleeneClosure(string re)
+    {
+        CompareWithDotNETRegexOnKleeneClosure(re, true, $"^({re})$", ['a', 'b', 'c', '{', '}'], 7);
+    }
+
+    [Fact]
+    public void TestRepetition()
+    {
+        Assert.Throws<ParsingException>(() => new CompiledRegex("a{2,1}"));
+        Assert.Throws<ParsingException>(() => new CompiledRegex("a{2}{3}"));
+        Assert.Throws<ParsingException>(() => new CompiledRegex("{2}"));
+        Assert.Throws<ParsingException>(() => new CompiledRegex("a{1001}"));
+        Assert.Throws<ParsingException>(() => new CompiledRegex("a{1,99999999999}"));
+        Assert.Throws<ParsingException>(() => new CompiledRegex("((a{1000}){1000}){1000}"));
+
+        // a brace that doesn't start a quantifier is a literal
+        Assert.True(new CompiledRegex("a{b").Match("a{b"u8.ToArray()));
+        Assert.True(new CompiledRegex("{x}").Match("{x}"u8.ToArray()));
+        Assert.True(new CompiledRegex("a{1").Match("a{1"u8.ToArray()));
+        Assert.True(new CompiledRegex("a{").Match("a{"u8.ToArray()));
+
+        // a single counting state, not 1000 states
+        var field = new CompiledRegex("[0-9]{1,1000}");
+        Assert.True(field.Match(System.Text.Encoding.ASCII.GetBytes(new string('7', 1000))));
+        Assert.False(field.Match(System.Text.Encoding.ASCII.GetBytes(new string('7', 1001))));
+        Assert.False(field.Match([]));
+
+        // the last repetition sets the group
+        var groups = new CompiledRegex("(a|b){3}").MatchCaptures("abb"u8.ToArray());
+        Assert.NotNull(groups);
+        Assert.Equal((2UL, 3UL), groups[1]);
+    }
+
+    [Theory]
+    [InlineData(Backend.Standard)]
+    [InlineData(Backend.LazyDFA)]
+    [InlineData(Backend.BitParallel)]
+    public void TestCounters(Backend backend)
+    {
+        var options = new ScannerOptions(backend);
+        foreach (var re in new[] { "[ab]{2,4}", "a{3,}b?", "(x[ab]{1,3})*", "[ab]*a[ab]{3}", "(a{2,3}b?)+", "x{0,2}a{2}" })
+            CompareWithDotNETRegexOnKleeneClosure(re, true, $"^({re})$", ['a', 'b', 'x'], 8, options);
+
+        // the values of a counter span several words
+        foreach (var re in new[] { "a{62,66}", "a{65,}", "(a{64}b)+" })
+        {
+            using var regex = new CompiledRegex(re, options);
+            var dotNet = new System.Text.RegularExpressions.Regex($"^({re})$");
+            for (int n = 60; n <= 70; ++n)
+                foreach (var input in new[] { new string('a', n), new string('a', n) + "b", "b" + new string('a', n) })
+                {
+                    var bytes = System.Text.Encoding.ASCII.GetBytes(input);
+                    Assert.True(dotNet.IsMatch(input) == regex.Match(bytes), $"'{re}' on '{input}'");
+
+                    var stream = regex.BeginStream();
+                    stream.Feed(bytes.AsSpan(0, bytes.Length / 2));
+                    stream.Clone().Feed(bytes.AsSpan(bytes.Length / 2));
+                    stream.Feed(bytes.AsSpan(bytes.Length / 2));
+                    Assert.Equal(regex.Match(bytes), stream.End());
+                }
+        }
+
+        // search, early and reverse matches run on the unrolled counters
+        using var number = new CompiledRegex("x[0-9]{2,4}", options);
+        Assert.Equal((6UL, 11UL), number.Search("ab x1 x123456"u8.ToArray()));
+        Assert.Equal((true, 5UL), number.MatchEarly("x1234"u8.ToArray(), MatchMode.UntilDecided));
+        Assert.Equal((false, 5UL), number.MatchEarly("x12345"u8.ToArray(), MatchMode.UntilDecided));
+        Assert.Equal((true, 3UL), number.MatchEarly("x12345"u8.ToArray(), MatchMode.Prefix));
+        Assert.True(number.MatchReverse("x123"u8.ToArray(), MatchMode.UntilDecided).ok);
+        Assert.False(number.MatchReverse("y123"u8.ToArray(), MatchMode.UntilDecided).ok);
+    }
+
+    [Fact]
+    public void TestCountersUnsupportedByJIT()
+    {
+        Assert.Throws<Regex.Runtime.NativeAPIException>(
+            () => new CompiledRegex("[0-9]{2,5}", new ScannerOptions(Backend.JIT))
+        );
+        // a counter is a single state, so it fits the bit-parallel limit
+        var re = new CompiledRegex("[0-9]{1,1000}x", new ScannerOptions(Backend.BitParallel));
+        Assert.True(re.Match(System.Text.Encoding.ASCII.GetBytes(new string('7', 1000) + "x")));
+        Assert.False(re.Match(System.Text.Encoding.ASCII.GetBytes(new string('7', 1001) + "x")));
+    }
+
+    [Theory]
+    [InlineData(Backend.Standard)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.LazyDFA)]
+    [InlineData(Backend.BitParallel)]
+    public void TestBackendsOnKleeneClosure(Backend backend)
+    {
+        var options = new ScannerOptions(backend);
+        CompareWithDotNETRegexOnKleeneClosure(
+            @"[^a1]|a*", true, @"^([^a1]|a*)$", ['a', '1', ' '], 8, options
+        );
+        CompareWithDotNETRegexOnKleeneClosure(
+            @"[01]+1[01][01]", true, @"^([01]+1[01][01])$", ['0', '1', 'z'], 8, options
+        );
+        CompareWithDotNETRegexOnKleeneClosure(
+            @"(a|bc)+z", true, @"^(a|bc)+z$", ['a', 'b', 'c'], 8, options
+        );
+    }
+
+    [Fact]
+    public void TestLazyDFACacheOverflow()
+    {
+        // (a|b)*a(a|b){6} has 2^7 DFA states, so the smallest cache is flushed all the time.
+        var re = new CompiledRegex(
+            "(a|b)*a(a|b)(a|b)(a|b)(a|b)(a|b)(a|b)",
+            new ScannerOptions(Backend.LazyDFA, DfaCacheSize: 1)
+        );
+        var dotNetRe = new System.Text.RegularExpressions.Regex("^(a|b)*a(a|b){6}$");
+
+        var rand = new Random(42);
+        for (int i = 0; i < 200; ++i)
+        {
+            var w = new byte[rand.Next(0, 300)];
+            for (int j = 0; j < w.Length; ++j)
+                w[j] = (byte)(rand.Next(2) == 0 ? 'a' : 'b');
+
+            var ws = System.Text.Encoding.ASCII.GetString(w);
+            Assert.True(dotNetRe.IsMatch(ws) == re.Match(w), ws);
+        }
+    }
+
+    /// <summary>
+    /// Expected search result is found by brute force: leftmost start, then longest end.
+    /// </summary>
+    private void CompareSearchWithDotNETRegexOnKleeneClosure(
+        string re,
+        IEnumerable<char> alphabet,
+        int maxWordLen)
+    {
+        var cre = new CompiledRegex(re);
+        var dotNetCRe = new System.Text.RegularExpressions.Regex($"^({re})$");
+
+        var lang = new AlphabetKleeneClosure(alphabet.Select(c => (byte)c), maxWordLen);
+        foreach (var w in lang.Words())
+        {
+            var ws = System.Text.Encoding.UTF8.GetString(w);
+
+            (ulong start, ulong end)? expected = null;
+            for (int start = 0; start <= ws.Length && expected == null; ++start)
+                for (int end = ws.Length; end >= start && expected == null; --end)
+                    if (dotNetCRe.IsMatch(ws[start..end]))
+                        expected = ((ulong)start, (ulong)end);
+
+            Assert.True(expected == cre.Search(w), $"'{re}' on '{ws}'");
+        }
+    }
+
+    [Fact]
+    public void TestSearch()
+    {
+        CompareSearchWithDotNETRegexOnKleeneClosure("ab+", ['a', 'b', 'c'], 7);
+        CompareSearchWithDotNETRegexOnKleeneClosure("a*", ['a', 'b'], 7);
+        CompareSearchWithDotNETRegexOnKleeneClosure("(a|bc)+z", ['a', 'b', 'c', 'z'], 6);
+        CompareSearchWithDotNETRegexOnKleeneClosure("[01]+1[01]", ['0', '1', 'z'], 7);
+
+        var re = new CompiledRegex("ERROR [0-9]+");
+        var input = System.Text.Encoding.ASCII.GetBytes("INFO 1\nWARN 2\nERROR 345\nERROR 6\n");
+        Assert.Equal(((ulong)14, (ulong)23), re.Search(input));
+        Assert.Null(re.Search(System.Text.Encoding.ASCII.GetBytes("INFO 1\nERROR x\n")));
+    }
+
+    [Theory]
+    [InlineData(Backend.Standard)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.LazyDFA)]
+    [InlineData(Backend.BitParallel)]
+    public void TestManyByteClasses(Backend backend)
+    {
+        // every letter and digit is a separate byte class
+        var chars = "abcdefghijklmnopqrstuvwxyz0123456789ABCDEF";
+        var re = new CompiledRegex($"[{chars}]([{chars[..20]}]|[^{chars[10..]}])", new ScannerOptions(backend));
+        for (int c1 = 0; c1 < 256; ++c1)
+            for (int c2 = 0; c2 < 256; c2 += 7)
+            {
+                bool expected = chars.Contains((char)c1)
+                    && (chars[..20].Contains((char)c2) || !chars[10..].Contains((char)c2));
+                Assert.True(expected == re.Match([(byte)c1, (byte)c2]), $"{c1:x} {c2:x}");
+            }
+    }
+
+    [Fact]
+    public void TestJITLongClasses()
+    {
+        // letters and digits are separate byte classes, and the last class is a lot of ranges
+        var chars = "abcdefghijklmnopqrstuvwxyz0123456789ABCDEF";
+        var evenChars = string.Concat(chars.Where((_, i) => i % 2 == 0));
+        var pattern = $"({string.Join('|', chars.ToCharArray())})[{evenChars}]*";
+        var jit = new CompiledRegex(pattern, new ScannerOptions(Backend.JIT));
+        var standard = new CompiledRegex(pattern, new ScannerOptions(Backend.Standard));
+
+        var rnd = new Random(1);
+        for (int i = 0; i < 1000; ++i)
+        {
+            var input = Enumerable.Range(0, rnd.Next(1, 8)).Select(_ => (byte)chars[rnd.Next(chars.Length)]).ToArray();
+            Assert.Equal(standard.Match(input), jit.Match(input));
+        }
+        Assert.True(jit.Match(System.Text.Encoding.ASCII.GetBytes("bacegikmoqsuwy02468ACE")));
+    }
+
+    [Theory]
+    [InlineData("key=[^;]*;value")]
+    [InlineData("[^;]*")]
+    [InlineData("a.*")]
+    [InlineData("k(a|b)*[^x]*;")]
+    public void TestJITSkipLoops(string pattern)
+    {
+        // long runs of bytes that don't change the active states
+        var jit = new CompiledRegex(pattern, new ScannerOptions(Backend.JIT));
+        var standard = new CompiledRegex(pattern, new ScannerOptions(Backend.Standard));
+
+        var rnd = new Random(1);
+        var fillers = "xyzab=";
+        for (int i = 0; i < 2000; ++i)
+        {
+            var sb = new System.Text.StringBuilder(rnd.Next(2) == 0 ? "key=" : "k");
+            int len = rnd.Next(80);
+            for (int j = 0; j < len; ++j)
+                sb.Append(rnd.Next(40) == 0 ? ';' : fillers[rnd.Next(fillers.Length)]);
+            if (rnd.Next(2) == 0)
+                sb.Append(";value");
+
+            var input = System.Text.Encoding.ASCII.GetBytes(sb.ToString());
+            Assert.True(standard.Match(input) == jit.Match(input), sb.ToString());
+        }
+    }
+
+    [Theory]
+    [InlineData(@".*ERROR [0-9]+.*", "ERROR ")]
+    [InlineData(@"(a|b)*abc(d|e)", "abc")]
+    [InlineData(@"x(abc|abd)y", "xab")]
+    [InlineData(@"(abc|abd)", "ab")]
+    [InlineData(@"a*", "")]
+    public void TestRequiredLiteral(string regex, string literal)
+    {
+        var nfa = Regex.NFA.Optimizer.Optimize(RegexParser.WithDefaultBuiltinClasses().Convert(regex));
+        Assert.Equal(literal, System.Text.Encoding.ASCII.GetString(Regex.NFA.Optimizer.RequiredLiteral(nfa)));
+    }
+
+    [Theory]
+    [InlineData(@"GET /a|GET /b|GET /c", 9)]
+    [InlineData(@"a.*x|b.*x", 5)]
+    [InlineData(@"(ab|cb)*", 4)]
+    public void TestReduce(string regex, int states)
+    {
+        var nfa = Regex.NFA.Optimizer.Optimize(RegexParser.WithDefaultBuiltinClasses().Convert(regex));
+        Assert.Equal(states, nfa.States.Count);
+    }
+
+    [Fact]
+    public void TestReduceKeepsCaptures()
+    {
+        // prefixes of the alternatives are merged, but the group still spans the whole of them
+        using var re = new CompiledRegex(@"(abc|abd)(x|y)*");
+        var groups = re.MatchCaptures("abdxy"u8.ToArray());
+        Assert.NotNull(groups);
+        Assert.Equal((0UL, 3UL), groups[1]);
+        Assert.Equal((4UL, 5UL), groups[2]);
+        Assert.Null(re.MatchCaptures("abex"u8.ToArray()));
+    }
+
+    [Theory]
+    [InlineData(Backend.Standard)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.LazyDFA)]
+    public void TestRequiredLiteralFilter(Backend backend)
+    {
+        var re = new CompiledRegex(@".*ERROR [0-9]+.*", new ScannerOptions(backend));
+        Assert.True(re.Match(System.Text.Encoding.ASCII.GetBytes("12:00 ERROR 42 disk is full")));
+        Assert.True(re.Match(System.Text.Encoding.ASCII.GetBytes("ERROR 1")));
+        Assert.False(re.Match(System.Text.Encoding.ASCII.GetBytes("12:00 ERROR disk is full")));
+        Assert.False(re.Match(System.Text.Encoding.ASCII.GetBytes("12:00 WARNING 42 disk is full")));
+        Assert.False(re.Match(System.Text.Encoding.ASCII.GetBytes("ERRO")));
+        Assert.Equal(((ulong)0, (ulong)14), re.Search(System.Text.Encoding.ASCII.GetBytes("12:00 ERROR 42")));
+        Assert.Null(re.Search(System.Text.Encoding.ASCII.GetBytes("12:00 WARNING 42")));
+    }
+
+    [Fact]
+    public void TestRegexSet()
+    {
+        string[] patterns = ["(a|b)*abb", "a*", "[a-c]+", "b(a|c)*", "(a|b)*a(a|b)(a|b)", "abc", "[ab]{2,4}c?", "a{3,}"];
+        var set = new RegexSet(patterns);
+        var regexes = patterns.Select(p => new CompiledRegex(p)).ToArray();
+
+        var lang = new AlphabetKleeneClosure("abc".Select(c => (byte)c), 6);
+        foreach (var w in lang.Words())
+        {
+            var matched = set.Match(w);
+            for (int i = 0; i < patterns.Length; ++i)
+                Assert.True(regexes[i].Match(w) == matched[i], $"{patterns[i]} {System.Text.Encoding.ASCII.GetString(w)}");
+        }
+    }
+
+    [Fact]
+    public void TestRegexSetManyPatterns()
+    {
+        // more patterns than bits in a word
+        var patterns = Enumerable.Range(0, 100).Select(i => $"k{i}=[0-9]*").ToArray();
+        var set = new RegexSet(patterns, new ScannerOptions(Backend.LazyDFA));
+        var matched = set.Match(System.Text.Encoding.ASCII.GetBytes("k73=42"));
+        for (int i = 0; i < patterns.Length; ++i)
+            Assert.Equal(i == 73, matched[i]);
+
+        Assert.Throws<Regex.Runtime.NativeAPIException>(
+            () => new RegexSet(patterns, new ScannerOptions(Backend.JIT))
+        );
+    }
+
+    [Theory]
+    [InlineData(Backend.BitParallel)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.LazyDFA)]
+    public void TestMatchBatch(Backend backend)
+    {
+        var regex = new CompiledRegex("(a|b)*a(a|b)c?", new ScannerOptions(backend));
+        var lang = new AlphabetKleeneClosure("abc".Select(c => (byte)c), 7);
+        // different lengths, so the lanes are retired at different steps
+        var inputs = lang.Words().Select(w => w.ToArray()).ToArray();
+
+        var results = regex.MatchBatch(inputs);
+        Assert.Equal(inputs.Length, results.Length);
+        for (int i = 0; i < inputs.Length; ++i)
+            Assert.Equal(regex.Match(inputs[i]), results[i]);
+
+        Assert.Empty(regex.MatchBatch([]));
+        var mixed = regex.MatchBatch(["aa"u8.ToArray(), []]);
+        Assert.True(mixed[0]);
+        Assert.False(mixed[1]);
+    }
+
+    [Theory]
+    [InlineData(Backend.BitParallel)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.LazyDFA)]
+    [InlineData(Backend.Standard)]
+    public unsafe void TestMatchBuffer(Backend backend)
+    {
+        var regex = new CompiledRegex(".*ERROR [0-9]+", new ScannerOptions(backend));
+        var bytes = "xx: ERROR 42; ERROR 7"u8.ToArray();
+
+        Assert.True(regex.Match(bytes));
+        Assert.True(regex.Match(bytes.AsSpan(0, 12)));
+        Assert.False(regex.Match(bytes.AsSpan(0, 13)));
+        Assert.True(regex.Match(new ReadOnlyMemory<byte>(bytes, 4, 8)));
+        Assert.False(regex.Match(ReadOnlySpan<byte>.Empty));
+        fixed (byte* ptr = bytes)
+        {
+            Assert.True(regex.Match(ptr + 4, 8));
+            Assert.False(regex.Match(ptr + 4, 5));
+        }
+    }
+
+    [Theory]
+    [InlineData(Backend.BitParallel, 1)]
+    [InlineData(Backend.JIT, 1)]
+    [InlineData(Backend.LazyDFA, 1)]
+    [InlineData(Backend.Standard, 1)]
+    // JIT keeps the states in the memory
+    [InlineData(Backend.JIT, 300)]
+    [InlineData(Backend.LazyDFA, 300)]
+    public void TestStream(Backend backend, int n)
+    {
+        var regex = new CompiledRegex(
+            $"(a|b)*a(a|b)c?|({string.Concat(Enumerable.Repeat("(a|b)", n))})*",
+            new ScannerOptions(backend)
+        );
+        var lang = new AlphabetKleeneClosure("abc".Select(c => (byte)c), 5);
+        foreach (var w in lang.Words())
+        {
+            var word = w.ToArray();
+            bool expected = regex.Match(word);
+            for (int split = 0; split <= word.Length; ++split)
+            {
+                var stream = regex.BeginStream();
+                stream.Feed(word.AsSpan(0, split));
+                stream.Feed(word.AsSpan(split));
+                Assert.Equal(expected, stream.End());
+            }
+        }
+
+        var parked = regex.BeginStream();
+        parked.Feed("ba"u8);
+        var resumed = parked.Clone();
+        resumed.Feed("b"u8);
+        Assert.True(resumed.End());
+        resumed.Feed("cc"u8);
+        Assert.False(resumed.End());
+        parked.Feed("ac"u8);
+        Assert.True(parked.End());
+    }
+
+    [Theory]
+    [InlineData(Backend.Auto)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.Standard)]
+    public void TestMatchFile(Backend backend)
+    {
+        var regex = new CompiledRegex(".*ERROR [0-9]+.*", new ScannerOptions(backend));
+        var path = Path.GetTempFileName();
+        try
+        {
+            Assert.False(regex.MatchFile(path));
+
+            var lines = Enumerable.Range(0, 100000).Select(i => $"line {i}: OK");
+            File.WriteAllLines(path, lines);
+            Assert.False(regex.MatchFile(path));
+            using (var reader = new Regex.Runtime.FileReader(path, 4096))
+                Assert.False(regex.Match(reader));
+
+            ulong errorPos = (ulong)new FileInfo(path).Length;
+            File.AppendAllText(path, "ERROR 42\n");
+            Assert.True(regex.MatchFile(path));
+            using (var reader = new Regex.Runtime.FileReader(path, 4096))
+                Assert.True(regex.Match(reader));
+            using (var reader = new Regex.Runtime.FileReader(path, 4096))
+                Assert.Equal((errorPos, errorPos + 8), new CompiledRegex("ERROR [0-9]+").Search(reader));
+        }
+        finally
+        {
+            File.Delete(path);
+        }
+
+        Assert.Throws<Regex.Runtime.NativeAPIException>(() => regex.MatchFile(path));
+    }
+
+    [Theory]
+    [InlineData(Backend.Auto, "[a-z]+=[0-9]+")]
+    [InlineData(Backend.Standard, "[a-z]+=[0-9]+")]
+    [InlineData(Backend.LazyDFA, "[a-z]+=[0-9]+")]
+    // lines without the required literal are skipped
+    [InlineData(Backend.Auto, ".*ERROR [0-9]+.*")]
+    [InlineData(Backend.JIT, ".*ERROR [0-9]+.*")]
+    public void TestGrep(Backend backend, string pattern)
+    {
+        var regex = new CompiledRegex(pattern, new ScannerOptions(backend));
+        var rnd = new Random(1);
+        var choices = new[] { "key=42", "ERROR 7", "x: ERROR 12 y", "ERROR", "", "a=", "=1", "b=2c" };
+        // big enough to be split between threads
+        var lines = Enumerable.Range(0, 300000).Select(i => choices[rnd.Next(choices.Length)]).ToArray();
+        var input = System.Text.Encoding.ASCII.GetBytes(string.Join("\n", lines));
+
+        var expected = new List<ulong>();
+        ulong offset = 0;
+        foreach (var line in lines)
+        {
+            if (regex.Match(System.Text.Encoding.ASCII.GetBytes(line)))
+                expected.Add(offset);
+            offset += (ulong)line.Length + 1;
+        }
+
+        foreach (int threads in new[] { 1, 4 })
+        {
+            Assert.Equal(expected, regex.Grep(input, threads));
+            Assert.Equal((ulong)expected.Count, regex.GrepCount(input, threads));
+        }
+        Assert.Empty(regex.Grep([]));
+    }
+
+    [Theory]
+    [InlineData(Backend.Auto)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.LazyDFA)]
+    public void TestMatchParallel(Backend backend)
+    {
+        // big enough for 3 chunks
+        var input = new byte[48 << 20];
+        var rnd = new Random(1);
+        for (int i = 0; i < input.Length; ++i)
+            input[i] = (byte)"ab"[rnd.Next(2)];
+
+        var regex = new CompiledRegex("(a|b)*a(a|b)(a|b)", new ScannerOptions(backend));
+        foreach (var tail in new[] { "abb", "bab", "aaa" })
+        {
+            tail.Select(c => (byte)c).ToArray().CopyTo(input, input.Length - 3);
+            Assert.Equal(regex.Match(input), regex.MatchParallel(input, 4));
+        }
+
+        // the chunk after the first sinks from some entry states
+        var words = new CompiledRegex("([ab]+ )*[ab]+", new ScannerOptions(backend));
+        input[input.Length / 2] = (byte)' ';
+        Assert.True(words.MatchParallel(input, 4));
+        input[input.Length / 2 + 1] = (byte)' ';
+        Assert.False(words.MatchParallel(input, 4));
+    }
+
+    [Theory]
+    [InlineData(Backend.Auto)]
+    [InlineData(Backend.LazyDFA)]
+    [InlineData(Backend.Standard)]
+    public void TestMatchParallelCounters(Backend backend)
+    {
+        // words of 1..70 letters, the counts go on across the chunk bounds
+        var text = new System.Text.StringBuilder();
+        var rnd = new Random(2);
+        while (text.Length < 48 << 20)
+            text.Append('a', 1 + rnd.Next(70)).Append(' ');
+        text.Append('b', 65);
+        var input = System.Text.Encoding.ASCII.GetBytes(text.ToString());
+
+        var words = new CompiledRegex("([ab]{1,70} )*[ab]{65,}", new ScannerOptions(backend));
+        Assert.True(words.MatchParallel(input, 4));
+
+        input[input.Length - 65] = (byte)' ';
+        Assert.False(words.MatchParallel(input, 4));
+        input[input.Length - 65] = (byte)'b';
+
+        // a word of 71 letters in the second chunk
+        Array.Fill(input, (byte)'a', input.Length / 2, 71);
+        Assert.False(words.MatchParallel(input, 4));
+    }
+
+    [Theory]
+    [InlineData(Backend.Auto)]
+    [InlineData(Backend.JIT)]
+    [InlineData(Backend.LazyDFA)]
+    [InlineData(Backend.Standard)]
+    public void TestConcurrentMatch(Backend backend)
+    {
+        var regex = new CompiledRegex("[a-z]+(-[a-z]+)*@[a-z]+\\.(com|org)", new ScannerOptions(backend));
+        var inputs = new[] { "john-doe@mail.com", "john@mail.net", "a@b.org", "@b.org" }
+            .Select(s => s.Select(c => (byte)c).ToArray()).ToArray();
+        var expected = new[] { true, false, true, false };
+
+        var failed = 0;
+        Parallel.For(0, 8, _ =>
+        {
+            for (int i = 0; i < 2000; ++i)
+            {
+                var k = i % inputs.Length;
+                if (regex.Match(inputs[k]) != expected[k])
+                    Interlocked.Increment(ref failed);
+            }
+        });
+        Assert.Equal(0, failed);
+    }
+
+    [Fact]
+    public void TestRegexCache()
+    {
+        using var cache = new RegexCache(2);
+        var input = "abc"u8.ToArray();
+
+        using var a1 = cache.Get("a.*");
+        using var a2 = cache.Get("a.*");
+        Assert.Same(a1.Regex, a2.Regex);
+        using (var standard = cache.Get("a.*", new ScannerOptions(Backend.Standard)))
+            Assert.NotSame(a1.Regex, standard.Regex);
+        Assert.Equal(new RegexCacheStats(1, 2, 0, 2), cache.Stats);
+
+        // evicts "a.*", the leases keep it alive
+        cache.Get("b.*").Dispose();
+        Assert.Equal(new RegexCacheStats(1, 3, 1, 2), cache.Stats);
+        Assert.True(a1.Regex.Match(input));
+        a1.Dispose();
+        Assert.True(a2.Regex.Match(input));
+        Assert.Throws<ObjectDisposedException>(() => a1.Regex);
+
+        Assert.Throws<ParsingException>(() => cache.Get("a|"));
+        Assert.Equal(2, cache.Stats.Count);
+    }
+
+    [Theory]
+    [InlineData(Backend.Auto, "[a-z]+=[0-9]+")]
+    [InlineData(Backend.JIT, "[a-z]+=[0-9]+")]
+    [InlineData(Backend.LazyDFA, "[a-z]+=[0-9]+")]
+    [InlineData(Backend.Standard, ".*ERROR [0-9]+.*")]
+    [InlineData(Backend.BitParallel, ".*ERROR [0-9]+.*")]
+    [InlineData(Backend.BitParallel, "[a-z]{2,8}=[0-9]{1,3}")]
+    public void TestSaveLoad(Backend backend, string pattern)
+    {
+        var inputs = new[] { "key=42", "key=", "=42", "x ERROR 500 y", "ERROR x" }
+            .Select(s => s.Select(c => (byte)c).ToArray()).ToArray();
+        using var regex = new CompiledRegex(pattern, new ScannerOptions(backend));
+        var image = regex.Save();
+
+        using var loaded = CompiledRegex.Load(image);
+        foreach (var input in inputs)
+            Assert.Equal(regex.Match(input), loaded.Match(input));
+        Assert.True(image.AsSpan().SequenceEqual(loaded.Save()));
+
+        var path = Path.GetTempFileName();
+        try
+        {
+            File.WriteAllBytes(path, image);
+            using var fromFile = CompiledRegex.LoadFile(path);
+            foreach (var input in inputs)
+                Assert.Equal(regex.Match(input), fromFile.Match(input));
+        }
+        finally
+        {
+            File.Delete(path);
+        }
+
+        Assert.Throws<Regex.Runtime.NativeAPIException>(() => CompiledRegex.Load(image.AsSpan(0, image.Length / 2)));
+        image[0] ^= 1;
+        Assert.Throws<Regex.Runtime.NativeAPIException>(() => CompiledRegex.Load(image));
+    }
+
+    [Theory]
+    [InlineData(Backend.Standard, "(a+)(b*)c", "aabbc")]
+    [InlineData(Backend.Standard, "(a|ab)(c|bcd)(d*)", "abcd")]
+    [InlineData(Backend.JIT, "(a*)(a|b)+", "aabab")]
+    [InlineData(Backend.LazyDFA, "(x)?y(?:z|w)*(w)?", "yzww")]
+    [InlineData(Backend.BitParallel, "([a-z]+)=([0-9]*)", "key=42")]
+    [InlineData(Backend.Auto, "(a)|b", "b")]
+    [InlineData(Backend.LazyDFA, "([0-9]{2,4})([0-9]*)", "123456")]
+    [InlineData(Backend.BitParallel, "(a{0,3})(a+)b{2,}", "aaaabbb")]
+    public void TestCaptures(Backend backend, string pattern, string input)
+    {
+        var bytes = input.Select(c => (byte)c).ToArray();
+        var expected = System.Text.RegularExpressions.Regex.Match(input, $"^(?:{pattern})$");
+        using var regex = new CompiledRegex(pattern, new ScannerOptions(backend));
+        using var loaded = CompiledRegex.Load(regex.Save());
+
+        foreach (var re in new[] { regex, loaded })
+        {
+            Assert.Equal(expected.Groups.Count - 1, re.CaptureGroups);
+            var groups = re.MatchCaptures(bytes);
+            Assert.NotNull(groups);
+            for (int i = 0; i < expected.Groups.Count; ++i)
+            {
+                var group = expected.Groups[i];
+                var bounds = group.Success ? ((ulong)group.Index, (ulong)(group.Index + group.Length)) : ((ulong, ulong)?)null;
+                Assert.Equal(bounds, groups[i]);
+            }
+            Assert.Null(re.MatchCaptures(bytes.Concat(new[] { (byte)'!' }).ToArray()));
+        }
+    }
+
+    [Fact]
+    public void TestMatchEarly()
+    {
+        var api = new CompiledRegex("GET /api/.*");
+        var body = System.Text.Encoding.ASCII.GetBytes("GET /api/users" + new string('x', 10000));
+        Assert.Equal((true, 9UL), api.MatchEarly(body, MatchMode.Prefix));
+        Assert.Equal((true, 9UL), api.MatchEarly(body, MatchMode.UntilDecided));
+        Assert.Equal((false, 8UL), api.MatchEarly("GET /apx/users"u8.ToArray(), MatchMode.UntilDecided));
+        Assert.Equal((false, 4UL), api.MatchEarly("GET "u8.ToArray(), MatchMode.Prefix));
+
+        var kv = new CompiledRegex("[a-z]+=[0-9]+");
+        Assert.Equal((true, 5UL), kv.MatchEarly("key=42;rest"u8.ToArray(), MatchMode.Prefix));
+        Assert.Equal((false, 7UL), kv.MatchEarly("key=42;rest"u8.ToArray(), MatchMode.UntilDecided));
+        Assert.Equal((true, 6UL), kv.MatchEarly("key=42"u8.ToArray(), MatchMode.UntilDecided));
+
+        // the result of UntilDecided is the one of Match() whether there's a universal tail or not
+        foreach (var pattern in new[] { "a(b|c)*.*", "(a|b)*b.*", "a.*b", ".*" })
+        {
+            var re = new CompiledRegex(pattern);
+            foreach (var input in new[] { "", "a", "ab", "abc", "bca", "abx", "ba", "xab" })
+            {
+                var bytes = System.Text.Encoding.ASCII.GetBytes(input);
+                Assert.Equal(re.Match(bytes), re.MatchEarly(bytes, MatchMode.UntilDecided).ok);
+            }
+        }
+        Assert.Equal((true, 0UL), new CompiledRegex(".*").MatchEarly("abc"u8.ToArray(), MatchMode.UntilDecided));
+    }
+
+    [Fact]
+    public void TestMatchReverse()
+    {
+        using var image = new CompiledRegex(@".*\.(jpg|png)");
+        var name = new string('x', 10000);
+        var png = System.Text.Encoding.ASCII.GetBytes(name + ".png");
+        var txt = System.Text.Encoding.ASCII.GetBytes(name + ".txt");
+        Assert.Equal((true, 4UL), image.MatchReverse(png, MatchMode.UntilDecided));
+        Assert.Equal((false, 1UL), image.MatchReverse(txt, MatchMode.UntilDecided));
+
+        // the result of UntilDecided is the one of Match(), for loaded images too
+        foreach (var pattern in new[] { "a(b|c)*.*", "(a|b)*b.*", "a.*b", ".*", "(ab)?" })
+        {
+            using var re = new CompiledRegex(pattern);
+            using var loaded = CompiledRegex.Load(re.Save());
+            foreach (var input in new[] { "", "a", "ab", "abc", "bca", "abx", "ba", "xab" })
+            {
+                var bytes = System.Text.Encoding.ASCII.GetBytes(input);
+                Assert.Equal(re.Match(bytes), re.MatchReverse(bytes, MatchMode.UntilDecided).ok);
+                Assert.Equal(re.Match(bytes), loaded.MatchReverse(bytes, MatchMode.UntilDecided).ok);
+            }
+        }
+
+        // the start of the leftmost-longest match is recovered from its end
+        using var kv = new CompiledRegex("[a-z]+=[0-9]+");
+        var line = "12 key=42, other=7"u8.ToArray();
+        Assert.Equal((3UL, 9UL), kv.Search(line));
+        Assert.Equal(3UL, kv.MatchStart(line, 9));
+        Assert.Null(kv.MatchStart(line, 10));
+        Assert.Equal((true, 6UL), kv.MatchEarly("key=42;rest"u8.ToArray(), MatchMode.LongestPrefix));
+    }
+
+    [Fact]
+    public void TestBitParallelStatesLimit()
+    {
+        // 64 NFA states, including the accepting one
+        var re = new CompiledRegex(new string('a', 63), new ScannerOptions(Backend.BitParallel));
+        Assert.True(re.Match(System.Text.Encoding.ASCII.GetBytes(new string('a', 63))));
+        Assert.False(re.Match(System.Text.Encoding.ASCII.GetBytes(new string('a', 62))));
+        Assert.False(re.Match(System.Text.Encoding.ASCII.GetBytes(new string('a', 64))));
+
+        Assert.Throws<Regex.Runtime.NativeAPIException>(
+            () => new CompiledRegex(new string('a', 64), new ScannerOptions(Backend.BitParallel))
+        );
+    }
+
+    [Theory]
+    [InlineData(200)]
+    [InlineData(255)]
+    [InlineData(256)]
+    [InlineData(257)]
+    [InlineData(1000)]
+    public void TestJITManyStates(int len)
+    {
+        // more NFA states than fit in the registers for the larger lengths
+        var pattern = new string('a', len) + "(b|cd)*e?";
+        var jit = new CompiledRegex(pattern, new ScannerOptions(Backend.JIT));
+        var standard = new CompiledRegex(pattern, new ScannerOptions(Backend.Standard));
+
+        string[] inputs =
+        [
+            new string('a', len),
+            new string('a', len - 1),
+            new string('a', len + 1),
+            new string('a', len) + "bcdbe",
+            new string('a', len) + "bcbe",
+            new string('a', len) + "cdcde",
+            new string('a', len) + "ee",
+        ];
+        foreach (var input in inputs)
+        {
+            var bytes = System.Text.Encoding.ASCII.GetBytes(input);
+            Assert.Equal(standard.Match(bytes), jit.Match(bytes));
+        }
+        Assert.True(jit.Match(System.Text.Encoding.ASCII.GetBytes(new string('a', len) + "bcdbe")));
+    }
 }
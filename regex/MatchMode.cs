@@ -0,0 +1,24 @@
+namespace Regex
+{
+    /// <summary>
+    /// Early-exit match modes of CompiledRegex.MatchEarly() and MatchReverse(), they stop reading
+    /// the input once the result is known.
+    /// </summary>
+    public enum MatchMode : uint
+    {
+        /// <summary>
+        /// The input starts with a match, stops at the end of the shortest matching prefix.
+        /// </summary>
+        Prefix = 0,
+        /// <summary>
+        /// Same result as Match(), but stops once no remaining input can reject the match,
+        /// e.g. after the prefix of `GET /api/.*`.
+        /// </summary>
+        UntilDecided,
+        /// <summary>
+        /// The input starts with a match, stops once no state is active, at the end of the
+        /// longest matching prefix.
+        /// </summary>
+        LongestPrefix,
+    }
+}
@@ -40,8 +40,12 @@ namespace Regex.NFA
             visited.Set(state.Index, true);
 
             string label;
-            if (state.Condition == null)
+            if (state.Tag != null)
+                label = $"label=\"{state.Index} t{state.Tag}\"";
+            else if (state.Condition == null)
                 label = $"label=\"{state.Index}\"";
+            else if (state.Counter != null)
+                label = $"label=\"{state.Index} {CharClassLabel(state.Condition)}{{{state.Counter.Min},{state.Counter.Max}}}\"";
             else
                 label = $"label=\"{state.Index} {CharClassLabel(state.Condition)}\"";
 
@@ -67,9 +71,14 @@ namespace Regex.NFA
 
             w.WriteLine($"{state.Index} [{label} {shape} {fillcolor} {color} {margin}]");
 
-            foreach (var nextState in state.Next)
+            for (int i = 0; i < state.Next.Count; ++i)
             {
-                w.WriteLine($"{state.Index} -> {nextState.Index}");
+                var nextState = state.Next[i];
+                var tags = state.NextTags[i];
+                if (tags.Count == 0)
+                    w.WriteLine($"{state.Index} -> {nextState.Index}");
+                else
+                    w.WriteLine($"{state.Index} -> {nextState.Index} [label=\"t{String.Join(",t", tags)}\"]");
                 RenderState(w, nextState, visited, sources);
             }
         }
@@ -40,6 +40,18 @@ namespace Regex.NFA
             => Ranges.All(rng => rng.Matches(c)) == !Inverted;
     }
 
+    /// <summary>
+    /// Bounds of a counting state: it matches Min..Max chars of its condition in a row, null Max
+    /// means unbounded.
+    /// </summary>
+    public record Counter(int Min, int? Max)
+    {
+        /// <summary>
+        /// Plain states the runtime unrolls the counter into for the simulations without counters.
+        /// </summary>
+        public int Width => Max ?? Min;
+    }
+
     /// <summary>
     /// There are two different types of NFA states: ε and non-ε.
     /// ε-state also may be a "back" state - intermediate state in a loop back path.
@@ -51,6 +63,12 @@ namespace Regex.NFA
         public CharClass? Condition { get; private init; }
         public List<State> Next { get; private init; }
 
+        /// <summary>
+        /// Capture slots set to the input position by the transition to each of the Next states.
+        /// Slot 2k is the start of the group k+1, 2k+1 is its end.
+        /// </summary>
+        public List<IReadOnlyList<int>> NextTags { get; private init; } = [];
+
         /// <summary>
         /// Regex parser adds extra intermediate ε-states when generates loops in NFA.
         /// They are marked with this flag.
@@ -58,6 +76,19 @@ namespace Regex.NFA
         /// </summary>
         public bool Back { get; private init; }
 
+        /// <summary>
+        /// Capture slot of a tag ε-state, the parser marks group bounds with them.
+        /// Optimizer moves tags to the transitions that replace ε-paths through such states.
+        /// </summary>
+        public int? Tag { get; private init; }
+
+        /// <summary>
+        /// Bounds of a counting state, the parser makes them for repetitions of a single char class
+        /// like `[0-9]{2,5}`. The state goes to Next only after the counted chars, each entry
+        /// starts another count.
+        /// </summary>
+        public Counter? Counter { get; private init; }
+
         /// <summary>
         /// An index of the current state.
         /// Negative value (default) means no index was assigned.
@@ -71,11 +102,12 @@ namespace Regex.NFA
 
         public bool IsEpsilon { get => Condition == null; }
 
-        public State(CharClass? condition, bool back, List<State> next)
+        public State(CharClass? condition, bool back, List<State> next, Counter? counter = null)
         {
             Condition = condition;
             Back = back;
             Next = next;
+            Counter = counter;
         }
 
         public static State MakeEpsilon()
@@ -87,7 +119,24 @@ namespace Regex.NFA
         public static State MakeConsuming(CharClass condition)
             => new(condition, false, []);
 
-        public void AddNext(params State[] states) => Next.AddRange(states);
+        public static State MakeCounting(CharClass condition, Counter counter)
+            => new(condition, false, [], counter);
+
+        public static State MakeTag(int slot)
+            => new(null, false, []) { Tag = slot };
+
+        public void AddNext(params State[] states)
+        {
+            Next.AddRange(states);
+            foreach (var _ in states)
+                NextTags.Add([]);
+        }
+
+        public void AddNext(State state, IReadOnlyList<int> tags)
+        {
+            Next.Add(state);
+            NextTags.Add(tags);
+        }
     }
 
     /// <summary>
@@ -96,6 +145,17 @@ namespace Regex.NFA
     /// Sink-state and sink-transitions are implicit (use your imagination).
     /// Source and accepting states could not be a "back" states.
     /// For all i: States[i].Index == i.
+    /// Next states of a state are in the priority order, like in a backtracking engine.
     /// </summary>
-    public record Automaton(IReadOnlyList<State> Sources, State Accept, IReadOnlyList<State> States) { }
+    /// <param name="CaptureGroups">Number of capture groups, the whole match is not counted.</param>
+    /// <param name="SourceTags">
+    /// Capture slots set at the input start by entering each of the sources, null means none.
+    /// </param>
+    public record Automaton(
+        IReadOnlyList<State> Sources,
+        State Accept,
+        IReadOnlyList<State> States,
+        int CaptureGroups = 0,
+        IReadOnlyList<IReadOnlyList<int>>? SourceTags = null
+    ) { }
 }
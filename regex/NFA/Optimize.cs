@@ -5,8 +5,9 @@ namespace Regex.NFA
     public static class Optimizer
     {
         private static void TraverseEpsilonPathsRec(
-            List<State> traversedPathEndings,
+            List<(State end, int[] tags)> traversedPathEndings,
             State state,
+            List<int> tags,
             HashSet<int> visited)
         {
             if (visited.Contains(state.Index))
@@ -14,23 +15,40 @@ namespace Regex.NFA
             visited.Add(state.Index);
 
             if (!state.IsEpsilon || state.Accept)
-                traversedPathEndings.Add(state);
+                traversedPathEndings.Add((state, tags.ToArray()));
 
             if (state.IsEpsilon)
-                foreach (var nextState in state.Next)
-                    TraverseEpsilonPathsRec(traversedPathEndings, nextState, visited);
+            {
+                if (state.Tag != null)
+                    tags.Add(state.Tag.Value);
+                for (int i = 0; i < state.Next.Count; ++i)
+                {
+                    tags.AddRange(state.NextTags[i]);
+                    TraverseEpsilonPathsRec(traversedPathEndings, state.Next[i], tags, visited);
+                    tags.RemoveRange(tags.Count - state.NextTags[i].Count, state.NextTags[i].Count);
+                }
+                if (state.Tag != null)
+                    tags.RemoveAt(tags.Count - 1);
+            }
         }
 
         /// <summary>
         /// Find all paths O,e1,...,en,T, where O is the origin, e1,...,en - ε-states, T - non-ε or accept.
+        /// Paths are found in the priority order, only the first path to each T is taken, with the tags
+        /// of the transitions and the tag states along it.
         /// </summary>
         private static void TraverseEpsilonPaths(
-            List<State> traversedPathEndings,
+            List<(State end, int[] tags)> traversedPathEndings,
             State state,
             HashSet<int> visited)
         {
-            foreach (var next in state.Next)
-                TraverseEpsilonPathsRec(traversedPathEndings, next, visited);
+            var tags = new List<int>();
+            for (int i = 0; i < state.Next.Count; ++i)
+            {
+                tags.AddRange(state.NextTags[i]);
+                TraverseEpsilonPathsRec(traversedPathEndings, state.Next[i], tags, visited);
+                tags.Clear();
+            }
         }
 
         public static Automaton Optimize(Automaton nfa)
@@ -49,7 +67,7 @@ namespace Regex.NFA
 
             foreach (var source in nfa.Sources)
             {
-                statesOptTable[source.Index] = new(source.Condition, source.Back, []);
+                statesOptTable[source.Index] = new(source.Condition, source.Back, [], source.Counter);
                 currentWave.Add(source);
             }
 
@@ -60,10 +78,10 @@ namespace Regex.NFA
                     if (state.Accept)
                         continue;
 
-                    var pathEndings = new List<State>();
+                    var pathEndings = new List<(State end, int[] tags)>();
                     TraverseEpsilonPaths(pathEndings, state, epsilonTraverseVisited);
                     epsilonTraverseVisited.Clear();
-                    foreach (State pathEnd in pathEndings)
+                    foreach (var (pathEnd, tags) in pathEndings)
                     {
                         // make an optimized state for pathEnd, if there's no
                         // add it to the next wave
@@ -71,7 +89,7 @@ namespace Regex.NFA
                         if (pathEndOpt == null)
                         {
                             pathEndOpt = statesOptTable[pathEnd.Index]
-                                = new(pathEnd.Condition, pathEnd.Back, []);
+                                = new(pathEnd.Condition, pathEnd.Back, [], pathEnd.Counter);
                             nextWave.Add(pathEnd);
                         }
 
@@ -80,7 +98,7 @@ namespace Regex.NFA
                         Debug.Assert(stateOpt != null);
 
                         // make a transition from state to pathEnd
-                        stateOpt.AddNext(pathEndOpt);
+                        stateOpt.AddNext(pathEndOpt, tags);
                     }
                 }
 
@@ -89,20 +107,27 @@ namespace Regex.NFA
             }
 
             var sourcesOpt = new List<State>();
-            // remove redundant ε-sources
-            foreach (var source in nfa.Sources)
+            var sourceTagsOpt = new List<IReadOnlyList<int>>();
+            // remove redundant ε-sources, their transitions tags are moved to the sources
+            for (int i = 0; i < nfa.Sources.Count; ++i)
             {
+                var source = nfa.Sources[i];
                 var sourceOpt = statesOptTable[source.Index];
                 Debug.Assert(sourceOpt != null);
+                IReadOnlyList<int> sourceTags = nfa.SourceTags?[i] ?? [];
 
                 if (!sourceOpt.IsEpsilon)
                 {
                     sourcesOpt.Add(sourceOpt);
+                    sourceTagsOpt.Add(sourceTags);
                     continue;
                 }
 
-                foreach (var next in sourceOpt.Next)
-                    sourcesOpt.Add(next);
+                for (int j = 0; j < sourceOpt.Next.Count; ++j)
+                {
+                    sourcesOpt.Add(sourceOpt.Next[j]);
+                    sourceTagsOpt.Add([.. sourceTags, .. sourceOpt.NextTags[j]]);
+                }
 
                 statesOptTable[source.Index] = null;
             }
@@ -122,7 +147,351 @@ namespace Regex.NFA
             Debug.Assert(acceptOpt != null);
             acceptOpt.Accept = true;
 
-            return new(sourcesOpt, acceptOpt, statesOpt);
+            return Reduce(new(sourcesOpt, acceptOpt, statesOpt, nfa.CaptureGroups, sourceTagsOpt));
+        }
+
+        /// <summary>
+        /// Partition refinement costs O(states * transitions) in the worst case, bigger NFAs are
+        /// not reduced.
+        /// </summary>
+        public const int MaxReducedStates = 10_000;
+
+        /// <summary>
+        /// Merge bisimilar states of the ε-free NFA until no more merges are possible.
+        /// Forward bisimilar states (same condition and equivalent next states) have the same
+        /// future, merging them factors common suffixes out of alternatives.
+        /// Backward bisimilar states (same condition and equivalent previous states) have the same
+        /// past, merging them factors common prefixes, like `GET /` of `GET /a|GET /b`.
+        /// Counting states are bisimilar only with the same bounds.
+        /// </summary>
+        public static Automaton Reduce(Automaton nfa)
+        {
+            if (nfa.States.Count > MaxReducedStates)
+                return nfa;
+
+            while (true)
+            {
+                int statesCount = nfa.States.Count;
+                nfa = Merge(nfa, ForwardClasses(nfa));
+                nfa = Merge(nfa, nfa.CaptureGroups == 0 ? BackwardClasses(nfa) : SiblingClasses(nfa));
+                if (nfa.States.Count == statesCount)
+                    return nfa;
+            }
+        }
+
+        /// <summary>
+        /// Bytes matched by a state, the union of ranges or its complement.
+        /// Empty for the accepting ε-state, that is distinguished by the Accept flag.
+        /// </summary>
+        private static (ulong, ulong, ulong, ulong) ConditionBytes(State state)
+        {
+            var words = new ulong[4];
+            if (state.Condition == null)
+                return (0, 0, 0, 0);
+
+            foreach (var range in state.Condition.Ranges)
+                for (int c = range.Start; c <= range.End; ++c)
+                    words[c / 64] |= 1UL << (c % 64);
+            if (state.Condition.Inverted)
+                for (int i = 0; i < words.Length; ++i)
+                    words[i] = ~words[i];
+            return (words[0], words[1], words[2], words[3]);
+        }
+
+        /// <summary>
+        /// Refine the partition of states by their signatures until it's stable.
+        /// States of a class have the same signature, a class is split when some of them get a
+        /// different one. The members that keep the signature keep the class, so only the
+        /// dependents of the moved states need new signatures. Chains of counted repetitions are
+        /// refined in linear time this way, a state per round.
+        /// </summary>
+        /// <param name="initialKey">Key of the coarsest partition, e.g. the condition.</param>
+        /// <param name="signature">Signature of a state by the current classes.</param>
+        /// <param name="dependents">States whose signatures depend on the class of the given one.</param>
+        /// <returns>Class of each state.</returns>
+        private static int[] Refine(
+            Automaton nfa,
+            Func<State, object> initialKey,
+            Func<int[], State, string> signature,
+            List<State>[] dependents)
+        {
+            var initialIds = new Dictionary<object, int>();
+            var classes = new int[nfa.States.Count];
+            foreach (var state in nfa.States)
+            {
+                var key = initialKey(state);
+                if (!initialIds.TryGetValue(key, out classes[state.Index]))
+                {
+                    classes[state.Index] = initialIds.Count;
+                    initialIds.Add(key, initialIds.Count);
+                }
+            }
+            // null until the first signature of the class is computed
+            var classSignatures = new List<string?>(initialIds.Values.Select(_ => (string?)null));
+            var classSizes = new List<int>(new int[initialIds.Count]);
+            foreach (var cls in classes)
+                ++classSizes[cls];
+
+            var dirty = nfa.States.ToList();
+            var isDirty = new bool[nfa.States.Count];
+            while (dirty.Count != 0)
+            {
+                var moved = new List<State>();
+                // a single state can't be split, like the accepting one that follows many states
+                var byClass = dirty
+                    .Where(s => classSizes[classes[s.Index]] > 1)
+                    .GroupBy(s => classes[s.Index])
+                    .Select(c => (cls: c.Key, groups: c.GroupBy(s => signature(classes, s)).ToList()))
+                    .ToList();
+                foreach (var (cls, groups) in byClass)
+                {
+                    // The clean members keep the class with its signature. If there're none, the
+                    // biggest group keeps it, so a class that isn't split is never renumbered and
+                    // the fewest states move.
+                    bool hasClean = groups.Sum(g => g.Count()) < classSizes[cls];
+                    if (!hasClean)
+                        classSignatures[cls] = groups.MaxBy(g => g.Count())!.Key;
+
+                    foreach (var group in groups)
+                    {
+                        if (group.Key == classSignatures[cls])
+                            continue;
+
+                        classSignatures.Add(group.Key);
+                        classSizes.Add(0);
+                        foreach (var state in group)
+                        {
+                            --classSizes[cls];
+                            classes[state.Index] = classSignatures.Count - 1;
+                            ++classSizes[classes[state.Index]];
+                            moved.Add(state);
+                        }
+                    }
+                }
+
+                Array.Clear(isDirty);
+                dirty.Clear();
+                foreach (var state in moved)
+                    foreach (var dependent in dependents[state.Index])
+                        if (!isDirty[dependent.Index])
+                        {
+                            isDirty[dependent.Index] = true;
+                            dirty.Add(dependent);
+                        }
+            }
+
+            // compact the numbers of the classes left empty
+            var compact = new Dictionary<int, int>();
+            return classes.Select(c => compact.TryAdd(c, compact.Count) ? compact.Count - 1 : compact[c]).ToArray();
+        }
+
+        private static List<State>[] Predecessors(Automaton nfa)
+        {
+            var prev = nfa.States.Select(_ => new List<State>()).ToArray();
+            foreach (var state in nfa.States)
+                foreach (var next in state.Next)
+                    prev[next.Index].Add(state);
+            return prev;
+        }
+
+        private static int[] ForwardClasses(Automaton nfa)
+        {
+            // Pike VM takes the first transition to a state, so the order and the tags of the next
+            // states matter if there are captures.
+            bool ordered = nfa.CaptureGroups > 0;
+            return Refine(
+                nfa,
+                state => (ConditionBytes(state), state.Counter, state.Accept),
+                (classes, state) =>
+                {
+                    if (!ordered)
+                        return string.Join(",", state.Next.Select(n => classes[n.Index]).Distinct().Order());
+
+                    var seen = new HashSet<int>();
+                    var transitions = new List<string>();
+                    for (int i = 0; i < state.Next.Count; ++i)
+                        if (seen.Add(classes[state.Next[i].Index]))
+                            transitions.Add($"{classes[state.Next[i].Index]}[{string.Join(",", state.NextTags[i])}]");
+                    return string.Join(",", transitions);
+                },
+                Predecessors(nfa));
+        }
+
+        private static int[] BackwardClasses(Automaton nfa)
+        {
+            var prev = Predecessors(nfa);
+            var sources = nfa.Sources.ToHashSet();
+            return Refine(
+                nfa,
+                state => (ConditionBytes(state), state.Counter, state.Accept, sources.Contains(state)),
+                (classes, state) => string.Join(",", prev[state.Index].Select(p => classes[p.Index]).Distinct().Order()),
+                nfa.States.Select(s => s.Next).ToArray());
+        }
+
+        /// <summary>
+        /// Backward bisimilar states with captures can't be merged in general: a Pike VM thread in
+        /// the merged state follows the next states of both with the slots of one of them.
+        /// Siblings are safe: states with the same transitions from the same states, next to each
+        /// other in their priority order. A thread reaches them together with the same slots and
+        /// the merged state follows their next states in the same order. Merging them level by
+        /// level factors common prefixes like `(GET /a|GET /b)`.
+        /// </summary>
+        private static int[] SiblingClasses(Automaton nfa)
+        {
+            var incoming = nfa.States.Select(_ => new List<string>()).ToArray();
+            foreach (var state in nfa.States)
+                for (int i = 0; i < state.Next.Count; ++i)
+                    incoming[state.Next[i].Index].Add($"{state.Index}[{string.Join(",", state.NextTags[i])}]");
+            for (int i = 0; i < nfa.Sources.Count; ++i)
+                incoming[nfa.Sources[i].Index].Add($"source[{string.Join(",", nfa.SourceTags?[i] ?? [])}]");
+
+            var ids = new Dictionary<((ulong, ulong, ulong, ulong), Counter?, bool, string), int>();
+            var classes = nfa.States
+                .Select(s => (ConditionBytes(s), s.Counter, s.Accept, string.Join(";", incoming[s.Index].Order())))
+                .Select(key => ids.TryAdd(key, ids.Count) ? ids.Count - 1 : ids[key])
+                .ToArray();
+
+            // siblings separated by another state in some list are not merged
+            var separated = new HashSet<int>();
+            void CheckAdjacent(IEnumerable<State> states)
+            {
+                var seen = new HashSet<int>();
+                int last = -1;
+                foreach (var state in states)
+                {
+                    int cls = classes[state.Index];
+                    if (cls != last && !seen.Add(cls))
+                        separated.Add(cls);
+                    last = cls;
+                }
+            }
+            CheckAdjacent(nfa.Sources);
+            foreach (var state in nfa.States)
+                CheckAdjacent(state.Next);
+
+            int classesCount = ids.Count;
+            foreach (var state in nfa.States)
+                if (separated.Contains(classes[state.Index]))
+                    classes[state.Index] = classesCount++;
+            return classes;
+        }
+
+        /// <summary>
+        /// Replace each class of states with a single state, that has the transitions of all of them.
+        /// Only the first transition to each class is kept, as the Pike VM would take only it.
+        /// </summary>
+        private static Automaton Merge(Automaton nfa, int[] classes)
+        {
+            if (classes.Distinct().Count() == nfa.States.Count)
+                return nfa;
+
+            // the first state of each class represents it
+            var merged = new State?[classes.Max() + 1];
+            var statesMerged = new List<State>();
+            foreach (var state in nfa.States)
+            {
+                if (merged[classes[state.Index]] != null)
+                    continue;
+                var stateMerged = new State(state.Condition, state.Back, [], state.Counter) { Accept = state.Accept };
+                stateMerged.Index = statesMerged.Count;
+                merged[classes[state.Index]] = stateMerged;
+                statesMerged.Add(stateMerged);
+            }
+
+            var linked = statesMerged.Select(_ => new HashSet<int>()).ToArray();
+            foreach (var state in nfa.States)
+            {
+                var from = merged[classes[state.Index]]!;
+                for (int i = 0; i < state.Next.Count; ++i)
+                {
+                    var to = merged[classes[state.Next[i].Index]]!;
+                    if (linked[from.Index].Add(to.Index))
+                        from.AddNext(to, state.NextTags[i]);
+                }
+            }
+
+            var sourcesMerged = new List<State>();
+            var sourceTagsMerged = new List<IReadOnlyList<int>>();
+            for (int i = 0; i < nfa.Sources.Count; ++i)
+            {
+                var source = merged[classes[nfa.Sources[i].Index]]!;
+                if (sourcesMerged.Contains(source))
+                    continue;
+                sourcesMerged.Add(source);
+                sourceTagsMerged.Add(nfa.SourceTags?[i] ?? []);
+            }
+
+            return new(
+                sourcesMerged,
+                merged[classes[nfa.Accept.Index]]!,
+                statesMerged,
+                nfa.CaptureGroups,
+                sourceTagsMerged);
+        }
+
+        private static bool IsSingleByte(State state)
+            => state.Condition is { Inverted: false, Ranges: [var range] } && range.Start == range.End
+                && state.Counter == null;
+
+        /// <summary>
+        /// Check if every path from sources to the accept state goes through the given state.
+        /// </summary>
+        private static bool IsOnEveryPath(Automaton nfa, State through)
+        {
+            var visited = new bool[nfa.States.Count];
+            var stack = new Stack<State>();
+            foreach (var source in nfa.Sources)
+                if (source != through && !visited[source.Index])
+                {
+                    visited[source.Index] = true;
+                    stack.Push(source);
+                }
+
+            while (stack.Count != 0)
+            {
+                var state = stack.Pop();
+                if (state.Accept)
+                    return false;
+
+                foreach (var next in state.Next)
+                    if (next != through && !visited[next.Index])
+                    {
+                        visited[next.Index] = true;
+                        stack.Push(next);
+                    }
+            }
+            return true;
+        }
+
+        /// <summary>
+        /// Find the longest literal that every string accepted by the optimized NFA contains.
+        /// It's a chain of single-byte states where each one has the only next state, and the first
+        /// state is passed by every accepting path.
+        /// </summary>
+        /// <returns>Empty array if there's no such literal.</returns>
+        public static byte[] RequiredLiteral(Automaton nfa)
+        {
+            byte[] best = [];
+            foreach (var state in nfa.States)
+            {
+                if (!IsSingleByte(state))
+                    continue;
+
+                var literal = new List<byte>();
+                var visited = new HashSet<State>();
+                for (var s = state; IsSingleByte(s) && visited.Add(s);)
+                {
+                    literal.Add(s.Condition!.Ranges[0].Start);
+                    var next = s.Next.Distinct().ToList();
+                    if (next.Count != 1)
+                        break;
+                    s = next[0];
+                }
+
+                if (literal.Count > best.Length && IsOnEveryPath(nfa, state))
+                    best = literal.ToArray();
+            }
+            return best;
         }
     }
 }
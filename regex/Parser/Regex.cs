@@ -7,11 +7,16 @@ namespace Regex.Parser
         /// </summary>
         private NFA.CharClass[] BuiltinClassesTable { get; init; }
 
+        /// <summary>
+        /// Capture groups opened so far by the current Convert().
+        /// </summary>
+        private int captureGroups;
+
         /// <summary>
         /// Construct a new regex to NFA converter. Only ASCII characters are allowed.
         /// </summary>
         /// <param name="builtinClasses">
-        /// Builtin classes should not use names (,),[,],+,*,?,.,&#92;,x,X,^,|,-,n,0,r,t,a,b,v,
+        /// Builtin classes should not use names (,),[,],{,},+,*,?,.,&#92;,x,X,^,|,-,n,0,r,t,a,b,v,
         /// since those are reserved for escape sequences.
         /// </param>
         public RegexParser(List<(char, NFA.CharClass)> builtinClasses)
@@ -61,6 +66,7 @@ namespace Regex.Parser
             {
                 'x' or 'X' => HexByte(p),
                 ']' or '[' or '\\' or '(' or ')' or '^' or '.' or '?' or '+' or '*' or '|' or '-' => c,
+                '{' or '}' => c,
                 'n' => '\n',
                 '0' => '\0',
                 'r' => '\r',
@@ -149,9 +155,11 @@ namespace Regex.Parser
                 },
                 p => // other
                 {
+                    bool quantifier = StartsRepetition(p);
                     char c = p.Char(c => 0x20 <= c && c <= 0x7e
                          && c != '\\' && c != '*' && c != '?' && c != ')' && c != '|'
-                         && c != '+' && c != '[' && c != ']' && c != '(' && c != '.');
+                         && c != '+' && c != '[' && c != ']' && c != '(' && c != '.'
+                         && (c != '{' || !quantifier));
                     return NFA.CharClass.SingleChar(c);
                 }
             );
@@ -160,9 +168,20 @@ namespace Regex.Parser
         private (NFA.State s, NFA.State e) Group(Parser p)
         {
             p.Char('(');
-            var ret = Alternative(p);
+            var nonCapturing = p.Optional(p => p.String("?:"));
+            // groups are numbered by their opening parentheses
+            int group = nonCapturing.Set ? 0 : ++captureGroups;
+            var (s, e) = Alternative(p);
             p.Char(')');
-            return ret;
+            if (nonCapturing.Set)
+                return (s, e);
+
+            // -> open -> s -> ... -> e -> close ->
+            var open = NFA.State.MakeTag(2 * (group - 1));
+            var close = NFA.State.MakeTag(2 * (group - 1) + 1);
+            open.AddNext(s);
+            e.AddNext(close);
+            return (open, close);
         }
 
         private (NFA.State s, NFA.State e) Atom(Parser p)
@@ -179,55 +198,221 @@ namespace Regex.Parser
             );
         }
 
+        private static (NFA.State s, NFA.State e) MakeOptional((NFA.State s, NFA.State e) atom)
+        {
+            // -> s1 -> s -> ... -> e -> e1 ->
+            //     \                     ^
+            //      \                    |
+            //       *-------------------*
+            var (s, e) = atom;
+            var e1 = NFA.State.MakeEpsilon();
+            var s1 = NFA.State.MakeEpsilon();
+            e.AddNext(e1);
+            s1.AddNext(s, e1);
+            return (s1, e1);
+        }
+
+        private static (NFA.State s, NFA.State e) MakePlus((NFA.State s, NFA.State e) atom)
+        {
+            // -> s -> ... -> e -> e1 ->
+            //    ^                /
+            //     \              /
+            //      *---- b <----*
+            var (s, e) = atom;
+            var b = NFA.State.MakeBack();
+            var e1 = NFA.State.MakeEpsilon();
+            e.AddNext(e1);
+            e1.AddNext(b);
+            b.AddNext(s);
+            return (s, e1);
+        }
+
+        private static (NFA.State s, NFA.State e) MakeStar((NFA.State s, NFA.State e) atom)
+        {
+            //      +-> s -> ... -> e
+            //     /                |
+            // -> s1 <----- b <-----+
+            //     \
+            //      *-----> e1 ----->
+            var (s, e) = atom;
+            var s1 = NFA.State.MakeEpsilon();
+            var b = NFA.State.MakeBack();
+            var e1 = NFA.State.MakeEpsilon();
+            s1.AddNext(s, e1);
+            e.AddNext(b);
+            b.AddNext(s1);
+            return (s1, e1);
+        }
+
+        /// <summary>
+        /// Upper limit of the counts in {n,m}, each repetition of a group is a copy of it in NFA.
+        /// </summary>
+        public const int MaxRepetitions = 1000;
+
+        /// <summary>
+        /// Upper limit of the NFA states made by copying an atom for {n,m}, so nested repetitions
+        /// don't explode.
+        /// </summary>
+        public const int MaxRepeatedStates = 100_000;
+
+        // Number of states of a fragment that isn't linked to the rest of NFA yet, counting states
+        // are counted unrolled, like the runtime makes them for the captures.
+        private static int FragmentSize(NFA.State s)
+        {
+            var visited = new HashSet<NFA.State>() { s };
+            var stack = new Stack<NFA.State>();
+            stack.Push(s);
+            while (stack.Count != 0)
+                foreach (var next in stack.Pop().Next)
+                    if (visited.Add(next))
+                        stack.Push(next);
+            return visited.Sum(state => state.Counter?.Width ?? 1);
+        }
+
+        // Saturates at MaxRepetitions + 1, the bounds are checked by the caller.
+        private static int RepetitionCount(Parser p)
+        {
+            int n = p.Char(char.IsAsciiDigit) - '0';
+            while (true)
+            {
+                var digit = p.Optional(p => p.Char(char.IsAsciiDigit));
+                if (!digit.Set)
+                    break;
+                n = Math.Min(n * 10 + digit.Value - '0', MaxRepetitions + 1);
+            }
+            return n;
+        }
+
+        // {n}, {n,} or {n,m} without the bounds checks, the max is null if unbounded
+        private static (int min, int? max) RepetitionBounds(Parser p)
+        {
+            p.Char('{');
+            int min = RepetitionCount(p);
+            int? max = min;
+            if (p.Optional(p => p.Char(',')).Set)
+            {
+                var count = p.Optional(RepetitionCount);
+                max = count.Set ? count.Value : null;
+            }
+            p.Char('}');
+            return (min, max);
+        }
+
+        // Like in .NET and PCRE, { that doesn't start {n}, {n,} or {n,m} is a literal, e.g. a{b or {x}.
+        private static bool StartsRepetition(Parser p)
+            => new Parser(p.Text, p.Index).Optional(RepetitionBounds).Set;
+
+        private static (int min, int? max) Repetition(Parser p)
+        {
+            if (!StartsRepetition(p))
+                throw new ParsingException(p);
+            var (min, max) = RepetitionBounds(p);
+            if ((max ?? min) > MaxRepetitions)
+                throw new ParsingException(p, $"repetition count is greater than {MaxRepetitions}");
+            if (min > max)
+                throw new ParsingException(p, "invalid repetition bounds");
+            return (min, max);
+        }
+
+        /// <summary>
+        /// Chain of `max` copies of the atom, the ones after `min` are optional.
+        /// The optional copies are nested: x{1,3} is x(x(x)?)?, so each copy adds only an exit
+        /// transition, unlike x x? x? where every copy may skip to any further one.
+        /// An unbounded max makes the last copy a loop.
+        /// A single char class, like [0-9]{2,5}, is a counting state instead: the runtime tracks
+        /// the counts in a bitmap, so the NFA doesn't grow with them.
+        /// </summary>
+        private static (NFA.State s, NFA.State e) MakeRepetition(
+            (NFA.State s, NFA.State e) first,
+            Func<(NFA.State s, NFA.State e)> copy,
+            int min,
+            int? max)
+        {
+            if (max == 0)
+            {
+                // matches only the empty string, the parsed atom is dropped
+                var empty = NFA.State.MakeEpsilon();
+                return (empty, empty);
+            }
+            if (max == null && min <= 1)
+                return min == 0 ? MakeStar(first) : MakePlus(first);
+            if (first.s == first.e && first.s.Condition != null && first.s.Counter == null && max != 1)
+            {
+                // x{0,m} is (x{1,m})?, counting states count at least one char
+                var counting = NFA.State.MakeCounting(first.s.Condition, new(Math.Max(min, 1), max));
+                return min == 0 ? MakeOptional((counting, counting)) : (counting, counting);
+            }
+
+            var start = NFA.State.MakeEpsilon();
+            var end = start;
+            var atom = first;
+            for (int i = 0; i < min; ++i)
+            {
+                if (i > 0)
+                    atom = copy();
+                if (max == null && i == min - 1)
+                    atom = MakePlus(atom);
+                end.AddNext(atom.s);
+                end = atom.e;
+            }
+            if (max == null)
+                return (start, end);
+
+            // -> end -> s1 -> s -> ... -> e -> s1' -> ...
+            //             \                      \
+            //              *----------------------*--> exit ->
+            var exit = NFA.State.MakeEpsilon();
+            for (int i = min; i < max; ++i)
+            {
+                if (i > 0)
+                    atom = copy();
+                var s1 = NFA.State.MakeEpsilon();
+                s1.AddNext(atom.s, exit);
+                end.AddNext(s1);
+                end = atom.e;
+            }
+            end.AddNext(exit);
+            return (start, exit);
+        }
+
         private (NFA.State s, NFA.State e) AtomQuantified(Parser p)
         {
-            var (s, e) = Atom(p);
+            int atomIndex = p.Index;
+            int groupsBefore = captureGroups;
+            var atom = Atom(p);
+
+            // The copies of {n,m} are parsed again from the same text, so their groups get the
+            // same numbers: the last repetition sets the captures.
+            (NFA.State s, NFA.State e) CopyAtom()
+            {
+                captureGroups = groupsBefore;
+                return Atom(new Parser(p.Text, atomIndex));
+            }
+
             return p.Or(
                 p =>
                 {
-                    // -> s1 -> s -> ... -> e -> e1 ->
-                    //     \                     ^
-                    //      \                    |
-                    //       *-------------------*
                     p.Char('?');
-                    var e1 = NFA.State.MakeEpsilon();
-                    var s1 = NFA.State.MakeEpsilon();
-                    e.AddNext(e1);
-                    s1.AddNext(s, e1);
-                    return (s1, e1);
+                    return MakeOptional(atom);
                 },
                 p =>
                 {
-                    // -> s -> ... -> e -> e1 ->
-                    //    ^                /
-                    //     \              /
-                    //      *---- b <----*
                     p.Char('+');
-                    var b = NFA.State.MakeBack();
-                    var e1 = NFA.State.MakeEpsilon();
-                    e.AddNext(e1);
-                    e1.AddNext(b);
-                    b.AddNext(s);
-                    return (s, e1);
+                    return MakePlus(atom);
                 },
                 p =>
                 {
-                    //      +-> s -> ... -> e
-                    //     /                |
-                    // -> s1 <----- b <-----+
-                    //     \
-                    //      *-----> e1 ----->
                     p.Char('*');
-
-                    var s1 = NFA.State.MakeEpsilon();
-                    var b = NFA.State.MakeBack();
-                    var e1 = NFA.State.MakeEpsilon();
-                    s1.AddNext(s, e1);
-                    e.AddNext(b);
-                    b.AddNext(s1);
-                    return (s1, e1);
+                    return MakeStar(atom);
+                },
+                p =>
+                {
+                    var (min, max) = Repetition(p);
+                    if ((long)FragmentSize(atom.s) * (max ?? min) > MaxRepeatedStates)
+                        throw new ParsingException(p, "repetition makes too many NFA states");
+                    return MakeRepetition(atom, CopyAtom, min, max);
                 },
-                p => (s, e) // no quantifier
+                p => atom // no quantifier
             );
         }
 
@@ -285,9 +470,14 @@ namespace Regex.Parser
                 AssignIndexDFS(reachableStates, nextState, ref index);
         }
 
+        /// <summary>
+        /// Convert the regex to NFA.
+        /// Groups (...) are capturing, (?:...) are not.
+        /// </summary>
         public NFA.Automaton Convert(string expr)
         {
             var p = new Parser(expr, 0);
+            captureGroups = 0;
 
             var (s, e) = Alternative(p);
             p.EOF();
@@ -302,7 +492,7 @@ namespace Regex.Parser
             int index = 0;
             AssignIndexDFS(states, source, ref index);
 
-            return new NFA.Automaton([source], accept, states);
+            return new NFA.Automaton([source], accept, states, captureGroups);
         }
     }
 }
@@ -1,3 +1,4 @@
+using System.Collections.Concurrent;
 using System.Diagnostics;
 using System.Runtime.InteropServices;
 using Regex.Parser;
@@ -8,16 +9,59 @@ namespace Regex
     public class CompiledRegex : IDisposable
     {
         private bool disposed = false;
+        // The owner's reference and the ones of the RegexCache leases.
+        private int refs = 1;
 
-        // These pointers to arrays are saved in order to free them later.
-        private unsafe readonly NativeAPI.CharRange* charRangesArr;
-        private unsafe readonly NativeAPI.State* statesArr;
+        // Not set if the regex was loaded from an image, the native scanner owns the NFA then.
+        private readonly NativeAutomaton? nativeAutomaton;
         private unsafe readonly NativeAPI.Automaton* nativeNFA;
+        private unsafe readonly byte* requiredLiteralArr;
 
         // Pointer to scanner and it's pinned handle
         private readonly IntPtr scannerPtr;
+        internal IntPtr ScannerPtr => scannerPtr;
 
-        private static string errorToString(NativeAPI.Error err)
+        // Native scanners keep the scratch state of a match, so each concurrent call needs its own.
+        // Clones share the compiled program with the original scanner and are reused by later calls.
+        private readonly ConcurrentBag<IntPtr> idleScanners = new();
+        private readonly List<IntPtr> scannerClones = new();
+
+        internal readonly struct RentedScanner : IDisposable
+        {
+            private readonly CompiledRegex regex;
+            public IntPtr Ptr { get; }
+
+            public RentedScanner(CompiledRegex regex, IntPtr ptr)
+            {
+                this.regex = regex;
+                Ptr = ptr;
+            }
+
+            public void Dispose()
+            {
+                regex.idleScanners.Add(Ptr);
+            }
+        }
+
+        /// <summary>
+        /// Take an idle scanner or clone a new one, it's returned to the pool on Dispose().
+        /// </summary>
+        internal RentedScanner RentScanner()
+        {
+            if (idleScanners.TryTake(out var ptr))
+                return new RentedScanner(this, ptr);
+
+            var err = NativeAPI.rcs_scanner_clone(out ptr, scannerPtr);
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            lock (scannerClones)
+            {
+                scannerClones.Add(ptr);
+            }
+            return new RentedScanner(this, ptr);
+        }
+
+        internal static string errorToString(NativeAPI.Error err)
         {
             IntPtr strPtr = NativeAPI.rcs_strerror(err);
             string? s = Marshal.PtrToStringUTF8(strPtr);
@@ -25,89 +69,111 @@ namespace Regex
             return s;
         }
 
-        public unsafe CompiledRegex(string regex)
+        public CompiledRegex(string regex) : this(regex, new ScannerOptions()) { }
+
+        public unsafe CompiledRegex(string regex, ScannerOptions options)
         {
             var nfa = RegexParser.WithDefaultBuiltinClasses().Convert(regex);
             nfa = NFA.Optimizer.Optimize(nfa);
 
-            // Count number of ranges so we can allocate a single ranges array
-            int charRangesCount = 0;
-            foreach (var state in nfa.States)
-                if (state.Condition != null)
-                    charRangesCount += state.Condition.Ranges.Count();
+            nativeAutomaton = new NativeAutomaton(nfa);
 
-            charRangesArr = (NativeAPI.CharRange*)Marshal
-                .AllocHGlobal(charRangesCount * sizeof(NativeAPI.CharRange)).ToPointer();
+            nativeNFA = (NativeAPI.Automaton*)Marshal
+                .AllocHGlobal(sizeof(NativeAPI.Automaton)).ToPointer();
 
-            statesArr = (NativeAPI.State*)Marshal
-                .AllocHGlobal(nfa.States.Count * sizeof(NativeAPI.State)).ToPointer();
+            var requiredLiteral = NFA.Optimizer.RequiredLiteral(nfa);
+            requiredLiteralArr = (byte*)Marshal.AllocHGlobal(requiredLiteral.Length).ToPointer();
+            requiredLiteral.CopyTo(new Span<byte>(requiredLiteralArr, requiredLiteral.Length));
 
-            // marshal each state to a native struct
-            int stateIndex = 0;
-            int rangeIndex = 0;
-            foreach (var state in nfa.States)
+            *nativeNFA = new()
             {
-                // retreive all data from nullable condition
-                NativeAPI.CharRange* stateRangesPtr = null; // use null for clarity
-                int rangesCount = 0;
-                bool inverted = false;
-                if (state.Condition != null)
-                {
-                    stateRangesPtr = &charRangesArr[rangeIndex];
-                    rangesCount = state.Condition.Ranges.Count;
-                    inverted = state.Condition.Inverted;
-
-                    foreach (var range in state.Condition.Ranges)
-                        charRangesArr[rangeIndex++] = new() { start = range.Start, end = range.End };
-                }
-
-                // make an array of pointers to next states
-                NativeAPI.State** nextStates = (NativeAPI.State**)Marshal
-                    .AllocHGlobal(state.Next.Count * sizeof(NativeAPI.State*)).ToPointer();
-                int nextStateIndex = 0;
-                foreach (var nextState in state.Next)
-                    nextStates[nextStateIndex++] = statesArr + nextState.Index;
+                states = new IntPtr(nativeAutomaton.States),
+                statesLen = (uint)nativeAutomaton.StatesLen,
+                sourceStates = new IntPtr(nativeAutomaton.Sources),
+                sourceStatesLen = (uint)nativeAutomaton.SourcesLen,
+                acceptState = new IntPtr(nativeAutomaton.Accepts[0]),
+                requiredLiteral = new IntPtr(requiredLiteralArr),
+                requiredLiteralLen = (uint)requiredLiteral.Length,
+                capturesLen = (uint)nfa.CaptureGroups,
+                tags = new IntPtr(nativeAutomaton.Tags),
+                sourceTags = new IntPtr(nativeAutomaton.SourceTags)
+            };
 
-                // write a state itself
-                statesArr[stateIndex++] = new()
-                {
-                    next = new IntPtr(nextStates),
-                    nextLen = (uint)state.Next.Count,
-                    ranges = new IntPtr(stateRangesPtr),
-                    rangesLen = (uint)rangesCount,
-                    invertedMatch = (byte)(inverted ? 1 : 0)
-                };
+            var nativeOptions = new NativeAPI.ScannerOptions()
+            {
+                backend = (uint)options.Backend,
+                dfaCacheSize = options.DfaCacheSize
+            };
+            var err = NativeAPI.rcs_scanner_init_ex(out scannerPtr, new IntPtr(nativeNFA), nativeOptions);
+            if (!err.Ok())
+            {
+                // Dispose() is never called for an object whose constructor threw
+                Marshal.FreeHGlobal(new IntPtr(requiredLiteralArr));
+                Marshal.FreeHGlobal(new IntPtr(nativeNFA));
+                nativeAutomaton.Dispose();
+                throw new NativeAPIException(errorToString(err));
             }
+            idleScanners.Add(scannerPtr);
+        }
 
-            nativeNFA = (NativeAPI.Automaton*)Marshal
-                .AllocHGlobal(sizeof(NativeAPI.Automaton)).ToPointer();
+        private CompiledRegex(IntPtr loadedScanner)
+        {
+            scannerPtr = loadedScanner;
+            idleScanners.Add(scannerPtr);
+        }
 
-            // make an array of pointers to source states
-            var sourceStates = (NativeAPI.State**)Marshal
-                .AllocHGlobal(nfa.Sources.Count * sizeof(NativeAPI.State)).ToPointer();
-            int sourceStateIndex = 0;
-            foreach (var source in nfa.Sources)
-                sourceStates[sourceStateIndex++] = &statesArr[source.Index];
+        /// <summary>
+        /// Save the compiled program to an image, that is loaded by Load() without parsing,
+        /// optimization and JIT compilation.
+        /// The image is valid only for the same runtime version and CPU architecture.
+        /// </summary>
+        public unsafe byte[] Save()
+        {
+            var err = NativeAPI.rcs_scanner_save(out byte* image, out ulong len, scannerPtr);
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            try
+            {
+                return new ReadOnlySpan<byte>(image, checked((int)len)).ToArray();
+            }
+            finally
+            {
+                NativeAPI.rcs_image_free(image);
+            }
+        }
 
-            *nativeNFA = new()
+        /// <summary>
+        /// Load a regex from the image made by Save().
+        /// The machine code of the image is executed as is, so it must come from a trusted source.
+        /// </summary>
+        public static unsafe CompiledRegex Load(ReadOnlySpan<byte> image)
+        {
+            fixed (byte* ptr = image)
             {
-                states = new IntPtr(statesArr),
-                statesLen = (uint)nfa.States.Count(),
-                sourceStates = new IntPtr(sourceStates),
-                sourceStatesLen = (uint)nfa.Sources.Count,
-                acceptState = new IntPtr(&statesArr[nfa.Accept.Index])
-            };
+                var err = NativeAPI.rcs_scanner_load(out var scanner, ptr, (ulong)image.Length);
+                if (!err.Ok())
+                    throw new NativeAPIException(errorToString(err));
+                return new CompiledRegex(scanner);
+            }
+        }
 
-            var err = NativeAPI.rcs_scanner_init(out scannerPtr, new IntPtr(nativeNFA));
+        /// <summary>
+        /// Same as Load() for the image file, it's memory-mapped by the native code.
+        /// </summary>
+        public static CompiledRegex LoadFile(string path)
+        {
+            var err = NativeAPI.rcs_scanner_load_file(out var scanner, path);
             if (!err.Ok())
                 throw new NativeAPIException(errorToString(err));
+            return new CompiledRegex(scanner);
         }
 
         public unsafe bool Match(Reader inputReader)
         {
+            using var scanner = RentScanner();
             byte ok = 0;
             inputReader.Exception = null;
-            var err = NativeAPI.rcs_match(out ok, scannerPtr, new IntPtr(inputReader.Native));
+            var err = NativeAPI.rcs_match(out ok, scanner.Ptr, new IntPtr(inputReader.Native));
             if (!err.Ok())
                 throw new NativeAPIException(errorToString(err));
             if (inputReader.Exception != null)
@@ -117,32 +183,367 @@ namespace Regex
 
         public bool Match(byte[] bytes)
         {
-            return Match(new ByteArrayReader(bytes));
+            return Match(new ReadOnlySpan<byte>(bytes));
+        }
+
+        /// <summary>
+        /// Match the input in place, without copying it to a reader's buffer.
+        /// </summary>
+        public unsafe bool Match(ReadOnlySpan<byte> bytes)
+        {
+            fixed (byte* ptr = bytes)
+            {
+                return Match(ptr, (ulong)bytes.Length);
+            }
+        }
+
+        public bool Match(ReadOnlyMemory<byte> bytes)
+        {
+            return Match(bytes.Span);
         }
 
+        /// <summary>
+        /// Match len bytes at ptr, the memory must stay valid during the call.
+        /// </summary>
+        public unsafe bool Match(byte* ptr, ulong len)
+        {
+            using var scanner = RentScanner();
+            var err = NativeAPI.rcs_match_buffer(out byte ok, scanner.Ptr, ptr, len);
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            return ok != 0;
+        }
+
+        /// <summary>
+        /// Match a huge input by several threads, each of them handles a chunk of it.
+        /// Pays off for regexes that quickly forget where they started, like most validators.
+        /// Small inputs are matched by the calling thread.
+        /// </summary>
+        /// <param name="threads">Worker threads number, 0 means the number of CPUs.</param>
+        public unsafe bool MatchParallel(ReadOnlySpan<byte> input, int threads = 0)
+        {
+            using var scanner = RentScanner();
+            fixed (byte* ptr = input)
+            {
+                var err = NativeAPI.rcs_match_parallel(out byte ok, scanner.Ptr, ptr, (ulong)input.Length, (uint)threads);
+                if (!err.Ok())
+                    throw new NativeAPIException(errorToString(err));
+                return ok != 0;
+            }
+        }
+
+        /// <summary>
+        /// Match the whole contents of the file.
+        /// The file is memory-mapped by the native code, no data goes through the managed side.
+        /// </summary>
+        public bool MatchFile(string path)
+        {
+            using var scanner = RentScanner();
+            var err = NativeAPI.rcs_match_file(out byte ok, scanner.Ptr, path);
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            return ok != 0;
+        }
+
+        /// <summary>
+        /// Match each of the inputs separately.
+        /// Much faster than calling Match() for each of many short inputs.
+        /// </summary>
+        /// <returns>Match result for each input.</returns>
+        public unsafe bool[] MatchBatch(IReadOnlyList<byte[]> inputs)
+        {
+            using var scanner = RentScanner();
+            var handles = new GCHandle[inputs.Count];
+            var nativeInputs = new NativeAPI.Input[inputs.Count];
+            var results = new byte[inputs.Count];
+            try
+            {
+                for (int i = 0; i < inputs.Count; ++i)
+                {
+                    handles[i] = GCHandle.Alloc(inputs[i], GCHandleType.Pinned);
+                    nativeInputs[i] = new()
+                    {
+                        ptr = handles[i].AddrOfPinnedObject(),
+                        len = (uint)inputs[i].Length
+                    };
+                }
+
+                fixed (byte* resultsPtr = results)
+                fixed (NativeAPI.Input* inputsPtr = nativeInputs)
+                {
+                    var err = NativeAPI.rcs_match_batch(
+                        resultsPtr,
+                        scanner.Ptr,
+                        inputsPtr,
+                        (uint)inputs.Count
+                    );
+                    if (!err.Ok())
+                        throw new NativeAPIException(errorToString(err));
+                }
+            }
+            finally
+            {
+                foreach (var handle in handles)
+                {
+                    if (handle.IsAllocated)
+                        handle.Free();
+                }
+            }
+
+            return Array.ConvertAll(results, r => r != 0);
+        }
+
+        // Copies the matched line offsets and frees the result.
+        private unsafe ulong[] TakeGrepResult(NativeAPI.Error err, NativeAPI.GrepResult result)
+        {
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            var lineStarts = new ReadOnlySpan<ulong>(result.lineStarts.ToPointer(), (int)result.count).ToArray();
+            NativeAPI.rcs_grep_result_free(ref result);
+            return lineStarts;
+        }
+
+        /// <summary>
+        /// Match each '\n'-delimited line of the input.
+        /// Big inputs are split between threads.
+        /// </summary>
+        /// <param name="threads">Worker threads number, 0 means the number of CPUs.</param>
+        /// <returns>Offsets of the matched lines.</returns>
+        public unsafe ulong[] Grep(ReadOnlySpan<byte> input, int threads = 0)
+        {
+            using var scanner = RentScanner();
+            var options = new NativeAPI.GrepOptions() { threads = (uint)threads, countOnly = 0 };
+            fixed (byte* ptr = input)
+            {
+                var err = NativeAPI.rcs_grep(out var result, scanner.Ptr, ptr, (ulong)input.Length, options);
+                return TakeGrepResult(err, result);
+            }
+        }
+
+        /// <summary>
+        /// Same as Grep(), but only counts the matched lines.
+        /// </summary>
+        public unsafe ulong GrepCount(ReadOnlySpan<byte> input, int threads = 0)
+        {
+            using var scanner = RentScanner();
+            var options = new NativeAPI.GrepOptions() { threads = (uint)threads, countOnly = 1 };
+            fixed (byte* ptr = input)
+            {
+                var err = NativeAPI.rcs_grep(out var result, scanner.Ptr, ptr, (ulong)input.Length, options);
+                if (!err.Ok())
+                    throw new NativeAPIException(errorToString(err));
+                return result.count;
+            }
+        }
+
+        /// <summary>
+        /// Same as Grep() for the whole contents of the file.
+        /// </summary>
+        public ulong[] GrepFile(string path, int threads = 0)
+        {
+            using var scanner = RentScanner();
+            var options = new NativeAPI.GrepOptions() { threads = (uint)threads, countOnly = 0 };
+            var err = NativeAPI.rcs_grep_file(out var result, scanner.Ptr, path, options);
+            return TakeGrepResult(err, result);
+        }
+
+        /// <summary>
+        /// Start an incremental match of an input pushed in chunks.
+        /// The regex must outlive the stream.
+        /// </summary>
+        public RegexStream BeginStream()
+        {
+            return new RegexStream(this);
+        }
+
+        /// <summary>
+        /// Find the leftmost-longest match anywhere in the input.
+        /// </summary>
+        /// <returns>Match bounds [start..end) or null if there's no match.</returns>
+        public unsafe (ulong start, ulong end)? Search(Reader inputReader)
+        {
+            using var scanner = RentScanner();
+            inputReader.Exception = null;
+            var err = NativeAPI.rcs_search(
+                out byte found,
+                out ulong start,
+                out ulong end,
+                scanner.Ptr,
+                new IntPtr(inputReader.Native)
+            );
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            if (inputReader.Exception != null)
+                throw inputReader.Exception;
+            return found != 0 ? (start, end) : null;
+        }
+
+        public (ulong start, ulong end)? Search(byte[] bytes)
+        {
+            return Search(new ByteArrayReader(bytes));
+        }
+
+        /// <summary>
+        /// Match in the early-exit mode, the rest of the input is not read once the result is known.
+        /// </summary>
+        /// <returns>
+        /// The result and the number of bytes consumed when it was decided.
+        /// </returns>
+        public unsafe (bool ok, ulong offset) MatchEarly(Reader inputReader, MatchMode mode)
+        {
+            using var scanner = RentScanner();
+            inputReader.Exception = null;
+            var err = NativeAPI.rcs_match_early(
+                out byte ok,
+                out ulong offset,
+                scanner.Ptr,
+                new IntPtr(inputReader.Native),
+                (uint)mode
+            );
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            if (inputReader.Exception != null)
+                throw inputReader.Exception;
+            return (ok != 0, offset);
+        }
+
+        public (bool ok, ulong offset) MatchEarly(byte[] bytes, MatchMode mode)
+        {
+            return MatchEarly(new ByteArrayReader(bytes), mode);
+        }
+
+        /// <summary>
+        /// Same as MatchEarly() for the input read backwards from its end, the prefixes of the
+        /// modes are suffixes of the input. UntilDecided gives the result of Match(), but rejects
+        /// or accepts the inputs of a regex like `.*\.(jpg|png)` by their tail alone.
+        /// </summary>
+        /// <returns>
+        /// The result and the number of bytes from the end consumed when it was decided.
+        /// </returns>
+        public unsafe (bool ok, ulong offset) MatchReverse(ReadOnlySpan<byte> bytes, MatchMode mode)
+        {
+            using var scanner = RentScanner();
+            fixed (byte* ptr = bytes)
+            {
+                var err = NativeAPI.rcs_match_reverse(
+                    out byte ok,
+                    out ulong offset,
+                    scanner.Ptr,
+                    ptr,
+                    (ulong)bytes.Length,
+                    (uint)mode
+                );
+                if (!err.Ok())
+                    throw new NativeAPIException(errorToString(err));
+                return (ok != 0, offset);
+            }
+        }
+
+        /// <summary>
+        /// Find the leftmost start of a match that ends at `end`, e.g. the end found by Search(),
+        /// by reading the input backwards from there.
+        /// </summary>
+        /// <returns>Start of the match or null if no match ends at `end`.</returns>
+        public ulong? MatchStart(ReadOnlySpan<byte> bytes, ulong end)
+        {
+            var (ok, offset) = MatchReverse(bytes[..checked((int)end)], MatchMode.LongestPrefix);
+            return ok ? end - offset : null;
+        }
+
+        /// <summary>
+        /// Number of capturing groups, `(?:...)` groups are not counted.
+        /// </summary>
+        public int CaptureGroups => (int)NativeAPI.rcs_captures_len(scannerPtr);
+
+        /// <summary>
+        /// Match the whole input and extract the capturing groups. The leftmost alternative and
+        /// the longest repetition are preferred like in the backtracking engines.
+        /// </summary>
+        /// <returns>
+        /// Bounds [start..end) of the whole match followed by the ones of each group, null for a
+        /// group that didn't participate. Null if there's no match.
+        /// </returns>
+        public unsafe (ulong start, ulong end)?[]? MatchCaptures(Reader inputReader)
+        {
+            using var scanner = RentScanner();
+            var slots = new ulong[2 * (CaptureGroups + 1)];
+            inputReader.Exception = null;
+            NativeAPI.Error err;
+            byte ok;
+            fixed (ulong* slotsPtr = slots)
+            {
+                err = NativeAPI.rcs_match_captures(
+                    out ok,
+                    slotsPtr,
+                    scanner.Ptr,
+                    new IntPtr(inputReader.Native)
+                );
+            }
+            if (!err.Ok())
+                throw new NativeAPIException(errorToString(err));
+            if (inputReader.Exception != null)
+                throw inputReader.Exception;
+            if (ok == 0)
+                return null;
+
+            var groups = new (ulong start, ulong end)?[CaptureGroups + 1];
+            for (int i = 0; i < groups.Length; ++i)
+            {
+                if (slots[2 * i] != NoCapture && slots[2 * i + 1] != NoCapture)
+                    groups[i] = (slots[2 * i], slots[2 * i + 1]);
+            }
+            return groups;
+        }
+
+        public (ulong start, ulong end)?[]? MatchCaptures(byte[] bytes)
+        {
+            return MatchCaptures(new ByteArrayReader(bytes));
+        }
+
+        // RCS_NO_CAPTURE
+        private const ulong NoCapture = ulong.MaxValue;
+
         public void Dispose()
         {
             Dispose(true);
             GC.SuppressFinalize(this);
         }
 
-        public unsafe void Dispose(bool disposing)
+        /// <summary>
+        /// Release the owner's reference, the native program is freed when the last reference is
+        /// released.
+        /// </summary>
+        public void Dispose(bool disposing)
         {
             if (!disposed)
             {
-                for (int i = 0; i < nativeNFA->statesLen; ++i)
-                    Marshal.FreeHGlobal(statesArr[i].next);
-                Marshal.FreeHGlobal(new IntPtr(statesArr));
+                disposed = true;
+                Release();
+            }
+        }
 
-                Marshal.FreeHGlobal(nativeNFA->sourceStates);
-                Marshal.FreeHGlobal(new IntPtr(charRangesArr));
+        // Extra reference of a cache lease, see RegexCache.
+        internal void Retain()
+        {
+            Interlocked.Increment(ref refs);
+        }
 
-                Marshal.FreeHGlobal(new IntPtr(nativeNFA));
+        internal void Release()
+        {
+            if (Interlocked.Decrement(ref refs) == 0)
+                Free();
+        }
 
-                NativeAPI.rcs_scanner_free(scannerPtr);
+        private unsafe void Free()
+        {
+            // clones must be freed before the scanner they share the program with
+            foreach (var clone in scannerClones)
+                NativeAPI.rcs_scanner_free(clone);
+            NativeAPI.rcs_scanner_free(scannerPtr);
 
-                disposed = true;
-            }
+            Marshal.FreeHGlobal(new IntPtr(requiredLiteralArr));
+            Marshal.FreeHGlobal(new IntPtr(nativeNFA));
+            nativeAutomaton?.Dispose();
         }
     }
 }
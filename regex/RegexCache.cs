@@ -0,0 +1,138 @@
+namespace Regex
+{
+    /// <summary>
+    /// Hit, miss and eviction counters of a <see cref="RegexCache"/>.
+    /// </summary>
+    /// <param name="Count">Number of cached regexes.</param>
+    public record RegexCacheStats(long Hits, long Misses, long Evictions, int Count) { }
+
+    /// <summary>
+    /// Reference to a regex shared through a <see cref="RegexCache"/>.
+    /// The regex stays valid until the lease is disposed, even if it's evicted from the cache.
+    /// </summary>
+    public sealed class CachedRegex : IDisposable
+    {
+        private CompiledRegex? regex;
+
+        internal CachedRegex(CompiledRegex regex)
+        {
+            regex.Retain();
+            this.regex = regex;
+        }
+
+        public CompiledRegex Regex => regex ?? throw new ObjectDisposedException(nameof(CachedRegex));
+
+        public void Dispose()
+        {
+            Interlocked.Exchange(ref regex, null)?.Release();
+        }
+    }
+
+    /// <summary>
+    /// Bounded LRU cache of compiled regexes keyed by pattern and options.
+    /// Parsing, optimization and native compilation are done once per pattern, the compiled regex
+    /// is shared by all leases returned for it. Thread-safe.
+    /// </summary>
+    public sealed class RegexCache : IDisposable
+    {
+        /// <summary>
+        /// Process-wide cache.
+        /// </summary>
+        public static RegexCache Shared { get; } = new RegexCache(256);
+
+        private readonly record struct Key(string Pattern, ScannerOptions Options);
+        private readonly record struct Entry(Key Key, CompiledRegex Regex);
+
+        // The most recently used entry is the first one.
+        private readonly LinkedList<Entry> lru = new();
+        private readonly Dictionary<Key, LinkedListNode<Entry>> entries = new();
+        private long hits, misses, evictions;
+
+        public int Capacity { get; private init; }
+
+        public RegexCache(int capacity)
+        {
+            if (capacity <= 0)
+                throw new ArgumentOutOfRangeException(nameof(capacity), "Capacity must be positive");
+            Capacity = capacity;
+        }
+
+        public RegexCacheStats Stats
+        {
+            get
+            {
+                lock (lru)
+                {
+                    return new RegexCacheStats(hits, misses, evictions, entries.Count);
+                }
+            }
+        }
+
+        public CachedRegex Get(string pattern)
+        {
+            return Get(pattern, new ScannerOptions());
+        }
+
+        /// <summary>
+        /// Get the cached regex or compile it, dispose the returned lease after use.
+        /// A regex that fails to compile isn't cached, the exception is rethrown on each call.
+        /// </summary>
+        public CachedRegex Get(string pattern, ScannerOptions options)
+        {
+            var key = new Key(pattern, options);
+            lock (lru)
+            {
+                if (entries.TryGetValue(key, out var node))
+                {
+                    ++hits;
+                    lru.Remove(node);
+                    lru.AddFirst(node);
+                    return new CachedRegex(node.Value.Regex);
+                }
+                ++misses;
+            }
+
+            // Compiled without the lock, so other patterns are served meanwhile.
+            // If the same pattern is compiled concurrently, the first inserted regex wins.
+            var regex = new CompiledRegex(pattern, options);
+            lock (lru)
+            {
+                if (entries.TryGetValue(key, out var node))
+                {
+                    regex.Dispose();
+                    return new CachedRegex(node.Value.Regex);
+                }
+
+                entries[key] = lru.AddFirst(new Entry(key, regex));
+                while (entries.Count > Capacity)
+                {
+                    var last = lru.Last!;
+                    lru.RemoveLast();
+                    entries.Remove(last.Value.Key);
+                    last.Value.Regex.Dispose();
+                    ++evictions;
+                }
+                return new CachedRegex(regex);
+            }
+        }
+
+        /// <summary>
+        /// Drop all cached regexes, the ones still leased are freed when their leases are disposed.
+        /// </summary>
+        public void Clear()
+        {
+            lock (lru)
+            {
+                foreach (var entry in lru)
+                    entry.Regex.Dispose();
+                lru.Clear();
+                entries.Clear();
+            }
+        }
+
+        public void Dispose()
+        {
+            Clear();
+        }
+    }
+}
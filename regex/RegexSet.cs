@@ -0,0 +1,110 @@
+using System.Collections;
+using System.Runtime.InteropServices;
+using Regex.Parser;
+using Regex.Runtime;
+
+namespace Regex
+{
+    /// <summary>
+    /// Several regexes matched in a single pass over the input.
+    /// </summary>
+    public class RegexSet : IDisposable
+    {
+        private bool disposed = false;
+
+        private readonly NativeAutomaton nativeAutomaton;
+        private unsafe readonly NativeAPI.AutomatonSet* nativeSet;
+
+        private readonly IntPtr scannerPtr;
+
+        public int Count { get; private init; }
+
+        public RegexSet(IEnumerable<string> regexes) : this(regexes, new ScannerOptions()) { }
+
+        /// <summary>
+        /// Only <see cref="Backend.Auto"/> and <see cref="Backend.LazyDFA"/> are supported.
+        /// </summary>
+        public unsafe RegexSet(IEnumerable<string> regexes, ScannerOptions options)
+        {
+            var parser = RegexParser.WithDefaultBuiltinClasses();
+            var nfas = regexes.Select(re => NFA.Optimizer.Optimize(parser.Convert(re))).ToList();
+            if (nfas.Count == 0)
+                throw new ArgumentException("Regex set must not be empty", nameof(regexes));
+            Count = nfas.Count;
+
+            nativeAutomaton = new NativeAutomaton(nfas);
+
+            nativeSet = (NativeAPI.AutomatonSet*)Marshal
+                .AllocHGlobal(sizeof(NativeAPI.AutomatonSet)).ToPointer();
+            *nativeSet = new()
+            {
+                states = new IntPtr(nativeAutomaton.States),
+                statesLen = (uint)nativeAutomaton.StatesLen,
+                sourceStates = new IntPtr(nativeAutomaton.Sources),
+                sourceStatesLen = (uint)nativeAutomaton.SourcesLen,
+                acceptStates = new IntPtr(nativeAutomaton.Accepts),
+                acceptStatesLen = (uint)nativeAutomaton.AcceptsLen
+            };
+
+            var nativeOptions = new NativeAPI.ScannerOptions()
+            {
+                backend = (uint)options.Backend,
+                dfaCacheSize = options.DfaCacheSize
+            };
+            var err = NativeAPI.rcs_set_scanner_init(out scannerPtr, new IntPtr(nativeSet), nativeOptions);
+            if (!err.Ok())
+            {
+                // Dispose() is never called for an object whose constructor threw
+                Marshal.FreeHGlobal(new IntPtr(nativeSet));
+                nativeAutomaton.Dispose();
+                throw new NativeAPIException(CompiledRegex.errorToString(err));
+            }
+        }
+
+        /// <summary>
+        /// Match every regex of the set against the whole input.
+        /// </summary>
+        /// <returns>Bit i is set iff the i-th regex matched.</returns>
+        public unsafe BitArray Match(Reader inputReader)
+        {
+            var matched = new ulong[(Count + 63) / 64];
+            inputReader.Exception = null;
+            fixed (ulong* matchedPtr = matched)
+            {
+                var err = NativeAPI.rcs_set_match(matchedPtr, scannerPtr, new IntPtr(inputReader.Native));
+                if (!err.Ok())
+                    throw new NativeAPIException(CompiledRegex.errorToString(err));
+            }
+            if (inputReader.Exception != null)
+                throw inputReader.Exception;
+
+            var result = new BitArray(Count);
+            for (int i = 0; i < Count; ++i)
+                result[i] = (matched[i / 64] & (1UL << (i % 64))) != 0;
+            return result;
+        }
+
+        public BitArray Match(byte[] bytes)
+        {
+            return Match(new ByteArrayReader(bytes));
+        }
+
+        public void Dispose()
+        {
+            Dispose(true);
+            GC.SuppressFinalize(this);
+        }
+
+        public unsafe void Dispose(bool disposing)
+        {
+            if (!disposed)
+            {
+                NativeAPI.rcs_set_scanner_free(scannerPtr);
+                Marshal.FreeHGlobal(new IntPtr(nativeSet));
+                nativeAutomaton.Dispose();
+
+                disposed = true;
+            }
+        }
+    }
+}
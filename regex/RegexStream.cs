@@ -0,0 +1,76 @@
+using Regex.Runtime;
+
+namespace Regex
+{
+    /// <summary>
+    /// Incremental match of an input pushed in chunks.
+    /// The whole match state is a small array, so a half-matched input may be parked
+    /// with Clone() and resumed later.
+    /// A stream must not be used from several threads at once, but different streams of the same
+    /// regex may be.
+    /// </summary>
+    public class RegexStream
+    {
+        private readonly CompiledRegex regex;
+        private readonly ulong[] context;
+
+        internal unsafe RegexStream(CompiledRegex regex)
+        {
+            this.regex = regex;
+            uint size = NativeAPI.rcs_stream_size(regex.ScannerPtr);
+            context = new ulong[(size + sizeof(ulong) - 1) / sizeof(ulong)];
+            fixed (ulong* ctx = context)
+            {
+                NativeAPI.rcs_stream_begin(new IntPtr(ctx), regex.ScannerPtr);
+            }
+        }
+
+        private RegexStream(RegexStream other)
+        {
+            regex = other.regex;
+            context = (ulong[])other.context.Clone();
+        }
+
+        /// <summary>
+        /// Advance the match by the next chunk of the input.
+        /// </summary>
+        public unsafe void Feed(ReadOnlySpan<byte> chunk)
+        {
+            using var scanner = regex.RentScanner();
+            fixed (ulong* ctx = context)
+            fixed (byte* ptr = chunk)
+            {
+                var err = NativeAPI.rcs_stream_feed(
+                    new IntPtr(ctx),
+                    scanner.Ptr,
+                    ptr,
+                    (uint)chunk.Length
+                );
+                if (!err.Ok())
+                    throw new NativeAPIException(CompiledRegex.errorToString(err));
+            }
+        }
+
+        /// <summary>
+        /// Check if the input fed so far matches. More chunks may be fed after that.
+        /// </summary>
+        public unsafe bool End()
+        {
+            fixed (ulong* ctx = context)
+            {
+                var err = NativeAPI.rcs_stream_end(out byte ok, new IntPtr(ctx));
+                if (!err.Ok())
+                    throw new NativeAPIException(CompiledRegex.errorToString(err));
+                return ok != 0;
+            }
+        }
+
+        /// <summary>
+        /// Copy of the current match state, independent of this one.
+        /// </summary>
+        public RegexStream Clone()
+        {
+            return new RegexStream(this);
+        }
+    }
+}
@@ -33,11 +33,16 @@ namespace Regex.Runtime
         {
             public IntPtr next; // struct rcs_nfa_state*
             public uint nextLen; // rcs_api_size
+            public IntPtr nextTags; // rcs_api_size*
             public IntPtr ranges; // struct rcs_nfa_char_range*
             public uint rangesLen; // rcs_api_size
             public byte invertedMatch; //rcs_api_bool
+            public uint counterMin; // rcs_api_size
+            public uint counterMax; // rcs_api_size
         };
 
+        public const uint CounterUnbounded = uint.MaxValue; // RCS_COUNTER_UNBOUNDED
+
         [StructLayout(LayoutKind.Sequential)]
         public struct Automaton
         {
@@ -46,8 +51,31 @@ namespace Regex.Runtime
             public IntPtr sourceStates; // struct rcs_nfa_state*
             public uint sourceStatesLen; // rcs_api_size
             public IntPtr acceptState; // struct rcs_nfa_state*
+            public IntPtr requiredLiteral; // uint8_t*
+            public uint requiredLiteralLen; // rcs_api_size
+            public uint capturesLen; // rcs_api_size
+            public IntPtr tags; // rcs_api_size*
+            public IntPtr sourceTags; // rcs_api_size*
+        };
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct AutomatonSet
+        {
+            public IntPtr states; // struct rcs_nfa_state*
+            public uint statesLen; // rcs_api_size
+            public IntPtr sourceStates; // struct rcs_nfa_state**
+            public uint sourceStatesLen; // rcs_api_size
+            public IntPtr acceptStates; // struct rcs_nfa_state**
+            public uint acceptStatesLen; // rcs_api_size
         };
 
+        [StructLayout(LayoutKind.Sequential)]
+        public struct ScannerOptions
+        {
+            public uint backend; // uint32_t (rcs_scanner_backend)
+            public uint dfaCacheSize; // rcs_api_size
+        }
+
         public delegate uint Read(IntPtr arg); // rcs_api_size (*)(void *arg)
         public delegate byte Unwind(IntPtr arg, ulong n); // rcs_api_size (*)(void *arg, uint64_t n)
 
@@ -63,6 +91,24 @@ namespace Regex.Runtime
         [LibraryImport("libregex-cs-runtime.so")]
         public static partial Error rcs_scanner_init(out IntPtr scanner, IntPtr nfa);
 
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial Error rcs_scanner_init_ex(out IntPtr scanner, IntPtr nfa, in ScannerOptions options);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial Error rcs_scanner_clone(out IntPtr scanner, IntPtr original);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_scanner_save(out byte* image, out ulong len, IntPtr scanner);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial void rcs_image_free(byte* image);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_scanner_load(out IntPtr scanner, byte* image, ulong len);
+
+        [LibraryImport("libregex-cs-runtime.so", StringMarshalling = StringMarshalling.Utf8)]
+        public static partial Error rcs_scanner_load_file(out IntPtr scanner, string path);
+
         [LibraryImport("libregex-cs-runtime.so", StringMarshalling = StringMarshalling.Utf8)]
         public static partial IntPtr rcs_strerror(Error err);
 
@@ -70,6 +116,117 @@ namespace Regex.Runtime
         public static partial Error rcs_match(out byte out_ok, IntPtr scanner, IntPtr reader);
 
         [LibraryImport("libregex-cs-runtime.so")]
-        public static partial Error rcs_scanner_free(IntPtr scanner);
+        public static unsafe partial Error rcs_match_buffer(
+            out byte out_ok,
+            IntPtr scanner,
+            byte* buf,
+            ulong len
+        );
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_match_parallel(
+            out byte out_ok,
+            IntPtr scanner,
+            byte* buf,
+            ulong len,
+            uint threads
+        );
+
+        [LibraryImport("libregex-cs-runtime.so", StringMarshalling = StringMarshalling.Utf8)]
+        public static partial Error rcs_match_file(out byte out_ok, IntPtr scanner, string path);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial Error rcs_search(
+            out byte out_found,
+            out ulong out_start,
+            out ulong out_end,
+            IntPtr scanner,
+            IntPtr reader
+        );
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct Input
+        {
+            public IntPtr ptr; // const uint8_t*
+            public uint len; // rcs_api_size
+        }
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial uint rcs_captures_len(IntPtr scanner);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial Error rcs_match_early(out byte out_ok, out ulong out_offset, IntPtr scanner, IntPtr reader, uint mode);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_match_reverse(out byte out_ok, out ulong out_offset, IntPtr scanner, byte* buf, ulong len, uint mode);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_match_captures(out byte out_ok, ulong* out_slots, IntPtr scanner, IntPtr reader);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_match_batch(
+            byte* out_ok,
+            IntPtr scanner,
+            Input* inputs,
+            uint inputs_len
+        );
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct GrepOptions
+        {
+            public uint threads; // rcs_api_size
+            public byte countOnly; // rcs_api_bool
+        }
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct GrepResult
+        {
+            public ulong count; // uint64_t
+            public IntPtr lineStarts; // uint64_t*
+        }
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_grep(
+            out GrepResult out_result,
+            IntPtr scanner,
+            byte* buf,
+            ulong len,
+            in GrepOptions options
+        );
+
+        [LibraryImport("libregex-cs-runtime.so", StringMarshalling = StringMarshalling.Utf8)]
+        public static partial Error rcs_grep_file(
+            out GrepResult out_result,
+            IntPtr scanner,
+            string path,
+            in GrepOptions options
+        );
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial void rcs_grep_result_free(ref GrepResult result);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial uint rcs_stream_size(IntPtr scanner);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial void rcs_stream_begin(IntPtr ctx, IntPtr scanner);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_stream_feed(IntPtr ctx, IntPtr scanner, byte* buf, uint len);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial Error rcs_stream_end(out byte out_ok, IntPtr ctx);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial void rcs_scanner_free(IntPtr scanner);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial Error rcs_set_scanner_init(out IntPtr scanner, IntPtr set, in ScannerOptions options);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static unsafe partial Error rcs_set_match(ulong* out_matched, IntPtr scanner, IntPtr reader);
+
+        [LibraryImport("libregex-cs-runtime.so")]
+        public static partial void rcs_set_scanner_free(IntPtr scanner);
     }
 }
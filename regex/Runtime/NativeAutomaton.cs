@@ -0,0 +1,183 @@
+using System.Runtime.InteropServices;
+using Regex.NFA;
+
+namespace Regex.Runtime
+{
+    /// <summary>
+    /// Native copy of the states of one or several optimized NFAs.
+    /// States of all automata are placed in one array, so it can be passed both as `struct rcs_nfa`
+    /// and as `struct rcs_nfa_set`.
+    /// Must outlive scanners created from it.
+    /// </summary>
+    internal unsafe class NativeAutomaton : IDisposable
+    {
+        private bool disposed = false;
+
+        // These pointers to arrays are saved in order to free them later.
+        private readonly NativeAPI.CharRange* charRangesArr;
+        private readonly uint* nextTagsArr;
+
+        public NativeAPI.State* States { get; private init; }
+        public int StatesLen { get; private init; }
+
+        public NativeAPI.State** Sources { get; private init; }
+        public int SourcesLen { get; private init; }
+
+        /// <summary>
+        /// Accept state of each automaton.
+        /// </summary>
+        public NativeAPI.State** Accepts { get; private init; }
+        public int AcceptsLen { get; private init; }
+
+        /// <summary>
+        /// Capture tags as `rcs_nfa.tags` and `rcs_nfa.source_tags`, only for a single automaton
+        /// with captures. Null otherwise, the states have no tags then.
+        /// </summary>
+        public uint* Tags { get; private init; }
+        public uint* SourceTags { get; private init; }
+
+        public NativeAutomaton(Automaton nfa) : this([nfa]) { }
+
+        public NativeAutomaton(IReadOnlyList<Automaton> nfas)
+        {
+            // Count number of ranges so we can allocate a single ranges array
+            int charRangesCount = 0;
+            foreach (var nfa in nfas)
+                foreach (var state in nfa.States)
+                    if (state.Condition != null)
+                        charRangesCount += state.Condition.Ranges.Count();
+
+            StatesLen = nfas.Sum(nfa => nfa.States.Count);
+            SourcesLen = nfas.Sum(nfa => nfa.Sources.Count);
+            AcceptsLen = nfas.Count;
+
+            charRangesArr = (NativeAPI.CharRange*)Marshal
+                .AllocHGlobal(charRangesCount * sizeof(NativeAPI.CharRange)).ToPointer();
+            States = (NativeAPI.State*)Marshal
+                .AllocHGlobal(StatesLen * sizeof(NativeAPI.State)).ToPointer();
+            Sources = (NativeAPI.State**)Marshal
+                .AllocHGlobal(SourcesLen * sizeof(NativeAPI.State*)).ToPointer();
+            Accepts = (NativeAPI.State**)Marshal
+                .AllocHGlobal(AcceptsLen * sizeof(NativeAPI.State*)).ToPointer();
+
+            if (nfas.Count == 1 && nfas[0].CaptureGroups > 0)
+            {
+                var nfa = nfas[0];
+                var tagsCount = nfa.States.Sum(s => s.NextTags.Sum(t => t.Count))
+                    + (nfa.SourceTags?.Sum(t => t.Count) ?? 0);
+                Tags = (uint*)Marshal.AllocHGlobal(Math.Max(tagsCount, 1) * sizeof(uint)).ToPointer();
+                SourceTags = (uint*)Marshal.AllocHGlobal((SourcesLen + 1) * sizeof(uint)).ToPointer();
+                nextTagsArr = (uint*)Marshal
+                    .AllocHGlobal((nfa.States.Sum(s => s.Next.Count) + StatesLen) * sizeof(uint)).ToPointer();
+            }
+
+            // states of the i-th automaton start at the offset
+            int statesOffset = 0;
+            int rangeIndex = 0;
+            int sourceIndex = 0;
+            for (int i = 0; i < nfas.Count; ++i)
+            {
+                var nfa = nfas[i];
+                int tagIndex = 0;
+                int nextTagsIndex = 0;
+                foreach (var state in nfa.States)
+                {
+                    States[statesOffset + state.Index] = MakeState(state, statesOffset, ref rangeIndex);
+                    if (Tags != null)
+                    {
+                        States[state.Index].nextTags = new IntPtr(&nextTagsArr[nextTagsIndex]);
+                        AddTags(state.NextTags, ref nextTagsIndex, ref tagIndex);
+                    }
+                }
+                if (Tags != null)
+                {
+                    int sourceTagsIndex = 0;
+                    SourceTags[0] = (uint)tagIndex;
+                    for (int j = 0; j < nfa.Sources.Count; ++j)
+                    {
+                        foreach (var tag in nfa.SourceTags?[j] ?? [])
+                            Tags[tagIndex++] = (uint)tag;
+                        SourceTags[++sourceTagsIndex] = (uint)tagIndex;
+                    }
+                }
+
+                foreach (var source in nfa.Sources)
+                    Sources[sourceIndex++] = &States[statesOffset + source.Index];
+                Accepts[i] = &States[statesOffset + nfa.Accept.Index];
+
+                statesOffset += nfa.States.Count;
+            }
+        }
+
+        // Appends the tags of each transition and their `next_len + 1` offsets.
+        private void AddTags(List<IReadOnlyList<int>> nextTags, ref int nextTagsIndex, ref int tagIndex)
+        {
+            nextTagsArr[nextTagsIndex++] = (uint)tagIndex;
+            foreach (var tags in nextTags)
+            {
+                foreach (var tag in tags)
+                    Tags[tagIndex++] = (uint)tag;
+                nextTagsArr[nextTagsIndex++] = (uint)tagIndex;
+            }
+        }
+
+        private NativeAPI.State MakeState(State state, int statesOffset, ref int rangeIndex)
+        {
+            // retreive all data from nullable condition
+            NativeAPI.CharRange* stateRangesPtr = null; // use null for clarity
+            int rangesCount = 0;
+            bool inverted = false;
+            if (state.Condition != null)
+            {
+                stateRangesPtr = &charRangesArr[rangeIndex];
+                rangesCount = state.Condition.Ranges.Count;
+                inverted = state.Condition.Inverted;
+
+                foreach (var range in state.Condition.Ranges)
+                    charRangesArr[rangeIndex++] = new() { start = range.Start, end = range.End };
+            }
+
+            // make an array of pointers to next states
+            NativeAPI.State** nextStates = (NativeAPI.State**)Marshal
+                .AllocHGlobal(state.Next.Count * sizeof(NativeAPI.State*)).ToPointer();
+            int nextStateIndex = 0;
+            foreach (var nextState in state.Next)
+                nextStates[nextStateIndex++] = States + statesOffset + nextState.Index;
+
+            return new()
+            {
+                next = new IntPtr(nextStates),
+                nextLen = (uint)state.Next.Count,
+                ranges = new IntPtr(stateRangesPtr),
+                rangesLen = (uint)rangesCount,
+                invertedMatch = (byte)(inverted ? 1 : 0),
+                counterMin = (uint)(state.Counter?.Min ?? 0),
+                counterMax = state.Counter == null ? 0 : (uint?)state.Counter.Max ?? NativeAPI.CounterUnbounded
+            };
+        }
+
+        public void Dispose()
+        {
+            Dispose(true);
+            GC.SuppressFinalize(this);
+        }
+
+        public void Dispose(bool disposing)
+        {
+            if (!disposed)
+            {
+                for (int i = 0; i < StatesLen; ++i)
+                    Marshal.FreeHGlobal(States[i].next);
+                Marshal.FreeHGlobal(new IntPtr(States));
+                Marshal.FreeHGlobal(new IntPtr(Sources));
+                Marshal.FreeHGlobal(new IntPtr(Accepts));
+                Marshal.FreeHGlobal(new IntPtr(charRangesArr));
+                Marshal.FreeHGlobal(new IntPtr(Tags));
+                Marshal.FreeHGlobal(new IntPtr(SourceTags));
+                Marshal.FreeHGlobal(new IntPtr(nextTagsArr));
+
+                disposed = true;
+            }
+        }
+    }
+}
@@ -115,7 +115,7 @@ namespace Regex.Runtime
             GC.SuppressFinalize(this);
         }
 
-        public unsafe void Dispose(bool disposing)
+        public unsafe virtual void Dispose(bool disposing)
         {
             if (!disposed)
             {
@@ -148,4 +148,45 @@ namespace Regex.Runtime
             sliceStart -= (uint)n;
         }
     }
+
+    /// <summary>
+    /// Reads a file by chunks of the buffer size.
+    /// CompiledRegex.MatchFile() is faster for matching a whole file, this reader is for the APIs
+    /// that accept only readers.
+    /// </summary>
+    public class FileReader : Reader
+    {
+        public const int DefaultBufferCapacity = 1 << 20;
+
+        private readonly FileStream stream;
+
+        public FileReader(string path, int bufferCapacity = DefaultBufferCapacity) : base(bufferCapacity)
+        {
+            stream = new FileStream(
+                path,
+                FileMode.Open,
+                FileAccess.Read,
+                FileShare.Read,
+                bufferSize: 0,
+                FileOptions.SequentialScan
+            );
+        }
+
+        public override (uint sliceStart, uint sliceLen) Read()
+        {
+            return (0, (uint)stream.Read(Buffer, 0, Buffer.Length));
+        }
+
+        public override void Unwind(ulong n)
+        {
+            stream.Seek(-(long)n, SeekOrigin.Current);
+        }
+
+        public override void Dispose(bool disposing)
+        {
+            if (disposing)
+                stream.Dispose();
+            base.Dispose(disposing);
+        }
+    }
 }
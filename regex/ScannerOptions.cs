@@ -0,0 +1,33 @@
+namespace Regex
+{
+    /// <summary>
+    /// Matching engine used by the native runtime.
+    /// </summary>
+    public enum Backend : uint
+    {
+        /// <summary>
+        /// Pick the fastest backend that supports the regex.
+        /// </summary>
+        Auto = 0,
+        /// <summary>
+        /// Plain NFA simulation.
+        /// </summary>
+        Standard,
+        /// <summary>
+        /// x86-64 JIT compiled NFA, supports only small regexes.
+        /// </summary>
+        JIT,
+        /// <summary>
+        /// DFA states are built from NFA on demand and cached.
+        /// </summary>
+        LazyDFA,
+        /// <summary>
+        /// Branch-free NFA simulation, supports only regexes with at most 64 NFA states.
+        /// </summary>
+        BitParallel,
+    }
+
+    /// <param name="Backend">Throws <c>NativeAPIException</c> if the backend can't handle the regex.</param>
+    /// <param name="DfaCacheSize">Memory limit of the lazy DFA states cache in bytes, 0 means default.</param>
+    public record ScannerOptions(Backend Backend = Backend.Auto, uint DfaCacheSize = 0) { }
+}